@@ -62,6 +62,17 @@ class AppController
      */
     void key_event(EventMgr::KeyEvent key);
 
+    /**
+     * @brief Background work in idle time
+     * 
+     * Called when no key has been pressed for a while. The current 
+     * controller may do a bounded chunk of background work.
+     * 
+     * @return true Some work was done, there may be more to do
+     * @return false Nothing to do, the device may go to sleep
+     */
+    bool idle();
+
     void going_to_deep_sleep();
     void launch();
 
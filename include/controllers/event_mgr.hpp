@@ -22,7 +22,7 @@ class EventMgr
     
     void loop();
 
-    KeyEvent get_key();
+    KeyEvent get_key(uint32_t timeout_ms = 15000);
     
     void left();
     void right();
@@ -19,6 +19,9 @@ class GameController
                   game_board(nullptr),
                    game_over(false  ),
           complete_user_move(false  ),
+          analysis_requested(false  ),
+            review_requested(false  ),
+                   reviewing(false  ),
          promotion_move_type(MoveType::UNKNOWN) { }
     
     void           key_event(EventMgr::KeyEvent key);
@@ -28,11 +31,16 @@ class GameController
     void    set_promotion_to(MoveType move_type) { promotion_move_type = move_type; }
     MoveType   get_promotion() { return promotion_move_type; }
     bool  is_game_play_white() { return game_play_white;     }
+    void    request_analysis() { analysis_requested = true;  }
+    void      request_review() { review_requested   = true;  }
     void                save();
+    bool                idle();
 
   private:
     static constexpr char const * TAG = "GameController";
-    static constexpr uint8_t      SAVED_GAME_FILE_VERSION = 1;
+    static constexpr uint8_t      SAVED_GAME_FILE_VERSION = 2;
+    static constexpr uint32_t     ANALYSIS_TIME           = 15000; // ms
+    static constexpr int          ANALYSIS_LINES          = 3;
 
     std::string  msg;
 
@@ -47,6 +55,9 @@ class GameController
     Board      * game_board;
     bool         game_over;
     bool         complete_user_move;
+    bool         analysis_requested;
+    bool         review_requested;
+    bool         reviewing;
 
     MoveType     promotion_move_type;
 
@@ -55,6 +66,8 @@ class GameController
     void        replay();
     bool          load();
     void complete_move(bool async);
+    void       analyse();
+    void        review(EventMgr::KeyEvent key);
 };
 
 #if __BOARD_CONTROLLER__
@@ -0,0 +1,150 @@
+// Copyright (c) 2021 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#pragma once
+
+#include "global.hpp"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Pre-rasterised bitmap font
+ *
+ * Glyphs of a font, rendered offline for a few sizes by the bitmap_font_gen
+ * tool (see tools/). When such a file is found beside a font file, the TTF
+ * class takes glyphs and metrics from it. FreeType is then only used for the
+ * sizes and characters not in the file.
+ *
+ * File format (little endian), <font name>.cibf:
+ *
+ *     BitmapFontHeader header
+ *     BitmapFontSize   sizes[header.size_count]
+ *     BitmapFontGlyph  glyphs[]               Per size, sorted by charcode
+ *     uint8_t          bitmaps[]
+ *
+ * Each size is present twice, one for each pixel resolution. 1-bit bitmaps
+ * are rows of pitch bytes, the leftmost pixel in the most significant bit.
+ * 3-bit bitmaps are rows of (width + 1) / 2 bytes, two pixels per byte, the
+ * leftmost pixel in the high nibble. They are expanded to one byte per pixel
+ * when loaded, the gray level in the 3 most significant bits, as rendered by
+ * FreeType.
+ *
+ * Glyphs are kept in screen orientation: the screen blitters are specialised
+ * for each panel orientation.
+ */
+
+#pragma pack(push, 1)
+struct BitmapFontHeader {
+  char     magic[4];                ///< "CIBF"
+  uint16_t version;
+  uint16_t resolution;              ///< Pixels per inch used for rendering
+  uint16_t size_count;
+  uint16_t reserved;
+};
+
+struct BitmapFontSize {
+  int16_t  glyph_size;              ///< In points
+  uint8_t  bits;                    ///< 1 or 3 bits per pixel
+  uint8_t  reserved;
+  int16_t  line_height;             ///< In pixels
+  int16_t  descender;               ///< In pixels
+  int16_t  em_width;                ///< In pixels
+  int16_t  em_height;               ///< In pixels
+  uint16_t glyph_count;
+  uint16_t reserved2;
+  uint32_t glyphs_offset;           ///< File offset of the size glyphs
+};
+
+struct BitmapFontGlyph {
+  uint16_t charcode;                ///< Unicode, basic multilingual plane
+  uint16_t width, height;           ///< In pixels
+  int16_t  xoff, yoff;
+  int16_t  advance;
+  uint32_t bitmap_offset;           ///< File offset of the bitmap
+};
+#pragma pack(pop)
+
+class BitmapFont
+{
+  private:
+    static constexpr char const * TAG = "BitmapFont";
+
+  public:
+    static constexpr uint16_t VERSION = 1;
+
+    BitmapFont() : buffer(nullptr), size(0), file(nullptr),
+                   header(nullptr), sizes(nullptr), last_size(nullptr) { }
+   ~BitmapFont() { clear(); }
+
+    /**
+     * @brief Load a bitmap font file
+     *
+     * On Linux, the file is memory mapped. On the ESP32, only the header and
+     * sizes table are read at load time. The glyphs table of a size is read
+     * when the size is first used, bitmaps being read when required.
+     *
+     * @param filename The bitmap font file name.
+     * @param resolution The screen resolution in pixels per inch.
+     * @return true The file was loaded.
+     * @return false File not found, invalid or rendered for another resolution.
+     */
+    bool load(const std::string & filename, uint16_t resolution);
+    void clear();
+
+    inline bool ready() const { return sizes != nullptr; }
+
+    /**
+     * @brief Metrics of a glyph size
+     *
+     * @param glyph_size The size in points.
+     * @return const BitmapFontSize* The size entry, nullptr if not in the file.
+     */
+    const BitmapFontSize * get_size(int16_t glyph_size);
+
+    /**
+     * @brief Find a glyph
+     *
+     * @param glyph_size The size in points.
+     * @param bits The pixel resolution (1 or 3 bits).
+     * @param charcode Character code as a unicode number.
+     * @return const BitmapFontGlyph* The glyph, nullptr if not in the file.
+     */
+    const BitmapFontGlyph * get_glyph(int16_t glyph_size, uint8_t bits, int32_t charcode);
+
+    /**
+     * @brief Retrieve a glyph bitmap
+     *
+     * @param glyph The glyph, as returned by get_glyph().
+     * @param bits The glyph pixel resolution.
+     * @param bitmap Where to put the bitmap, pitch() * height bytes.
+     * @return true The bitmap was retrieved.
+     */
+    bool get_bitmap(const BitmapFontGlyph & glyph, uint8_t bits, uint8_t * bitmap);
+
+    /**
+     * @brief Bytes per row of a loaded glyph bitmap
+     */
+    static inline int16_t pitch(uint16_t width, uint8_t bits) {
+      return (bits == 1) ? ((width + 7) >> 3) : width;
+    }
+
+    /**
+     * @brief Size of a glyph bitmap in the file
+     */
+    static inline uint32_t bitmap_size(uint16_t width, uint16_t height, uint8_t bits) {
+      return ((bits == 1) ? ((width + 7) >> 3) : ((width + 1) >> 1)) * height;
+    }
+
+  private:
+    uint8_t                * buffer;    ///< Memory mapped file (Linux) or header and sizes (ESP32)
+    size_t                   size;
+    FILE                   * file;      ///< Bitmaps access (ESP32)
+    const BitmapFontHeader * header;
+    const BitmapFontSize   * sizes;
+    const BitmapFontSize   * last_size;
+
+    std::vector<const BitmapFontGlyph *> glyph_tables; ///< For each size, nullptr until used (ESP32)
+};
@@ -25,8 +25,10 @@ class Fonts
     enum class FaceStyle : uint8_t { NORMAL = 0, BOLD, ITALIC, BOLD_ITALIC };
     struct FontEntry {
       std::string name;
-      TTF *       font;
+      TTF *       font;                   ///< nullptr until first used
       FaceStyle   style;
+      std::string filename;               ///< Empty for memory fonts
+      bool        failed;                 ///< The font file could not be loaded
     };
 
     /**
@@ -40,15 +42,15 @@ class Fonts
     void clear(bool all = false);
 
     TTF * get(int16_t index) {
-      TTF * f; 
       if (index >= font_cache.size()) {
         LOG_E("Fonts.get(): Wrong index: %d vs size: %u", index, font_cache.size());
-        f = font_cache.at(0).font;
+        index = 0;
       }
-      else {
-        f = font_cache.at(index).font;
+      FontEntry & entry = font_cache.at(index);
+      if ((entry.font == nullptr) && (entry.failed || !load(entry, index))) {
+        return (index == 0) ? nullptr : get(0); // The drawings font, loaded by setup()
       }
-      return f;
+      return entry.font;
     };
 
     int16_t get_index(const std::string & name, FaceStyle style);
@@ -66,10 +68,14 @@ class Fonts
     /**
      * @brief Add a font from a file.
      * 
+     * The font is only registered: it will be loaded when first retrieved
+     * through get(). Only the file signature is checked here. If the font
+     * cannot be loaded, get() will return the font at index 0.
+     * 
      * @param name Font name
      * @param style Font style (bold, italic, normal)
      * @param filename File name
-     * @return true The font was loaded
+     * @return true The font was added
      * @return false Some error (file does not exists, etc.)
      */
     bool add(const std::string & name, FaceStyle style, const std::string & filename);
@@ -99,6 +105,8 @@ class Fonts
   private:
     typedef std::vector<FontEntry> FontCache;
     FontCache font_cache;
+
+    bool load(FontEntry & entry, int16_t index);
 };
 
 #if __FONTS__
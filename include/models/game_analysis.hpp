@@ -0,0 +1,107 @@
+// Copyright (c) 2021 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#pragma once
+
+#include "global.hpp"
+
+#include "chess_engine.hpp"
+
+#include <fstream>
+
+/**
+ * @brief Post-game analysis
+ *
+ * Evaluates every position of a finished game with a bounded search budget,
+ * one position (or search chunk) per call to *step()*, such that the work 
+ * can be done in idle time and interrupted at any point. Once all positions have been evaluated,
+ * a new pass is started with a larger budget, refining the scores. The
+ * score loss of each move (from the point of view of the side that played
+ * it) gives its annotation.
+ *
+ * The progress (pass, next position, scores and annotations) is saved
+ * with the game, such that the analysis resumes where it was after a
+ * deep sleep.
+ */
+class GameAnalysis
+{
+  public:
+    static constexpr int16_t MAX_PLIES = 1000;
+
+    enum class Annotation : int8_t { NONE, INACCURACY, MISTAKE, BLUNDER };
+
+    GameAnalysis() { reset(); }
+
+    void reset();
+
+    /**
+     * @brief Start the analysis of a finished game
+     *
+     * @param step_count Number of steps (plies) played in the game
+     */
+    void start(int16_t step_count);
+
+    /**
+     * @brief Analyse the next position
+     *
+     * The engine board is used to set up the position and is left with the
+     * final position of the game on return.
+     *
+     * @param steps The game steps
+     * @return true Some work was done
+     * @return false The analysis is complete (or was not started)
+     */
+    bool step(Step * steps);
+
+    bool save(std::ofstream & file);
+    bool load(std::ifstream & file);
+
+    inline bool    is_started()     const { return step_count >= 0; }
+    inline bool    is_complete()    const { return pass >= PASS_COUNT; }
+    inline int16_t get_step_count() const { return step_count; }
+    inline int8_t  get_pass()       const { return pass;       }
+
+    inline Annotation get_annotation(int16_t ply) const {
+      return ((ply >= 0) && (ply < step_count)) ? annotations[ply] : Annotation::NONE;
+    }
+
+  private:
+    static constexpr char const * TAG = "GameAnalysis";
+
+    static constexpr int16_t NO_SCORE   = INT16_MIN;
+    static constexpr int8_t  PASS_COUNT = 3;
+
+    // Search budget per position for each pass, in milliseconds
+
+    static constexpr uint32_t budgets[PASS_COUNT] = { 1000, 4000, 15000 };
+
+    // Searches are done in chunks, resumed at the next call to step(). A
+    // chunk also ends as soon as a key is waiting (see
+    // ChessEngine::set_interrupt_check()).
+
+    static const uint32_t CHUNK_TIME = 500;
+
+    // Score loss (centipawns) thresholds for annotations. Scores are
+    // clipped to +/- SCORE_CLIP such that a mate is worth a blunder.
+
+    static constexpr int INACCURACY_LOSS =   50;
+    static constexpr int MISTAKE_LOSS    =  100;
+    static constexpr int BLUNDER_LOSS    =  300;
+    static constexpr int SCORE_CLIP      = 1000;
+
+    int16_t    step_count;
+    int8_t     pass;
+    int16_t    next_ply;
+    int16_t    scores[MAX_PLIES + 1];  // Position scores, from the side to move perspective
+    Annotation annotations[MAX_PLIES];
+
+    void set_position(Step * steps, int16_t ply);
+    void     annotate(int16_t ply);
+};
+
+#if __GAME_ANALYSIS__
+  GameAnalysis game_analysis;
+#else
+  extern GameAnalysis game_analysis;
+#endif
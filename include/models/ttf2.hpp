@@ -6,7 +6,7 @@
 
 #include "global.hpp"
 #include "logging.hpp"
-#include "memory_pool.hpp"
+#include "models/bitmap_font.hpp"
 
 #include <ft2build.h>
 
@@ -41,7 +41,7 @@ class TTF
 
     int16_t fonts_cache_index;
     
-    inline bool ready() const { return face != nullptr; }
+    inline bool ready() const { return (face != nullptr) || bitmap_font.ready(); }
     
     /**
      * @brief Get a glyph object
@@ -63,8 +63,9 @@ class TTF
      * @return int32_t Normal line height of the face in pixels
      */
     int32_t get_line_height(int16_t glyph_size)  {
-      if (current_size != glyph_size) set_font_size(glyph_size); 
-      return (face == nullptr) ? 0 : (face->size->metrics.height >> 6); 
+      const BitmapFontSize * size = bitmap_font.ready() ? bitmap_font.get_size(glyph_size) : nullptr;
+      if (size != nullptr) return size->line_height;
+      return use_face(glyph_size) ? (face->size->metrics.height >> 6) : 0; 
     }
 
     /**
@@ -73,13 +74,15 @@ class TTF
      * @return int32_t EM width in pixels related to the current font size. 
      */
     int32_t get_em_width(int16_t glyph_size) {
-      if (current_size != glyph_size) set_font_size(glyph_size); 
-      return (face == nullptr) ? 0 : face->size->metrics.x_ppem; 
+      const BitmapFontSize * size = bitmap_font.ready() ? bitmap_font.get_size(glyph_size) : nullptr;
+      if (size != nullptr) return size->em_width;
+      return use_face(glyph_size) ? face->size->metrics.x_ppem : 0; 
     }
 
     int32_t get_em_height(int16_t glyph_size) { 
-      if (current_size != glyph_size) set_font_size(glyph_size);
-      return (face == nullptr) ? 0 : face->size->metrics.y_ppem; 
+      const BitmapFontSize * size = bitmap_font.ready() ? bitmap_font.get_size(glyph_size) : nullptr;
+      if (size != nullptr) return size->em_height;
+      return use_face(glyph_size) ? face->size->metrics.y_ppem : 0; 
     }
 
     /**
@@ -89,42 +92,91 @@ class TTF
      *                 the current font size.
      */
     int32_t get_descender_height(int16_t glyph_size) {
-      if (current_size != glyph_size) set_font_size(glyph_size);
-      return (face == nullptr) ? 0 : (face->size->metrics.descender >> 6); 
+      const BitmapFontSize * size = bitmap_font.ready() ? bitmap_font.get_size(glyph_size) : nullptr;
+      if (size != nullptr) return size->descender;
+      return use_face(glyph_size) ? (face->size->metrics.descender >> 6) : 0; 
     }
 
     void clear_cache();
 
     void get_size(const char * str, Dim * dim, int16_t glyph_size);
 
+    /**
+     * @brief Glyphs cache memory budget
+     * 
+     * The glyphs of all fonts share this budget. When it is reached, the
+     * least recently used glyph sizes are removed from the caches. Sizes used
+     * since the last page painting are never removed, as their glyphs may be
+     * part of the page display list: the budget may then be exceeded.
+     * 
+     * @param bytes Memory budget in bytes.
+     */
+    static void set_cache_budget(uint32_t bytes) { cache_budget = bytes; }
+    static uint32_t get_cache_bytes() { return cache_bytes; }
+
   private:
-    static constexpr uint16_t BYTE_POOL_SIZE = 16384*2;
+    static constexpr uint16_t       BYTE_POOL_SIZE = 4096;
+    static constexpr uint32_t DEFAULT_CACHE_BUDGET = 512 * 1024;
+    static constexpr int16_t    DIRECT_GLYPH_COUNT = 256;   ///< Latin-1 glyphs are directly indexed
 
-    typedef std::unordered_map<int32_t, BitmapGlyph *> Glyphs; ///< Cache for the glyphs'  bitmap 
-    typedef std::unordered_map<int16_t, Glyphs> GlyphsCache;
-    typedef uint8_t BytePool[BYTE_POOL_SIZE];
-    typedef std::forward_list<BytePool *> BytePools;
-    
-    GlyphsCache cache;
+    typedef std::unordered_map<int32_t, BitmapGlyph *> Glyphs; ///< Glyphs beyond the Latin-1 range
+    typedef std::forward_list<uint8_t *> BytePools;
 
-    MemoryPool<BitmapGlyph> bitmap_glyph_pool;
-    
-    BytePools byte_pools;
-    uint16_t  byte_pool_idx;
+    /**
+     * @brief Glyphs cache for one glyph size
+     * 
+     * The glyphs and their bitmaps are allocated in byte pools belonging to
+     * the size. Removing a size from the cache releases all of them at once.
+     */
+    struct GlyphsCache {
+      int16_t       glyph_size;
+      uint16_t      paint_count;                 ///< Page paint count at last use
+      uint32_t      last_use;                    ///< LRU clock at last use
+      uint32_t      bytes;                       ///< Memory used by this size
+      BitmapGlyph * direct[DIRECT_GLYPH_COUNT];
+      Glyphs        others;
+      BytePools     byte_pools;
+      uint8_t *     byte_pool;                   ///< Pool currently used for small allocations
+      uint16_t      byte_pool_idx;
+    };
+    typedef std::forward_list<GlyphsCache *> GlyphsCaches;
+
+    GlyphsCaches  caches;
+    GlyphsCache * current_cache;                 ///< Last size used
 
-    void add_buff_to_byte_pool();
-    uint8_t * byte_pool_alloc(uint16_t size);
+    static TTF * instances;                      ///< All fonts, for cache eviction
+    TTF        * next_instance;                  ///< A plain list: usable by fonts deleted at exit
+    static uint32_t cache_budget;
+    static uint32_t cache_bytes;
+    static uint32_t lru_clock;
+
+    GlyphsCache *  get_cache(int16_t glyph_size);
+    void         remove_cache(GlyphsCache * cache);
+    uint8_t *  byte_pool_alloc(GlyphsCache * cache, uint16_t size);
+    
+    static void make_room(uint32_t size, const GlyphsCache * keep);
 
     unsigned char * memory_font;                      ///< Buffer for memory fonts
+    #if CHESS_LINUX_BUILD
+      void        * mapped_font;                      ///< Memory mapped font file
+      size_t        mapped_size;
+    #else
+      FT_StreamRec  font_stream;                      ///< Font file, read by FreeType when required
+    #endif
     int current_size;
 
+    BitmapFont  bitmap_font;                          ///< Pre-rasterised glyphs, if available
+    std::string face_filename;                        ///< Font file, opened on first use when there is a bitmap font
+
     static FT_Library library;
     void clear_face();
     
     /**
      * @brief Set the font face object
      * 
-     * Get a font file loaded and ready to supply glyphs.
+     * Get a font file opened and ready to supply glyphs. The file is not
+     * loaded in memory: it is memory mapped on Linux and read through a
+     * FreeType stream on the ESP32, FreeType reading the parts it needs.
      * 
      * @param font_filename The filename of the font. 
      * @return true The font was found and retrieved
@@ -157,5 +209,17 @@ class TTF
      */
     bool set_font_size(int16_t size);
 
+    /**
+     * @brief Get the FreeType face ready for a glyph size
+     * 
+     * When a bitmap font is available, the font file is only opened when
+     * required for a size or a glyph not in the bitmap font.
+     * 
+     * @param glyph_size The size of the glyphs in points.
+     * @return true The face is ready.
+     * @return false The face is not available.
+     */
+    bool use_face(int16_t glyph_size);
+
     BitmapGlyph * get_glyph_internal(int32_t charcode, int16_t glyph_size);    
 };
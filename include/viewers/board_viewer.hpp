@@ -19,26 +19,111 @@
 #include "viewers/page.hpp"
 #include "models/fonts.hpp"
 
+#include "chess_engine_types.hpp"
+
 class BoardViewer
 {
   private:
     static constexpr char const * TAG = "BoardViewer";
 
+    // What is on screen since the last call to show_board()
+
+    struct Shown {
+      bool        valid;
+      bool        play_white;
+      bool        analysis;
+      int8_t      font_index;
+      uint16_t    paint_count;  ///< Page paint count right after the board was painted
+      Dim         dim;          ///< Board square dimensions
+      Board       board;
+      Pos         cursor_pos;
+      Pos         from_pos;
+      std::string msg;
+      int16_t     moves_top;    ///< First line of the moves list shown
+      int16_t     moves_end;    ///< Line after the last one shown
+    } shown;
+
+    // The moves list is laid out incrementally. The text of each move is
+    // kept with the lines it is laid out in: when a move is added, only the
+    // last line is laid out again. The lines are shown one page at a time.
+
+    struct MovesList {
+      std::vector<Step>        steps;        ///< Steps the texts come from
+      std::vector<int8_t>      annotations;  ///< Their annotations when laid out
+      std::vector<std::string> texts;        ///< Move text, numbered for white moves
+      std::vector<std::string> lines;
+      std::vector<int16_t>     line_first;   ///< First move of each line
+      int16_t                  last_width;   ///< Width of the last line in pixels
+      int16_t                  width;        ///< Width available for the lines
+      int16_t                  page_lines;   ///< Lines per page
+      int16_t                  page;         ///< Page shown, counted back from the last one
+      int16_t                  changed_line; ///< First line changed since the list was shown
+    } moves;
+
+    static constexpr int8_t  MOVES_FONT_INDEX = 1;
+    static constexpr int8_t  MOVES_FONT_SIZE  = 10;
+
+    void      layout_moves(Step * steps, int step_count, Dim dim);
+    void       moves_range(int16_t & top, int16_t & end);
+    void        show_moves(Page::Format & fmt, Dim dim, bool clear);
+    void          show_msg(Page::Format & fmt, const std::string & msg);
+    void      show_changes(Page::Format & fmt, Pos cursor_pos, Pos from_pos, const std::string & msg,
+                           Step * steps, int step_count);
+    void          show_all(Page::Format & fmt,
+                           bool           play_white, 
+                           Pos            cursor_pos, 
+                           Pos            from_pos, 
+                           Step         * steps,
+                           int            step_count,
+                           const std::string & msg,
+                           const std::vector<std::string> & analysis);
+
   public:
 
-    BoardViewer() { }
+    BoardViewer() {
+      shown.valid        = false;
+      moves.last_width   = 0;
+      moves.width        = 0;
+      moves.page_lines   = 0;
+      moves.page         = 0;
+      moves.changed_line = 0;
+    }
    ~BoardViewer() { }
 
     /**
      * @brief Show a page on the display.
      * 
+     * The analysis lines, if any, are shown in place of the moves list.
+     * If the screen still shows the last board painted, with the same moves
+     * list, only the squares, cursors and message that changed are redrawn.
      */
     void show_board(bool        play_white, 
                     Pos         cursor_pos, 
                     Pos         from_pos, 
                     Step    * steps, 
                     int         step_count, 
-                    std::string msg);
+                    std::string msg,
+                    const std::vector<std::string> & analysis = {});
+
+    /**
+     * @brief Force the next show_board() to redraw the whole screen.
+     */
+    inline void invalidate() { shown.valid = false; }
+
+    /**
+     * @brief Scroll the moves list
+     * 
+     * The change is shown by the next show_board() call.
+     * 
+     * @param pages Pages to scroll back in the game history, forward if negative.
+     * @return true The list was scrolled.
+     */
+    bool scroll_moves(int16_t pages);
+
+    /**
+     * @brief Show the last page of the moves list at the next show_board() call.
+     */
+    inline void show_last_moves() { moves.page = 0; }
 
     void show_cursor(bool play_white, Dim dim, Pos pos, Page::Format & fmt, bool bold);
 
@@ -5,11 +5,10 @@
 #pragma once
 
 #include <string>
-#include <forward_list>
+#include <vector>
 
 #include "global.hpp"
 #include "models/fonts.hpp"
-#include "memory_pool.hpp"
 
 /**
  * @brief Page preparation
@@ -78,7 +77,7 @@ class Page
           TTF::BitmapGlyph * glyph;    ///< Glyph
         } glyph_entry;
         struct ImageEntry {            ///< Used for IMAGE
-          Image image;       
+          Image image;                 ///< Image, its bitmap being owned by the caller
           int16_t advance;             ///< Horizontal advance on the baseline
         } image_entry;
         struct RegionEntry {           ///< Used for HIGHLIGHT, CLEAR_HIGHLIGHT, SET_REGION and CLEAR_REGION
@@ -90,7 +89,18 @@ class Page
       DisplayListCommand command;      ///< Command
     };
 
-    typedef std::forward_list<DisplayListEntry *> DisplayList;
+    /**
+     * @brief Display list
+     * 
+     * Entries are stored by value, in the order they are added. The lists are
+     * only cleared between pages, keeping their capacity: once the first pages
+     * have been built, adding entries doesn't allocate memory anymore.
+     */
+    typedef std::vector<DisplayListEntry> DisplayList;
+
+    static constexpr uint16_t DISPLAY_LIST_CAPACITY =  512; ///< Entries initially reserved for a page
+    static constexpr uint16_t    LINE_LIST_CAPACITY =  128; ///< Entries initially reserved for a line or a word
+    static constexpr int16_t            BAND_HEIGHT =   32; ///< Screen band height, in pixels, for the paint ordering
 
     /**
      * @brief Book Compute Mode
@@ -103,13 +113,14 @@ class Page
      */
     ComputeMode compute_mode;
 
-    MemoryPool <DisplayListEntry> display_list_entry_pool;
-
     DisplayList display_list;            ///< The list of artefacts and their position to put on screen
     DisplayList line_list;               ///< Line preparation for paragraphs
+    DisplayList word_list;               ///< Word preparation for add_word()
 
     bool screen_is_full;                 ///< True if screen no more space to add characters
 
+    uint16_t paint_count;                ///< Number of screen paintings, for viewers to know if the screen changed
+
     Pos     pos;                         ///< Current drawing Screen position
     int16_t min_y, max_x, max_y, min_x;  ///< Screen limits for page content
     int16_t para_max_x, para_min_x;
@@ -117,9 +128,9 @@ class Page
     int16_t line_width,  glyphs_height;
     int16_t para_indent, top_margin;
 
-    inline void clear_line_list() { line_list.clear(); }
-
+    void clear_line_list();
     void clear_display_list();
+    void     sort_by_band();
     void           add_line(const Format     & fmt,   bool          justifyable);
     void  add_glyph_to_line(TTF::BitmapGlyph * glyph, int16_t       glyph_size, TTF & font, bool is_space);
     int32_t      to_unicode(const char      ** str,   TextTransform transform,  bool  first) const;
@@ -240,7 +251,8 @@ class Page
      * @brief Paint the display list to the screen.
      * 
      * The screen is first erased and the painting process is done using 
-     * the content of the display list.
+     * the content of the display list. Glyphs are painted by screen band,
+     * following the frame buffer row order.
      * 
      * @param clear_screen Screen contain is erased before painting.
      * @param no_full      Bypass partial update count control. Use with great caution!
@@ -306,6 +318,7 @@ class Page
     inline const DisplayList &  get_display_list() const { return display_list;           }
     inline const DisplayList &     get_line_list() const { return line_list;              }
     inline int16_t                     get_pos_y() const { return pos.y;                  }
+    inline uint16_t              get_paint_count() const { return paint_count;            }
 
     inline void reset_font_index(Format & fmt, Fonts::FaceStyle style) {
       if (style != fmt.font_style) {
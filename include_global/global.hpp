@@ -21,10 +21,12 @@
   #endif
 #endif
 
-#if CHESS_LINUX_BUILD
-  #define MAIN_FOLDER "/home/turgu1/Dev/Chess-InkPlate/SDCard"
-#else
-  #define MAIN_FOLDER "/sdcard"
+#ifndef MAIN_FOLDER
+  #if CHESS_LINUX_BUILD
+    #define MAIN_FOLDER "/home/turgu1/Dev/Chess-InkPlate/SDCard"
+  #else
+    #define MAIN_FOLDER "/sdcard"
+  #endif
 #endif
 
 #define FONTS_FOLDER MAIN_FOLDER "/fonts"
@@ -16,6 +16,10 @@
 #define _WEIGHTS_ 1
 #include "chess_engine_weights.hpp"
 
+#include "chess_engine_nnue.hpp"
+#include "chess_engine_cache.hpp"
+#include "chess_engine_bitbase.hpp"
+
 #include <cinttypes>
 #include <string>
 #include <iostream>
@@ -24,42 +28,270 @@
 #include <algorithm>
 #include <cctype>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <chrono>
 #include <cstring>
+#include <new>
 
 #include <cassert>
 
 // =====Shared variables ==================================================
 
-static Board board;
+// The board, kings location and figures lists are private to each search 
+// thread. The main thread is the one calling solve_step().
+
+static thread_local Board board;
+
+static thread_local int8_t idx_white_king = 0;
+static thread_local int8_t idx_black_king = 0;
+
+// Figures location lists, one per side ([0] = white, [1] = black), kings
+// included. piece_slot gives the entry of an occupied board location in the
+// list of its side, for constant time removal. The lists are maintained by 
+// move_step() and back_step() and rebuilt by init_piece_lists(), such that
+// move generation doesn't have to scan the whole board.
 
-static int8_t idx_white_king = 0;
-static int8_t idx_black_king = 0;
-static bool          endgame = false;
+static thread_local int8_t piece_list[2][16];
+static thread_local int8_t piece_count[2];
+static thread_local int8_t piece_slot[64];
 
-static Position pos[MAXDEPTH + 1];
+static inline void
+add_piece(int side, int8_t board_idx)
+{
+  piece_slot[board_idx] = piece_count[side];
+  piece_list[side][piece_count[side]++] = board_idx;
+}
 
-enum class TaskReq    : int8_t { EXEC, STOP };
-enum class EngineReq  : int8_t { COMPLETED  };
+static inline void
+remove_piece(int side, int8_t board_idx)
+{
+  int8_t slot = piece_slot[board_idx];
+  int8_t last = piece_list[side][--piece_count[side]];
 
-struct TaskQueueData {
-  TaskReq req;
+  piece_list[side][slot] = last;
+  piece_slot[last]       = slot;
+}
+
+static inline void
+move_piece(int side, int8_t from_idx, int8_t to_idx)
+{
+  int8_t slot = piece_slot[from_idx];
+
+  piece_list[side][slot] = to_idx;
+  piece_slot[to_idx]     = slot;
+}
+
+// Pawn structure hash table. Pawns are moving seldomly and their structure is
+// found again and again in the search tree. The structure evaluation is then
+// kept here, indexed by the pawns Zobrist key. The king shield part depends
+// on the kings location and is refreshed when they are not the same.
+
+struct PawnHashEntry {
+  uint32_t key;
+  int16_t  score_mg;
+  int16_t  score_eg;
+  int16_t  shield_mg;
+  int8_t   white_king_idx;
+  int8_t   black_king_idx;
 };
 
-struct EngineQueueData {
-  EngineReq req;
+static uint32_t pawn_zobrist[2][64]; // [0] = white, [1] = black
+
+static inline uint32_t 
+pawn_zobrist_key(int8_t fig, int8_t board_idx)
+{
+  return pawn_zobrist[(fig > 0) ? 0 : 1][board_idx];
+}
+
+// Parallel search (young brothers wait). Once the first step of a node has 
+// been searched, the remaining steps are offered to idle threads through a
+// split point. Each thread owns a stack of split points, from which the
+// idle threads steal steps to be searched. A thread joining a split point
+// copies the board and the path of positions leading to it, and searches
+// the steps it takes on its own copy.
+
+const int ILLEGAL_STEP = 30000; // search_step() result for a step leaving the king in check
+
+struct SplitPoint {
+  SplitPoint            * parent;      // Split point the master was working for
+  Position              * master_pos;  // Positions of the master thread
+  Board                   board;       // Board at the split node
+  int                     pos_idx;
+  int                     depth_left;
+  int                     beta;
+  int                     steps_count;
+  bool                    white;
+  bool                    zero;
+  bool                    lazy;
+
+  std::mutex              lock;        // Protects the following fields
+  std::condition_variable done;        // Signaled when a helper is leaving
+  bool                    open;        // Helpers can join
+  int                     helpers;     // Helpers currently working here
+  int                     next_step;   // Next step to be searched
+  int                     alpha;
+  int                     score;
+  bool                    best_found;
+  Step                    best;
+  Step                    pv[MAXDEPTH + 1];  // Principal variation of best
+  int8_t                  pv_length;
+  std::atomic<bool>       cutoff;      // Remaining steps are useless
+};
+
+struct ThreadData {
+  Position         pos[MAXDEPTH + 1];
+  PawnHashEntry    pawn_hash[PAWN_HASH_SIZE];
+  SplitPoint       split_points[MAX_SPLIT_POINTS];
+  int              split_count;
+
+  // Principal variations: pv[i][i..pv_length[i]-1] is the best line found
+  // from the node at pos_idx i.
+
+  Step             pv[MAXDEPTH + 1][MAXDEPTH + 1];
+  int8_t           pv_length[MAXDEPTH + 1];
+
+  // Statistics, only modified by the owning thread
+
+  std::atomic<int> move_count;
+  std::atomic<int> pawn_hash_misses;
+  std::atomic<int> depth;
+  std::atomic<int> null_tries;         // Null move searches
+  std::atomic<int> null_cutoffs;       // Null move searches failing high
+  std::atomic<int> null_verify_fails;  // ... but refuted by the verification search
+  std::atomic<int> null_nodes;         // Nodes spent in null move searches
+  std::atomic<int> bitbase_hits;       // Nodes resolved by the bitbases
 };
 
-#if CHESS_LINUX_BUILD  
-  static mqd_t   task_queue;
-  static mqd_t   engine_queue;
+static ThreadData   main_thread_data;
+static ThreadData * thread_data[MAX_SEARCH_THREADS] = { &main_thread_data };
+
+static thread_local ThreadData    * cur_thread   = &main_thread_data;
+static thread_local Position      * pos          = main_thread_data.pos;
+static thread_local PawnHashEntry * pawn_hash    = main_thread_data.pawn_hash;
+static thread_local SplitPoint    * active_split = nullptr;
+static thread_local bool            zero         = false; // In a null move search
+static thread_local bool            lazy         = false;
+static thread_local bool            skip_null    = false; // No null move at the next node (verification search)
+
+static std::mutex              work_mutex;       // Idle threads are waiting on work_available
+static std::condition_variable work_available;
+static std::atomic<int>        idle_threads(0);
+static bool                    stopping = false; // Protected by work_mutex
+
+// Nodes with less pieces (kings included) than this are looked up in the
+// bitbases. As the tables tell who wins but not how, the root position
+// itself and those with as many pieces are searched as usual.
+
+static int bitbase_pieces = 0;
+
+// The helper threads are stopped at exit, before the objects they are 
+// waiting on are destroyed.
+
+static struct Workers {
+  std::thread threads[MAX_SEARCH_THREADS - 1];
+
+  ~Workers() {
+    {
+      std::lock_guard<std::mutex> guard(work_mutex);
+      stopping = true;
+    }
+    work_available.notify_all();
+    for (auto & thread : threads) if (thread.joinable()) thread.join();
+  }
+} workers;
+
+// The step of a node improving alpha starts the node principal variation,
+// followed by the one of the child node.
+
+static inline void
+update_pv(int pos_idx, const Step & step)
+{
+  Step * line  = cur_thread->pv[pos_idx];
+  Step * child = cur_thread->pv[pos_idx + 1];
+  int    end   = std::max<int>(cur_thread->pv_length[pos_idx + 1], pos_idx + 1);
+
+  line[pos_idx] = step;
+  for (int i = pos_idx + 1; i < end; i++) line[i] = child[i];
+  cur_thread->pv_length[pos_idx] = end;
+}
+
+static inline void
+increment(std::atomic<int> & counter, int value = 1)
+{
+  counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+static int
+total(std::atomic<int> ThreadData::* counter, int thread_count)
+{
+  int sum = 0;
+  for (int i = 0; i < thread_count; i++) sum += thread_data[i]->*counter;
+  return sum;
+}
+
+// Non pawn material of a side, in game phase units.
+
+static inline int
+piece_phase(int side)
+{
+  int phase = 0;
+  for (int i = 0; i < piece_count[side]; i++) phase += fig_phase[abs(board[piece_list[side][i]])];
+  return phase;
+}
+
+// Check if the search done by this thread became useless, following a cutoff 
+// in one of the split points it is working for.
+
+static inline bool
+split_cutoff()
+{
+  for (SplitPoint * sp = active_split; sp != nullptr; sp = sp->parent) {
+    if (sp->cutoff.load(std::memory_order_relaxed)) return true;
+  }
+  return false;
+}
+
+// Find a split point with remaining steps to search. Called with work_mutex 
+// locked.
+
+static SplitPoint *
+find_split_point()
+{
+  for (int thread_idx = 0; thread_idx < MAX_SEARCH_THREADS; thread_idx++) {
+    if ((thread_data[thread_idx] == nullptr) || (thread_data[thread_idx] == cur_thread)) continue;
+
+    for (SplitPoint & sp : thread_data[thread_idx]->split_points) {
+      std::lock_guard<std::mutex> guard(sp.lock);
+      if (sp.open && !sp.cutoff && (sp.next_step < sp.steps_count)) {
+        sp.helpers++;
+        return &sp;
+      }
+    }
+  }
+  return nullptr;
+}
+
+// Piece-square values of a figure, from the white side point of view.
+// The middle game and end game tables differ for the king only.
 
-  static mq_attr task_attr      = { 0, 5, sizeof(  TaskQueueData), 0 };
-  static mq_attr engine_attr    = { 0, 5, sizeof(EngineQueueData), 0 };
+static inline int 
+pst_mg(int8_t fig, int8_t board_idx)
+{
+  return (fig > 0) ?  stat_weight_white[ fig - 1][board_idx] 
+                   : -stat_weight_black[-fig - 1][board_idx];
+}
 
-  #define    QUEUE_SEND(q, m, t)     mq_send(q, (const char *) &m, sizeof(m),       1)
-  #define QUEUE_RECEIVE(q, m, t)  mq_receive(q,       (char *) &m, sizeof(m), nullptr)
-#else
+static inline int 
+pst_eg(int8_t fig, int8_t board_idx)
+{
+  if (fig ==  KING) return  stat_weight_white[KING][board_idx];
+  if (fig == -KING) return -stat_weight_black[KING][board_idx];
+  return pst_mg(fig, board_idx);
+}
+
+#if !CHESS_LINUX_BUILD
   #include <esp_pthread.h>
 
   static esp_pthread_cfg_t create_config(const char *name, int core_id, int stack, int prio)
@@ -71,36 +303,27 @@ struct EngineQueueData {
       cfg.prio = prio;
       return cfg;
   }
-
-  static xQueueHandle task_queue;
-  static xQueueHandle engine_queue;
-  
-  #define    QUEUE_SEND(q, m, t)  xQueueSend(q, &m, t)
-  #define QUEUE_RECEIVE(q, m, t)  while (!xQueueReceive(q, &m, t)) std::this_thread::yield()
 #endif
 
 // ===== Shared funtions ==================================================
 
+// Check if the king of a side is attacked by a sliding figure (bishop, rook, 
+// queen) or by the other king.
+template <bool WHITE>
 bool 
-ChessEngine::check_on_white_king()
+ChessEngine::checkd()
 {
+  constexpr int8_t them     = WHITE ? -1 : 1; // Sign of the opponent figures
+  const     int8_t king_idx = WHITE ? idx_white_king : idx_black_king;
+
   int8_t f2 = NO_FIG;
   int    j  = 0;
-  
-  if (board[idx_white_king] != KING) {
-    for (int i = 0; i < 64; i++) {
-      if (board[i] == KING) {
-        idx_white_king = i;
-        break;
-      }
-    }
-  }
 
-  while (diag_step[idx_white_king][j] != 99) {
-    if (diag_step[idx_white_king][j] == 88) f2 = NO_FIG;
+  while (diag_step[king_idx][j] != 99) {
+    if (diag_step[king_idx][j] == 88) f2 = NO_FIG;
     else if (f2 == NO_FIG) {
-      f2 = board[diag_step[idx_white_king][j]];
-      if (f2 == -BISHOP || f2 == -QUEEN) return true;
+      f2 = board[diag_step[king_idx][j]];
+      if ((f2 == them * BISHOP) || (f2 == them * QUEEN)) return true;
     }
     j++;
   }
@@ -108,572 +331,352 @@ ChessEngine::check_on_white_king()
   f2 = NO_FIG;
   j  = 0;
 
-  while (stra_step[idx_white_king][j] != 99) {
-    if (stra_step[idx_white_king][j] == 88) f2 = NO_FIG;
+  while (stra_step[king_idx][j] != 99) {
+    if (stra_step[king_idx][j] == 88) f2 = NO_FIG;
     else if (f2 == NO_FIG) {
-      f2 = board[stra_step[idx_white_king][j]];
-      if ((f2 == -ROOK) || (f2 == -QUEEN)) return true;
-      if ((j == 0) || (stra_step[idx_white_king][j] == 88))
-        if (f2 == -KING) return true;
+      f2 = board[stra_step[king_idx][j]];
+      if ((f2 == them * ROOK) || (f2 == them * QUEEN)) return true;
+      if ((j == 0) || (stra_step[king_idx][j] == 88)) {
+        if (f2 == them * KING) return true;
+      }
     }
     j++;
   }
 
-  j = 0;
-  while (knight_step[idx_white_king][j] != 99) {
-    if (board[knight_step[idx_white_king][j]] == -KNIGHT) return true;
-    j++;
-  }
-  if (row[idx_white_king] < 7) {
-    if ((column[idx_white_king] > 1) && (board[idx_white_king - 9] == -PAWN)) return true;
-    if ((column[idx_white_king] < 8) && (board[idx_white_king - 7] == -PAWN)) return true;
-  }
-  j = 0;
-  while (king_step[idx_white_king][j] != 99) {
-    if (board[king_step[idx_white_king][j]] == -KING) return true;
-    j++;
-  }
-  
   return false;
 }
 
+// Check if the king of a side is attacked by any figure.
+template <bool WHITE>
 bool 
-ChessEngine::check_on_black_king()
+ChessEngine::check_on_king()
 {
-  int8_t f2 = NO_FIG;
-  int    j  = 0;
-  
-  if (board[idx_black_king] != -KING) {
-    for (int i = 0; i < 64; i++) { 
-      if (board[i] == -KING) {
-        idx_black_king = i;
-        break;
-      }
-    }
-  }
-
-  while (diag_step[idx_black_king][j] != 99) {
-    if (diag_step[idx_black_king][j] == 88) f2 = NO_FIG;
-    else if (f2 == NO_FIG) {
-      f2 = board[diag_step[idx_black_king][j]];
-      if (f2 == BISHOP || f2 == QUEEN) return true;
-    }
-    j++;
-  }
-
-  f2 = NO_FIG;
-  j  = 0;
+  constexpr int8_t them     = WHITE ? -1 :  1; // Sign of the opponent figures
+  constexpr int8_t forward  = WHITE ? -8 :  8;
+  const     int8_t king_idx = WHITE ? idx_white_king : idx_black_king;
 
-  while (stra_step[idx_black_king][j] != 99) {
-    if (stra_step[idx_black_king][j] == 88) f2 = NO_FIG;
-    else if (f2 == NO_FIG) {
-      f2 = board[stra_step[idx_black_king][j]];
-      if (f2 == ROOK || f2 == QUEEN) return true;
-      if (j == 0 || stra_step[idx_black_king][j] == 88) {
-        if (f2 == KING) return true;
-      }
-    }
-    j++;
-  }
+  int j = 0;
 
-  j = 0;
+  if (checkd<WHITE>()) return true;
 
-  while (knight_step[idx_black_king][j] != 99) {
-    if (board[knight_step[idx_black_king][j]] == KNIGHT) return true;
+  while (knight_step[king_idx][j] != 99) {
+    if (board[knight_step[king_idx][j]] == them * KNIGHT) return true;
     j++;
   }
 
-  if (row[idx_black_king] > 2) {
-    if ((column[idx_black_king] > 1) && (board[idx_black_king + 7] == PAWN)) return true;
-    if ((column[idx_black_king] < 8) && (board[idx_black_king + 9] == PAWN)) return true;
+  if (WHITE ? (row[king_idx] < 7) : (row[king_idx] > 2)) {
+    if ((column[king_idx] > 1) && (board[king_idx + forward - 1] == them * PAWN)) return true;
+    if ((column[king_idx] < 8) && (board[king_idx + forward + 1] == them * PAWN)) return true;
   }
 
   j = 0;
-
-  while (king_step[idx_black_king][j] != 99) {
-    if (board[king_step[idx_black_king][j]] == KING) return true;
+  while (king_step[king_idx][j] != 99) {
+    if (board[king_step[king_idx][j]] == them * KING) return true;
     j++;
   }
-
+  
   return false;
 }
 
-// ===== Chess Task =======================================================
-
-// This task is parallellizing part of the move generator. It takes care of all
-// moves related to pawns and kings.
-void ChessTask::exec()
+bool 
+ChessEngine::check_on_white_king()
 {
-  int    pos_idx;
-  int8_t f;
-  //unsigned long task_tik;
-  //unsigned long task_count = 0;
-
-  TaskQueueData task_queue_data;
-
-  for (;;) {
-    QUEUE_RECEIVE(task_queue, task_queue_data, 5000 / portTICK_PERIOD_MS);
-    if (task_queue_data.req == TaskReq::EXEC) {
-      // task_tik=micros();
-      pos_idx = task_pos_idx;
-      assert((pos_idx >= 0) && (pos_idx < MAXDEPTH));
-      if (board[idx_white_king] != KING) {
-        for (int board_idx = 0; board_idx < 64; board_idx++) {
-          if (board[board_idx] == KING) {
-            idx_white_king = board_idx;
-            break;
-          }
-        }
-      }
-      if (board[idx_black_king] != -KING) {
-        for (int board_idx = 0; board_idx < 64; board_idx++) {
-          if (board[board_idx] == -KING) {
-            idx_black_king = board_idx;
-            break;
-          }
-        }
-      }
-      assert((pos_idx >= 0) && (pos_idx < MAXDEPTH));
-      if (pos_idx > 0) {
-        if (pos[pos_idx - 1].steps[pos[pos_idx - 1].cur_step].check == CheckType::NONE) {
-          if (pos[pos_idx].white_move) 
-            pos[pos_idx].check_on_table = chess_engine.check_on_white_king();
-          else 
-            pos[pos_idx].check_on_table = chess_engine.check_on_black_king();
-          pos[pos_idx - 1].steps[pos[pos_idx - 1].cur_step].check = 
-            pos[pos_idx].check_on_table ? CheckType::CHECK : CheckType::NONE;
-        } 
-        else pos[pos_idx].check_on_table = true;
-      } 
-      else if (pos[0].white_move) pos[0].check_on_table = chess_engine.check_on_white_king();
-      else pos[0].check_on_table = chess_engine.check_on_black_king();
-
-      steps_count = 0;
-
-      for (int ii = 0; ii < 64; ii++) {
-        int board_idx = (pos[pos_idx].white_move)  ? ii : 63 - ii;
-
-        f = board[board_idx];
-
-        if ((f == NO_FIG) || 
-            (chess_engine.is_black_fig(f) &&  pos[pos_idx].white_move) || 
-            (chess_engine.is_white_fig(f) && !pos[pos_idx].white_move)) continue;
-
-        if (f == PAWN) {
-          if ((ChessEngine::row[board_idx] < 7) && (board[board_idx - 8] == NO_FIG)) add_one_step(board_idx, board_idx - 8);
-          if ((ChessEngine::row[board_idx] == 2) && (board[board_idx - 8] == NO_FIG) && (board[board_idx - 16] == NO_FIG)) add_one_step(board_idx, board_idx - 16);
-          if (ChessEngine::row[board_idx] == 7) {
-            if (board[board_idx - 8] == NO_FIG) { // No piece on front on last row
-              add_one_step(board_idx, board_idx - 8); steps[steps_count - 1].type = MoveType::PROMOTE_TO_KNIGHT;
-              add_one_step(board_idx, board_idx - 8); steps[steps_count - 1].type = MoveType::PROMOTE_TO_BISHOP;
-              add_one_step(board_idx, board_idx - 8); steps[steps_count - 1].type = MoveType::PROMOTE_TO_ROOK;
-              add_one_step(board_idx, board_idx - 8); steps[steps_count - 1].type = MoveType::PROMOTE_TO_QUEEN;
-            }
-            if ((ChessEngine::column[board_idx] > 1) && chess_engine.is_black_fig(board[board_idx - 9])) { // A piece can be taken on last row to the left
-              add_one_step(board_idx, board_idx - 9); steps[steps_count - 1].type = MoveType::PROMOTE_TO_KNIGHT;
-              add_one_step(board_idx, board_idx - 9); steps[steps_count - 1].type = MoveType::PROMOTE_TO_BISHOP;
-              add_one_step(board_idx, board_idx - 9); steps[steps_count - 1].type = MoveType::PROMOTE_TO_ROOK;
-              add_one_step(board_idx, board_idx - 9); steps[steps_count - 1].type = MoveType::PROMOTE_TO_QUEEN;
-            }
-            if ((ChessEngine::column[board_idx] < 8) && chess_engine.is_black_fig(board[board_idx - 7])) { // A piece can be taken on last row to the right
-              add_one_step(board_idx, board_idx - 7); steps[steps_count - 1].type = MoveType::PROMOTE_TO_KNIGHT;
-              add_one_step(board_idx, board_idx - 7); steps[steps_count - 1].type = MoveType::PROMOTE_TO_BISHOP;
-              add_one_step(board_idx, board_idx - 7); steps[steps_count - 1].type = MoveType::PROMOTE_TO_ROOK;
-              add_one_step(board_idx, board_idx - 7); steps[steps_count - 1].type = MoveType::PROMOTE_TO_QUEEN;
-            }
-          } 
-          else {
-            if ((ChessEngine::column[board_idx] > 1) && chess_engine.is_black_fig(board[board_idx - 9])) add_one_step(board_idx, board_idx - 9);
-            if ((ChessEngine::column[board_idx] < 8) && chess_engine.is_black_fig(board[board_idx - 7])) add_one_step(board_idx, board_idx - 7);
-          }
-        } 
-        else if (f == -PAWN) {
-
-          if ((ChessEngine::row[board_idx] > 2) && (board[board_idx + 8] == NO_FIG)) add_one_step(board_idx, board_idx + 8);
-          if ((ChessEngine::row[board_idx] == 7) && (board[board_idx + 8] == NO_FIG) && (board[board_idx + 16] == NO_FIG)) add_one_step(board_idx, board_idx + 16);
-          if (ChessEngine::row[board_idx] == 2) {
-            if (board[board_idx + 8] == NO_FIG) {
-              add_one_step(board_idx, board_idx + 8); steps[steps_count - 1].type = MoveType::PROMOTE_TO_KNIGHT;
-              add_one_step(board_idx, board_idx + 8); steps[steps_count - 1].type = MoveType::PROMOTE_TO_BISHOP;
-              add_one_step(board_idx, board_idx + 8); steps[steps_count - 1].type = MoveType::PROMOTE_TO_ROOK;
-              add_one_step(board_idx, board_idx + 8); steps[steps_count - 1].type = MoveType::PROMOTE_TO_QUEEN;
-            }
-            if ((ChessEngine::column[board_idx] > 1) && chess_engine.is_white_fig(board[board_idx + 7])) {
-              add_one_step(board_idx, board_idx + 7); steps[steps_count - 1].type = MoveType::PROMOTE_TO_KNIGHT;
-              add_one_step(board_idx, board_idx + 7); steps[steps_count - 1].type = MoveType::PROMOTE_TO_BISHOP;
-              add_one_step(board_idx, board_idx + 7); steps[steps_count - 1].type = MoveType::PROMOTE_TO_ROOK;
-              add_one_step(board_idx, board_idx + 7); steps[steps_count - 1].type = MoveType::PROMOTE_TO_QUEEN;
-            }
-            if ((ChessEngine::column[board_idx] < 8) && chess_engine.is_white_fig(board[board_idx + 9])) {
-              add_one_step(board_idx, board_idx + 9); steps[steps_count - 1].type = MoveType::PROMOTE_TO_KNIGHT;
-              add_one_step(board_idx, board_idx + 9); steps[steps_count - 1].type = MoveType::PROMOTE_TO_BISHOP;
-              add_one_step(board_idx, board_idx + 9); steps[steps_count - 1].type = MoveType::PROMOTE_TO_ROOK;
-              add_one_step(board_idx, board_idx + 9); steps[steps_count - 1].type = MoveType::PROMOTE_TO_QUEEN;
-            }
-          } 
-          else {
-            if ((ChessEngine::column[board_idx] > 1) && chess_engine.is_white_fig(board[board_idx + 7])) add_one_step(board_idx, board_idx + 7);
-            if ((ChessEngine::column[board_idx] < 8) && chess_engine.is_white_fig(board[board_idx + 9])) add_one_step(board_idx, board_idx + 9);
-          }
-        } 
-        else if (!endgame && (abs(f) == KING)) add_king_step(board_idx);
-      }
-
-      if ((pos[pos_idx].en_passant_pp != 0) && 
-          (board[pos[pos_idx].en_passant_pp] == NO_FIG)) {
-        if (pos[pos_idx].white_move) {
-          if ((ChessEngine::column[pos[pos_idx].en_passant_pp] > 1) && 
-              (board[pos[pos_idx].en_passant_pp + 7] == PAWN)) {
-            add_one_step(pos[pos_idx].en_passant_pp + 7, pos[pos_idx].en_passant_pp);
-            steps[steps_count - 1].type = MoveType::EN_PASSANT;
-            steps[steps_count - 1].f2   = -PAWN;
-          }
-          if ((ChessEngine::column[pos[pos_idx].en_passant_pp] < 8) && 
-              (board[pos[pos_idx].en_passant_pp + 9] == PAWN)) {
-            add_one_step(pos[pos_idx].en_passant_pp + 9, pos[pos_idx].en_passant_pp);
-            steps[steps_count - 1].type = MoveType::EN_PASSANT;
-            steps[steps_count - 1].f2   = -PAWN;
-          }
-        } 
-        else {
-          if ((ChessEngine::column[pos[pos_idx].en_passant_pp] > 1) && 
-              (board[pos[pos_idx].en_passant_pp - 9] == -PAWN)) {
-            add_one_step(pos[pos_idx].en_passant_pp - 9, pos[pos_idx].en_passant_pp);
-            steps[steps_count - 1].type = MoveType::EN_PASSANT;
-            steps[steps_count - 1].f2   = PAWN;
-          }
-          if ((ChessEngine::column[pos[pos_idx].en_passant_pp] < 8) && 
-              (board[pos[pos_idx].en_passant_pp - 7] == -PAWN)) {
-            add_one_step(pos[pos_idx].en_passant_pp - 7, pos[pos_idx].en_passant_pp);
-            steps[steps_count - 1].type = MoveType::EN_PASSANT;
-            steps[steps_count - 1].f2   = PAWN;
-          }
-        }
-      }
-      //   task_execute+=micros()-task_tik;
-      EngineQueueData engine_queue_data;
-      engine_queue_data.req = EngineReq::COMPLETED;
-      QUEUE_SEND(engine_queue, engine_queue_data, 0);
-    }
-    else {
-      sched_yield();
-    }
-
-    // task_count++;
+  return check_on_king<true>();
+}
 
-    // if (task_count > 7000000) {
-    //   task_count = 0;
-    //   if (!std::cin.eof()) {
-    //     std::string s;
-    //     std::getline(std::cin, s, '\n');
-    //     trim(s);
-    //     to_uppercase(s);
-    //     if (s == "STOP") {
-    //       halt = true;
-    //       std::cout << "STOPPED" << std::endl;
-    //     } //timelimith=millis(); }
-    //   } 
-    //   else delay(1);
-    // }
-  }
+bool 
+ChessEngine::check_on_black_king()
+{
+  return check_on_king<false>();
 }
 
+// ===== Chess Engine =====================================================
+
 void 
-ChessTask::add_one_step(int c1, int c2)
+ChessEngine::move_pos(int pos_idx, Step & step)
 {
-  steps[steps_count].type = MoveType::SIMPLE;
-  steps[steps_count].c1   = c1;
-  steps[steps_count].c2   = c2;
-  steps[steps_count].f1   = board[c1];
-  steps[steps_count].f2   = board[c2];
-  steps_count++;
+  if (pos[pos_idx].white_move) move_pos<true >(pos_idx, step);
+  else                         move_pos<false>(pos_idx, step);
 }
 
-void
-ChessTask::add_king_step(int8_t board_idx)
+template <bool WHITE>
+void 
+ChessEngine::move_pos(int pos_idx, Step & step)
 {
-  signed char f1 = board[board_idx];
-  signed char f2;
-  int         j  = 0;
+  constexpr int8_t us        = WHITE ?  1 : -1; // Sign of the side to move figures
+  constexpr int8_t forward   = WHITE ? -8 :  8;
+  constexpr int8_t king_home = WHITE ? 60 :  4;
 
-  while (king_step[board_idx][j] != 99) {
-    f2 = board[king_step[board_idx][j]];
-    if ((f2 == NO_FIG) || 
-        (chess_engine.is_black_fig(f2) && chess_engine.is_white_fig(f1)) || 
-        (chess_engine.is_white_fig(f2) && chess_engine.is_black_fig(f1))) {
-      steps[steps_count].type =MoveType::SIMPLE;
-      steps[steps_count].c1 = board_idx;
-      steps[steps_count].c2 = king_step[board_idx][j];
-      steps[steps_count].f1 = f1;
-      steps[steps_count].f2 = f2;
-      steps_count++;
+  assert((pos_idx >= 0) && (pos_idx < MAXDEPTH));
+
+  Position & cur  = pos[pos_idx];
+  Position & next = pos[pos_idx + 1];
+
+  next.white_castle_kingside_ok  = cur.white_castle_kingside_ok;
+  next.white_castle_queenside_ok = cur.white_castle_queenside_ok;
+  next.black_castle_kingside_ok  = cur.black_castle_kingside_ok;
+  next.black_castle_queenside_ok = cur.black_castle_queenside_ok;
+  next.en_passant_pp = 0;
+
+  bool & kingside_ok  = WHITE ? next.white_castle_kingside_ok  : next.black_castle_kingside_ok;
+  bool & queenside_ok = WHITE ? next.white_castle_queenside_ok : next.black_castle_queenside_ok;
+
+  if (kingside_ok || queenside_ok) {
+    if (step.c1 == king_home) {
+      kingside_ok  = false;
+      queenside_ok = false;
+    } 
+    else if (step.c1 == king_home + 3) kingside_ok  = false;
+    else if (step.c1 == king_home - 4) queenside_ok = false;
+  }
+  if ((step.type == MoveType::SIMPLE) && (step.f1 == us * PAWN) && (step.c2 == step.c1 + 2 * forward)) {
+    if (((column[step.c2] > 1) && (board[step.c2 - 1] == -us * PAWN)) || 
+        ((column[step.c2] < 8) && (board[step.c2 + 1] == -us * PAWN))) {
+      next.en_passant_pp = step.c1 + forward;
     }
-    j++;
   }
-}
 
-void
-ChessTask::retrieve_steps(int pos_idx)
-{
-  assert((pos_idx >= 0) && (pos_idx < MAXDEPTH));
+  next.weight_white = cur.weight_white;
+  next.weight_black = cur.weight_black;
+
+  short & own_weight   = WHITE ? next.weight_white : next.weight_black;
+  short & other_weight = WHITE ? next.weight_black : next.weight_white;
 
-  int count = pos[pos_idx].steps_count;
-  for (int i = 0; i < steps_count; i++) {
-    pos[pos_idx].steps[count++] = steps[i];
+  if (step.f2 != NO_FIG) other_weight -= fig_weight[abs(step.f2)];
+  if (step.type > MoveType::CASTLE_QUEENSIDE) {
+    own_weight += fig_weight[(int)(step.type) - 2] - 100;
   }
-  pos[pos_idx].steps_count = count;
-}
 
-// ===== Chess Engine =====================================================
+  if (stats) {
+    int8_t placed = step.f1;
+    int    mg     = cur.score_mg;
+    int    eg     = cur.score_eg;
+    int    phase  = cur.phase;
 
-void 
-ChessEngine::move_pos(int pos_idx, Step & step)
-{
-  assert((pos_idx >= 0) && (pos_idx < MAXDEPTH));
-
-  pos[pos_idx + 1].white_castle_kingside_ok  = pos[pos_idx].white_castle_kingside_ok;
-  pos[pos_idx + 1].white_castle_queenside_ok = pos[pos_idx].white_castle_queenside_ok;
-  pos[pos_idx + 1].black_castle_kingside_ok  = pos[pos_idx].black_castle_kingside_ok;
-  pos[pos_idx + 1].black_castle_queenside_ok = pos[pos_idx].black_castle_queenside_ok;
-  pos[pos_idx + 1].en_passant_pp = 0;
-
-  if (pos[pos_idx].white_move) { //
-    if (pos[pos_idx].white_castle_kingside_ok || pos[pos_idx].white_castle_queenside_ok) {
-      if (step.c1 == 60) {
-        pos[pos_idx + 1].white_castle_kingside_ok  = false;
-        pos[pos_idx + 1].white_castle_queenside_ok = false;
-      } 
-      else if (step.c1 == 63) pos[pos_idx + 1].white_castle_kingside_ok  = false;
-      else if (step.c1 == 56) pos[pos_idx + 1].white_castle_queenside_ok = false;
-    }
-    if ((step.type == MoveType::SIMPLE) && (step.f1 == PAWN) && (step.c2 == step.c1 - 16)) {
-      if (((column[step.c2] > 1) && (board[step.c2 - 1] == -PAWN)) || 
-          ((column[step.c2] < 8) && (board[step.c2 + 1] == -PAWN))) {
-        pos[pos_idx + 1].en_passant_pp = step.c1 - 8;
-      }
-    }
-    pos[pos_idx + 1].weight_white = pos[pos_idx].weight_white;
-    pos[pos_idx + 1].weight_black = pos[pos_idx].weight_black;
-    if (step.f2 != NO_FIG) {
-      pos[pos_idx + 1].weight_black -= fig_weight[-step.f2];
-    }
     if (step.type > MoveType::CASTLE_QUEENSIDE) {
-      pos[pos_idx + 1].weight_white += fig_weight[(int)(step.type) - 2] - 100;
-    }
-    
-    if (stats) {
-      if ((step.f1 == KING) && endgame) {
-        pos[pos_idx + 1].weight_both = pos[pos_idx].weight_both + 
-                                       stat_weight_white[KING][step.c2] - 
-                                       stat_weight_white[KING][step.c1];
-      }
-      else {
-        pos[pos_idx + 1].weight_both = pos[pos_idx].weight_both + 
-                                       stat_weight_white[step.f1 - 1][step.c2] - 
-                                       stat_weight_white[step.f1 - 1][step.c1];
-      }
-      if (step.f2 != NO_FIG) pos[pos_idx + 1].weight_both += stat_weight_black[-step.f2 - 1][step.c2];
-    }
-  } 
-  else { //
-    if (pos[pos_idx].black_castle_kingside_ok || pos[pos_idx].black_castle_queenside_ok) {
-      if (step.c1 == 4) {
-        pos[pos_idx + 1].black_castle_kingside_ok  = false;
-        pos[pos_idx + 1].black_castle_queenside_ok = false;
-      } 
-      else if (step.c1 == 7) pos[pos_idx + 1].black_castle_kingside_ok  = false;
-      else if (step.c1 == 0) pos[pos_idx + 1].black_castle_queenside_ok = false;
-    }
-    if ((step.type == MoveType::SIMPLE) && (step.f1 == -PAWN) && (step.c2 == step.c1 + 16)) {
-      if (((column[step.c2] > 1) && (board[step.c2 - 1] == PAWN)) || 
-          ((column[step.c2] < 8) && (board[step.c2 + 1] == PAWN))) {
-        pos[pos_idx + 1].en_passant_pp = step.c1 + 8;
-      }
+      placed  = us * ((int)(step.type) - 2);
+      phase  += fig_phase[(int)(step.type) - 2];
     }
-    pos[pos_idx + 1].weight_white = pos[pos_idx].weight_white;
-    pos[pos_idx + 1].weight_black = pos[pos_idx].weight_black;
-    if (step.f2 != NO_FIG) pos[pos_idx + 1].weight_white -= fig_weight[step.f2];
-    if (step.type > MoveType::CASTLE_QUEENSIDE) {
-      pos[pos_idx + 1].weight_black += fig_weight[(int)(step.type) - 2] - 100;
-    }
-    
-    if (stats) {
-      if ((step.f1 == -KING) && endgame)
-        pos[pos_idx + 1].weight_both = pos[pos_idx].weight_both - 
-                                       stat_weight_black[KING][step.c2] + 
-                                       stat_weight_black[KING][step.c1];
-      else
-        pos[pos_idx + 1].weight_both = pos[pos_idx].weight_both - 
-                                       stat_weight_black[-step.f1 - 1][step.c2] + 
-                                       stat_weight_black[-step.f1 - 1][step.c1];
-      if (step.f2 != NO_FIG) {
-        pos[pos_idx + 1].weight_both -= stat_weight_white[step.f2 - 1][step.c2];
-      }
+
+    uint32_t pawn_key = cur.pawn_key;
+
+    mg += pst_mg(placed, step.c2) - pst_mg(step.f1, step.c1);
+    eg += pst_eg(placed, step.c2) - pst_eg(step.f1, step.c1);
+
+    if (step.f1 == us * PAWN) {
+      pawn_key ^= pawn_zobrist_key(step.f1, step.c1);
+      if (placed == us * PAWN) pawn_key ^= pawn_zobrist_key(step.f1, step.c2);
     }
+
+    if (step.f2 != NO_FIG) {
+      int8_t capture_idx = step.c2;
+      if (step.type == MoveType::EN_PASSANT) capture_idx -= forward;
+      mg    -= pst_mg(step.f2, capture_idx);
+      eg    -= pst_eg(step.f2, capture_idx);
+      phase -= fig_phase[abs(step.f2)];
+      if (step.f2 == -us * PAWN) pawn_key ^= pawn_zobrist_key(step.f2, capture_idx);
+    }
+    else if (step.type == MoveType::CASTLE_KINGSIDE) {
+      mg += pst_mg(us * ROOK, king_home + 1) - pst_mg(us * ROOK, king_home + 3);
+      eg += pst_eg(us * ROOK, king_home + 1) - pst_eg(us * ROOK, king_home + 3);
+    }
+    else if (step.type == MoveType::CASTLE_QUEENSIDE) {
+      mg += pst_mg(us * ROOK, king_home - 1) - pst_mg(us * ROOK, king_home - 4);
+      eg += pst_eg(us * ROOK, king_home - 1) - pst_eg(us * ROOK, king_home - 4);
+    }
+
+    next.score_mg = mg;
+    next.score_eg = eg;
+    next.phase    = phase;
+    next.pawn_key = pawn_key;
   }
 
-  move_count++;
+  increment(cur_thread->move_count);
 }
 
 void 
 ChessEngine::move_step(int pos_idx, Step & step)
 {
-  //checks(l,s);
-  board[step.c1] = 0;
-  board[step.c2] = step.f1;
-
-  if (pos[pos_idx].white_move) {
-    if (step.f1 == KING) idx_white_king = step.c2;
-    switch (step.type) {
-      case MoveType::SIMPLE:
-        return;
+  if (pos[pos_idx].white_move) move_step<true >(step);
+  else                         move_step<false>(step);
+}
 
-      case MoveType::EN_PASSANT:
-        board[step.c2 + 8] = 0;
-        break;
+template <bool WHITE>
+void 
+ChessEngine::move_step(Step & step)
+{
+  constexpr int8_t   us        = WHITE ?  1 : -1; // Sign of the side to move figures
+  constexpr int8_t   forward   = WHITE ? -8 :  8;
+  constexpr int8_t   king_home = WHITE ? 60 :  4;
+  constexpr int      side      = WHITE ?  0 :  1;
+  int8_t           & king_idx  = WHITE ? idx_white_king : idx_black_king;
 
-      case MoveType::CASTLE_KINGSIDE:
-        board[60] = 0;
-        board[61] = ROOK;
-        board[62] = KING;
-        board[63] = 0;
-        idx_white_king = 62;
-        break;
+  //checks(l,s);
+  if (nnue_active) nnue.move(step);
 
-      case MoveType::CASTLE_QUEENSIDE:
-        board[60] = 0;
-        board[59] = ROOK;
-        board[58] = KING;
-        board[57] = 0;
-        board[56] = 0;
-        idx_white_king = 58;
-        break;
+  board[step.c1] = 0;
+  board[step.c2] = step.f1;
 
-      case MoveType::PROMOTE_TO_KNIGHT: 
-      case MoveType::PROMOTE_TO_BISHOP: 
-      case MoveType::PROMOTE_TO_ROOK: 
-      case MoveType::PROMOTE_TO_QUEEN:
-        board[step.c2] = (int)(step.type) - 2;
-        break;
+  if (step.f2 != NO_FIG) {
+    remove_piece(1 - side, (step.type == MoveType::EN_PASSANT) ? step.c2 - forward : step.c2);
+  }
+  move_piece(side, step.c1, step.c2);
 
-      default:
-        break;
-    }
-  } 
-  else {
-    if (step.f1 == -KING) idx_black_king = step.c2;
-    switch (step.type) {
-      case MoveType::SIMPLE:
-        return;
+  if (step.f1 == us * KING) king_idx = step.c2;
+  switch (step.type) {
+    case MoveType::SIMPLE:
+      return;
 
-      case MoveType::EN_PASSANT:
-        board[step.c2 - 8] = 0;
-        break;
+    case MoveType::EN_PASSANT:
+      board[step.c2 - forward] = 0;
+      break;
 
-      case MoveType::CASTLE_KINGSIDE:
-        board[4] = 0;
-        board[5] = -ROOK;
-        board[6] = -KING;
-        board[7] = 0;
-        idx_black_king = 6;
-        break;
+    case MoveType::CASTLE_KINGSIDE:
+      board[king_home    ] = 0;
+      board[king_home + 1] = us * ROOK;
+      board[king_home + 2] = us * KING;
+      board[king_home + 3] = 0;
+      move_piece(side, king_home + 3, king_home + 1);
+      king_idx = king_home + 2;
+      break;
 
-      case MoveType::CASTLE_QUEENSIDE:
-        board[4] = 0;
-        board[3] = -ROOK;
-        board[2] = -KING;
-        board[1] = 0;
-        board[0] = 0;
-        idx_black_king = 2;
-        break;
+    case MoveType::CASTLE_QUEENSIDE:
+      board[king_home    ] = 0;
+      board[king_home - 1] = us * ROOK;
+      board[king_home - 2] = us * KING;
+      board[king_home - 3] = 0;
+      board[king_home - 4] = 0;
+      move_piece(side, king_home - 4, king_home - 1);
+      king_idx = king_home - 2;
+      break;
 
-      case MoveType::PROMOTE_TO_KNIGHT: 
-      case MoveType::PROMOTE_TO_BISHOP: 
-      case MoveType::PROMOTE_TO_ROOK: 
-      case MoveType::PROMOTE_TO_QUEEN:
-        board[step.c2] = 2 - (int)(step.type);
-        break;
+    case MoveType::PROMOTE_TO_KNIGHT: 
+    case MoveType::PROMOTE_TO_BISHOP: 
+    case MoveType::PROMOTE_TO_ROOK: 
+    case MoveType::PROMOTE_TO_QUEEN:
+      board[step.c2] = us * ((int)(step.type) - 2);
+      break;
 
-      default:
-        break;
-    }
+    default:
+      break;
   }
 }
 
 void 
 ChessEngine::back_step(int pos_idx, Step & step)
 {
+  assert((pos_idx >= 0) && (pos_idx < MAXDEPTH));
+
+  if (pos[pos_idx].white_move) back_step<true >(step);
+  else                         back_step<false>(step);
+}
+
+template <bool WHITE>
+void 
+ChessEngine::back_step(Step & step)
+{
+  constexpr int8_t   us        = WHITE ?  1 : -1; // Sign of the side to move figures
+  constexpr int8_t   forward   = WHITE ? -8 :  8;
+  constexpr int8_t   king_home = WHITE ? 60 :  4;
+  constexpr int      side      = WHITE ?  0 :  1;
+  int8_t           & king_idx  = WHITE ? idx_white_king : idx_black_king;
+
+  if (nnue_active) nnue.unmove(step);
+
   board[step.c1] = step.f1;
   board[step.c2] = step.f2;
 
-  assert((pos_idx >= 0) && (pos_idx < MAXDEPTH));
+  move_piece(side, step.c2, step.c1);
+  if (step.f2 != NO_FIG) {
+    add_piece(1 - side, (step.type == MoveType::EN_PASSANT) ? step.c2 - forward : step.c2);
+  }
 
-  if (pos[pos_idx].white_move) {
-    if (step.f1 == KING) idx_white_king = step.c1;
-    switch (step.type) {
-      case MoveType::SIMPLE:
-        return;
+  if (step.f1 == us * KING) king_idx = step.c1;
+  switch (step.type) {
+    case MoveType::SIMPLE:
+      return;
 
-      case MoveType::EN_PASSANT:
-        board[step.c2] = 0;
-        board[step.c2 + 8] = -PAWN;
-        break;
+    case MoveType::EN_PASSANT:
+      board[step.c2] = 0;
+      board[step.c2 - forward] = -us * PAWN;
+      break;
 
-      case MoveType::CASTLE_KINGSIDE:
-        board[60] = KING;
-        board[61] = 0;
-        board[62] = 0;
-        board[63] = ROOK;
-        idx_white_king = 60;
-        break;
-        
-      case MoveType::CASTLE_QUEENSIDE:
-        board[60] = KING;
-        board[59] = 0;
-        board[58] = 0;
-        board[57] = 0;
-        board[56] = ROOK;
-        idx_white_king = 60;
-        break;
+    case MoveType::CASTLE_KINGSIDE:
+      board[king_home    ] = us * KING;
+      board[king_home + 1] = 0;
+      board[king_home + 2] = 0;
+      board[king_home + 3] = us * ROOK;
+      move_piece(side, king_home + 1, king_home + 3);
+      king_idx = king_home;
+      break;
+      
+    case MoveType::CASTLE_QUEENSIDE:
+      board[king_home    ] = us * KING;
+      board[king_home - 1] = 0;
+      board[king_home - 2] = 0;
+      board[king_home - 3] = 0;
+      board[king_home - 4] = us * ROOK;
+      move_piece(side, king_home - 1, king_home - 4);
+      king_idx = king_home;
+      break;
 
-      default:
-        break;
-    }
-  } 
-  else { //
-    if (step.f1 == -KING) idx_black_king = step.c1;
-    switch (step.type) {
-      case MoveType::SIMPLE:
-        return;
+    default:
+      break;
+  }
+}
 
-      case MoveType::EN_PASSANT: //
-        board[step.c2] = 0;
-        board[step.c2 - 8] = PAWN;
-        break;
+template <bool WHITE>
+void
+ChessEngine::add_pawn_steps(int pos_idx, int8_t board_idx)
+{
+  constexpr int8_t them      = WHITE ? -1 :  1; // Sign of the opponent figures
+  constexpr int8_t forward   = WHITE ? -8 :  8;
+  constexpr int    first_row = WHITE ?  2 :  7;
+  constexpr int    last_row  = WHITE ?  7 :  2; // Row from which a pawn is promoted
 
-      case MoveType::CASTLE_KINGSIDE: //
-        board[4] = -KING;
-        board[5] = 0;
-        board[6] = 0;
-        board[7] = -ROOK;
-        idx_black_king = 4;
-        break;
-        
-      case MoveType::CASTLE_QUEENSIDE: //
-        board[4] = -KING;
-        board[3] = 0;
-        board[2] = 0;
-        board[1] = 0;
-        board[0] = -ROOK;
-        idx_black_king = 4;
-        break;
+  int8_t front = board_idx + forward;
+  int    r     = row[board_idx];
 
-      default:
-        break;
+  if ((r != last_row) && (board[front] == NO_FIG)) add_one_step(pos_idx, board_idx, front);
+  if ((r == first_row) && (board[front] == NO_FIG) && (board[front + forward] == NO_FIG)) add_one_step(pos_idx, board_idx, front + forward);
+  if (r == last_row) {
+    if (board[front] == NO_FIG) add_promotion_steps(pos_idx, board_idx, front); // No piece on front on last row
+    if ((column[board_idx] > 1) && (board[front - 1] * them > 0)) { // A piece can be taken on last row to the left
+      add_promotion_steps(pos_idx, board_idx, front - 1);
     }
+    if ((column[board_idx] < 8) && (board[front + 1] * them > 0)) { // A piece can be taken on last row to the right
+      add_promotion_steps(pos_idx, board_idx, front + 1);
+    }
+  } 
+  else {
+    if ((column[board_idx] > 1) && (board[front - 1] * them > 0)) add_one_step(pos_idx, board_idx, front - 1);
+    if ((column[board_idx] < 8) && (board[front + 1] * them > 0)) add_one_step(pos_idx, board_idx, front + 1);
   }
 }
 
+void
+ChessEngine::add_promotion_steps(int pos_idx, int c1, int c2)
+{
+  Position & p = pos[pos_idx];
+
+  add_one_step(pos_idx, c1, c2); p.steps[p.steps_count - 1].type = MoveType::PROMOTE_TO_KNIGHT;
+  add_one_step(pos_idx, c1, c2); p.steps[p.steps_count - 1].type = MoveType::PROMOTE_TO_BISHOP;
+  add_one_step(pos_idx, c1, c2); p.steps[p.steps_count - 1].type = MoveType::PROMOTE_TO_ROOK;
+  add_one_step(pos_idx, c1, c2); p.steps[p.steps_count - 1].type = MoveType::PROMOTE_TO_QUEEN;
+}
+
+void 
+ChessEngine::add_one_step(int pos_idx, int c1, int c2)
+{
+  Step & step = pos[pos_idx].steps[pos[pos_idx].steps_count++];
+
+  step.type = MoveType::SIMPLE;
+  step.c1   = c1;
+  step.c2   = c2;
+  step.f1   = board[c1];
+  step.f2   = board[c2];
+}
+
 void 
 ChessEngine::add_king_step(int pos_idx, int board_idx)
 {
@@ -855,72 +858,6 @@ ChessEngine::getbm(int move_idx, const Step & ep)
 }
 #endif
 
-bool 
-ChessEngine::checkd_w()
-{
-  signed char f2 = NO_FIG;
-  int         j  = 0;
-
-  while (diag_step[idx_white_king][j] != 99) {
-    if (diag_step[idx_white_king][j] == 88) f2 = NO_FIG;
-    else if (f2 == NO_FIG) {
-      f2 = board[diag_step[idx_white_king][j]];
-      if (f2 == -BISHOP || f2 == -QUEEN) return true;
-    }
-    j++;
-  }
-
-  f2 = NO_FIG;
-  j  = 0;
-
-  while (stra_step[idx_white_king][j] != 99) {
-    if (stra_step[idx_white_king][j] == 88) f2 = NO_FIG;
-    else if (f2 == NO_FIG) {
-      f2 = board[stra_step[idx_white_king][j]];
-      if (f2 == -ROOK || f2 == -QUEEN) return true;
-      if (j == 0 || stra_step[idx_white_king][j] == 88) {
-        if (f2 == -KING) return true;
-      }
-    }
-    j++;
-  }
-
-  return false;
-}
-
-bool 
-ChessEngine::checkd_b()
-{
-  signed char f2 = NO_FIG;
-  int         j  = 0;
-
-  while (diag_step[idx_black_king][j] != 99) {
-    if (diag_step[idx_black_king][j] == 88) f2 = NO_FIG;
-    else if (f2 == NO_FIG) {
-      f2 = board[diag_step[idx_black_king][j]];
-      if (f2 == BISHOP || f2 == QUEEN) return true;
-    }
-    j++;
-  }
-
-  f2 = NO_FIG;
-  j  = 0;
-
-  while (stra_step[idx_black_king][j] != 99) {
-    if (stra_step[idx_black_king][j] == 88) f2 = NO_FIG;
-    else if (f2 == NO_FIG) {
-      f2 = board[stra_step[idx_black_king][j]];
-      if (f2 == ROOK || f2 == QUEEN) return true;
-      if (j == NO_FIG || stra_step[idx_black_king][j] == 88) {
-        if (f2 == KING) return true;
-      }
-    }
-    j++;
-  }
-
-  return false;
-}
-
 void 
 ChessEngine::sort_steps(int pos_idx)
 {
@@ -952,129 +889,107 @@ ChessEngine::sort_steps(int pos_idx)
 void 
 ChessEngine::generate_steps(int pos_idx)
 {
+  if (pos[pos_idx].white_move) generate_steps<true >(pos_idx);
+  else                         generate_steps<false>(pos_idx);
+}
+
+template <bool WHITE>
+void 
+ChessEngine::generate_steps(int pos_idx)
+{
+  constexpr int8_t   us        = WHITE ?  1 : -1; // Sign of the side to move figures
+  constexpr int8_t   back      = WHITE ?  8 : -8;
+  constexpr int8_t   king_home = WHITE ? 60 :  4;
+  constexpr int      side      = WHITE ?  0 :  1;
+  int8_t           & king_idx  = WHITE ? idx_white_king : idx_black_king;
+
   pos[pos_idx].cur_step = 0;
   pos[pos_idx].steps_count = 0;
   int check;
   int8_t f;
 
-  chess_engine_task.set_pos_idx(pos_idx);
-  TaskQueueData task_queue_data;
-  task_queue_data.req = TaskReq::EXEC;
-  QUEUE_SEND(task_queue, task_queue_data, 0);
-
-  for (int ii = 0; ii < 64; ii++) {
-    int target_idx = (pos[pos_idx].white_move) ? ii : 63 - ii;
-    f = board[target_idx];
-    if ((f == NO_FIG) || 
-        (is_black_fig(f) &&  pos[pos_idx].white_move) || 
-        (is_white_fig(f) && !pos[pos_idx].white_move)) continue;
-    switch (abs(f)) {
+  if (pos_idx > 0) {
+    if (pos[pos_idx - 1].steps[pos[pos_idx - 1].cur_step].check == CheckType::NONE) {
+      pos[pos_idx].check_on_table = check_on_king<WHITE>();
+      pos[pos_idx - 1].steps[pos[pos_idx - 1].cur_step].check = 
+        pos[pos_idx].check_on_table ? CheckType::CHECK : CheckType::NONE;
+    } 
+    else pos[pos_idx].check_on_table = true;
+  } 
+  else pos[0].check_on_table = check_on_king<WHITE>();
+
+  for (int i = 0; i < piece_count[side]; i++) {
+    int8_t target_idx = piece_list[side][i];
+    f = board[target_idx] * us;
+    switch (f) {
+      case PAWN: add_pawn_steps<WHITE>(pos_idx, target_idx); break;
       case KNIGHT:  add_knight_step(pos_idx, target_idx); break;
       case BISHOP:    add_diag_step(pos_idx, target_idx); break;
       case ROOK:      add_stra_step(pos_idx, target_idx); break;
       case QUEEN:     add_stra_step(pos_idx, target_idx); 
                       add_diag_step(pos_idx, target_idx); break;
-      case KING: if (endgame) add_king_step(pos_idx, target_idx); break;
+      case KING:      add_king_step(pos_idx, target_idx); break;
     }
   } //
-  //int in=0;
-
-  EngineQueueData engine_queue_data;
-  QUEUE_RECEIVE(engine_queue, engine_queue_data, 5000 / portTICK_PERIOD_MS);
-
-  //if (in) count_in++;
-  //count_all++;
-  if (pos[pos_idx].white_move && !pos[pos_idx].check_on_table) { //
-    if (pos[pos_idx].white_castle_kingside_ok) { //
-      if ((board[60] == KING  ) && 
-          (board[61] == NO_FIG) && 
-          (board[62] == NO_FIG) && 
-          (board[63] == ROOK  )) {
-        board[60]      = NO_FIG;
-        board[61]      = KING;
-        idx_white_king = 61;
-        check          = check_on_white_king();
-        board[60]      = KING;
-        idx_white_king = 60;
-        board[61]      = NO_FIG;
 
-        if (!check) {
-          pos[pos_idx].steps[pos[pos_idx].steps_count].type = MoveType::CASTLE_KINGSIDE;
-          pos[pos_idx].steps[pos[pos_idx].steps_count].c1   =     60;
-          pos[pos_idx].steps[pos[pos_idx].steps_count].c2   =     62;
-          pos[pos_idx].steps[pos[pos_idx].steps_count].f1   =   KING;
-          pos[pos_idx].steps[pos[pos_idx].steps_count].f2   = NO_FIG;
-          pos[pos_idx].steps_count++;
-        }
-      }
-    }
-    if (pos[pos_idx].white_castle_queenside_ok) { //
-      if ((board[60] == KING  ) && 
-          (board[59] == NO_FIG) && 
-          (board[58] == NO_FIG) && 
-          (board[57] == NO_FIG) && 
-          (board[56] == ROOK  )) {
-        board[60]      = NO_FIG;
-        board[59]      = KING;
-        idx_white_king = 59;
-        check          = check_on_white_king();
-        board[60]      = KING;
-        idx_white_king = 60;
-        board[59]      = NO_FIG;
+  int8_t en_passant_pp = pos[pos_idx].en_passant_pp;
 
-        if (!check) {
-          pos[pos_idx].steps[pos[pos_idx].steps_count].type = MoveType::CASTLE_QUEENSIDE;
-          pos[pos_idx].steps[pos[pos_idx].steps_count].c1   =     60;
-          pos[pos_idx].steps[pos[pos_idx].steps_count].c2   =     58;
-          pos[pos_idx].steps[pos[pos_idx].steps_count].f1   =   KING;
-          pos[pos_idx].steps[pos[pos_idx].steps_count].f2   = NO_FIG;
-          pos[pos_idx].steps_count++;
-        }
-      }
+  if ((en_passant_pp != 0) && (board[en_passant_pp] == NO_FIG)) {
+    if ((column[en_passant_pp] > 1) && (board[en_passant_pp + back - 1] == us * PAWN)) {
+      add_one_step(pos_idx, en_passant_pp + back - 1, en_passant_pp);
+      pos[pos_idx].steps[pos[pos_idx].steps_count - 1].type = MoveType::EN_PASSANT;
+      pos[pos_idx].steps[pos[pos_idx].steps_count - 1].f2   = -us * PAWN;
     }
-  } 
-  else if (!pos[pos_idx].white_move && !pos[pos_idx].check_on_table) { //
-    if (pos[pos_idx].black_castle_kingside_ok) { //
-      if ((board[4] == -KING ) && 
-          (board[5] == NO_FIG) && 
-          (board[6] == NO_FIG) && 
-          (board[7] == -ROOK )) {
-        board[4]       = NO_FIG;
-        board[5]       = -KING;
-        idx_black_king = 5;
-        check          = check_on_black_king();
-        board[4]       = -KING;
-        idx_black_king = 4;
-        board[5]       = NO_FIG;
+    if ((column[en_passant_pp] < 8) && (board[en_passant_pp + back + 1] == us * PAWN)) {
+      add_one_step(pos_idx, en_passant_pp + back + 1, en_passant_pp);
+      pos[pos_idx].steps[pos[pos_idx].steps_count - 1].type = MoveType::EN_PASSANT;
+      pos[pos_idx].steps[pos[pos_idx].steps_count - 1].f2   = -us * PAWN;
+    }
+  }
+
+  if (!pos[pos_idx].check_on_table) { //
+    if (WHITE ? pos[pos_idx].white_castle_kingside_ok : pos[pos_idx].black_castle_kingside_ok) { //
+      if ((board[king_home    ] == us * KING) && 
+          (board[king_home + 1] == NO_FIG   ) && 
+          (board[king_home + 2] == NO_FIG   ) && 
+          (board[king_home + 3] == us * ROOK)) {
+        board[king_home    ] = NO_FIG;
+        board[king_home + 1] = us * KING;
+        king_idx             = king_home + 1;
+        check                = check_on_king<WHITE>();
+        board[king_home    ] = us * KING;
+        king_idx             = king_home;
+        board[king_home + 1] = NO_FIG;
 
         if (!check) {
           pos[pos_idx].steps[pos[pos_idx].steps_count].type = MoveType::CASTLE_KINGSIDE;
-          pos[pos_idx].steps[pos[pos_idx].steps_count].c1   =      4;
-          pos[pos_idx].steps[pos[pos_idx].steps_count].c2   =      6;
-          pos[pos_idx].steps[pos[pos_idx].steps_count].f1   =  -KING;
+          pos[pos_idx].steps[pos[pos_idx].steps_count].c1   = king_home;
+          pos[pos_idx].steps[pos[pos_idx].steps_count].c2   = king_home + 2;
+          pos[pos_idx].steps[pos[pos_idx].steps_count].f1   = us * KING;
           pos[pos_idx].steps[pos[pos_idx].steps_count].f2   = NO_FIG;
           pos[pos_idx].steps_count++;
         }
       }
     }
-    if (pos[pos_idx].black_castle_queenside_ok) { //
-      if ((board[4] == -KING ) && 
-          (board[3] == NO_FIG) && 
-          (board[2] == NO_FIG) && 
-          (board[1] == NO_FIG) && 
-          (board[0] == -ROOK )) {
-        board[4]       = NO_FIG;
-        board[3]       = -KING;
-        idx_black_king = 3;
-        check          = check_on_black_king();
-        board[4]       = -KING;
-        idx_black_king = 4;
-        board[3]       = NO_FIG;
+    if (WHITE ? pos[pos_idx].white_castle_queenside_ok : pos[pos_idx].black_castle_queenside_ok) { //
+      if ((board[king_home    ] == us * KING) && 
+          (board[king_home - 1] == NO_FIG   ) && 
+          (board[king_home - 2] == NO_FIG   ) && 
+          (board[king_home - 3] == NO_FIG   ) && 
+          (board[king_home - 4] == us * ROOK)) {
+        board[king_home    ] = NO_FIG;
+        board[king_home - 1] = us * KING;
+        king_idx             = king_home - 1;
+        check                = check_on_king<WHITE>();
+        board[king_home    ] = us * KING;
+        king_idx             = king_home;
+        board[king_home - 1] = NO_FIG;
+
         if (!check) {
           pos[pos_idx].steps[pos[pos_idx].steps_count].type = MoveType::CASTLE_QUEENSIDE;
-          pos[pos_idx].steps[pos[pos_idx].steps_count].c1   =      4;
-          pos[pos_idx].steps[pos[pos_idx].steps_count].c2   =      2;
-          pos[pos_idx].steps[pos[pos_idx].steps_count].f1   =  -KING;
+          pos[pos_idx].steps[pos[pos_idx].steps_count].c1   = king_home;
+          pos[pos_idx].steps[pos[pos_idx].steps_count].c2   = king_home - 2;
+          pos[pos_idx].steps[pos[pos_idx].steps_count].f1   = us * KING;
           pos[pos_idx].steps[pos[pos_idx].steps_count].f2   = NO_FIG;
           pos[pos_idx].steps_count++;
         }
@@ -1082,8 +997,6 @@ ChessEngine::generate_steps(int pos_idx)
     }
   }
 
-  chess_engine_task.retrieve_steps(pos_idx);
-
   for (int i = 0; i < pos[pos_idx].steps_count; i++) {
     pos[pos_idx].steps[i].same_col = pos[pos_idx].steps[i].same_row = false;
     pos[pos_idx].steps[i].check    = CheckType::NONE;
@@ -1093,6 +1006,14 @@ ChessEngine::generate_steps(int pos_idx)
     }
     pos[pos_idx].steps[i].weight <<= 2;
 
+    // Losing captures are tried after the good ones, just before the quiet moves.
+
+    if ((pos[pos_idx].steps[i].f2 != NO_FIG) && 
+        (pos[pos_idx].steps[i].type == MoveType::SIMPLE) && 
+        (see(pos[pos_idx].steps[i]) < 0)) {
+      pos[pos_idx].steps[i].weight = 1;
+    }
+
     if (pos_idx > 0) {
       if (pos[pos_idx].best.c2 == pos[pos_idx].steps[i].c2 && 
           pos[pos_idx].best.c1 == pos[pos_idx].steps[i].c1) {
@@ -1133,6 +1054,147 @@ ChessEngine::generate_steps(int pos_idx)
   }
 }
 
+// Pawn structure evaluation, from the white side point of view. Doubled, 
+// isolated, backward and passed pawns are considered.
+void
+ChessEngine::evaluate_pawns(PawnHashEntry & entry)
+{
+  // Per column (with one guard column on each side), the lowest and highest
+  // row where pawns of each color are located. 
+
+  int8_t white_min_row[10], white_max_row[10], white_count[10];
+  int8_t black_min_row[10], black_max_row[10], black_count[10];
+
+  for (int col = 0; col < 10; col++) {
+    white_min_row[col] = black_min_row[col] = 9;
+    white_max_row[col] = black_max_row[col] = 0;
+    white_count[col]   = black_count[col]   = 0;
+  }
+
+  for (int board_idx = 8; board_idx < 56; board_idx++) {
+    int col = column[board_idx];
+    int r   = row[board_idx];
+    if (board[board_idx] == PAWN) {
+      white_count[col]++;
+      if (r < white_min_row[col]) white_min_row[col] = r;
+      if (r > white_max_row[col]) white_max_row[col] = r;
+    }
+    else if (board[board_idx] == -PAWN) {
+      black_count[col]++;
+      if (r < black_min_row[col]) black_min_row[col] = r;
+      if (r > black_max_row[col]) black_max_row[col] = r;
+    }
+  }
+
+  int mg = 0, eg = 0;
+
+  for (int col = 1; col <= 8; col++) {
+    if (white_count[col] > 1) {
+      mg += DOUBLED_PAWN_MG * (white_count[col] - 1);
+      eg += DOUBLED_PAWN_EG * (white_count[col] - 1);
+    }
+    if (black_count[col] > 1) {
+      mg -= DOUBLED_PAWN_MG * (black_count[col] - 1);
+      eg -= DOUBLED_PAWN_EG * (black_count[col] - 1);
+    }
+  }
+
+  for (int board_idx = 8; board_idx < 56; board_idx++) {
+    int col = column[board_idx];
+    int r   = row[board_idx];
+
+    if (board[board_idx] == PAWN) {
+      if ((black_max_row[col - 1] <= r) && (black_max_row[col] <= r) && (black_max_row[col + 1] <= r)) {
+        mg += passed_pawn_mg[r - 1];
+        eg += passed_pawn_eg[r - 1];
+      }
+      if ((white_count[col - 1] == 0) && (white_count[col + 1] == 0)) {
+        mg += ISOLATED_PAWN_MG;
+        eg += ISOLATED_PAWN_EG;
+      }
+      else if ((white_min_row[col - 1] > r) && (white_min_row[col + 1] > r) &&
+               (((col < 8) && (board_idx >= 17) && (board[board_idx - 15] == -PAWN)) ||
+                ((col > 1) && (board_idx >= 17) && (board[board_idx - 17] == -PAWN)))) {
+        mg += BACKWARD_PAWN_MG;
+        eg += BACKWARD_PAWN_EG;
+      }
+    }
+    else if (board[board_idx] == -PAWN) {
+      if ((white_min_row[col - 1] >= r) && (white_min_row[col] >= r) && (white_min_row[col + 1] >= r)) {
+        mg -= passed_pawn_mg[8 - r];
+        eg -= passed_pawn_eg[8 - r];
+      }
+      if ((black_count[col - 1] == 0) && (black_count[col + 1] == 0)) {
+        mg -= ISOLATED_PAWN_MG;
+        eg -= ISOLATED_PAWN_EG;
+      }
+      else if ((black_max_row[col - 1] < r) && (black_max_row[col + 1] < r) &&
+               (((col > 1) && (board_idx < 47) && (board[board_idx + 15] == PAWN)) ||
+                ((col < 8) && (board_idx < 47) && (board[board_idx + 17] == PAWN)))) {
+        mg -= BACKWARD_PAWN_MG;
+        eg -= BACKWARD_PAWN_EG;
+      }
+    }
+  }
+
+  entry.score_mg = mg;
+  entry.score_eg = eg;
+}
+
+// King shield evaluation: pawns protecting a king still located on its 
+// first two rows. The value depends on the kings location and is kept with
+// the pawn structure entry.
+void
+ChessEngine::evaluate_shield(PawnHashEntry & entry)
+{
+  int shield = 0;
+
+  if (row[idx_white_king] <= 2) {
+    for (int col = column[idx_white_king] - 1; col <= column[idx_white_king] + 1; col++) {
+      if ((col < 1) || (col > 8)) continue;
+      int front_idx = idx_white_king - 8 + (col - column[idx_white_king]);
+      if      (board[front_idx    ] == PAWN) shield += SHIELD_PAWN_CLOSE;
+      else if (board[front_idx - 8] == PAWN) shield += SHIELD_PAWN_FAR;
+      else                                   shield += SHIELD_PAWN_MISSING;
+    }
+  }
+
+  if (row[idx_black_king] >= 7) {
+    for (int col = column[idx_black_king] - 1; col <= column[idx_black_king] + 1; col++) {
+      if ((col < 1) || (col > 8)) continue;
+      int front_idx = idx_black_king + 8 + (col - column[idx_black_king]);
+      if      (board[front_idx    ] == -PAWN) shield -= SHIELD_PAWN_CLOSE;
+      else if (board[front_idx + 8] == -PAWN) shield -= SHIELD_PAWN_FAR;
+      else                                    shield -= SHIELD_PAWN_MISSING;
+    }
+  }
+
+  entry.shield_mg      = shield;
+  entry.white_king_idx = idx_white_king;
+  entry.black_king_idx = idx_black_king;
+}
+
+const PawnHashEntry &
+ChessEngine::probe_pawns(int pos_idx)
+{
+  uint32_t        key   = pos[pos_idx].pawn_key;
+  PawnHashEntry & entry = pawn_hash[key & (PAWN_HASH_SIZE - 1)];
+
+  if (entry.key != key) {
+    increment(cur_thread->pawn_hash_misses);
+    evaluate_pawns(entry);
+    entry.key            = key;
+    entry.white_king_idx = -1;
+  }
+
+  if ((entry.white_king_idx != idx_white_king) || 
+      (entry.black_king_idx != idx_black_king)) {
+    evaluate_shield(entry);
+  }
+
+  return entry;
+}
+
 int 
 ChessEngine::evaluate(int pos_idx)
 {
@@ -1140,21 +1202,50 @@ ChessEngine::evaluate(int pos_idx)
     if (pos[pos_idx].white_move) return pos[pos_idx].weight_white - pos[pos_idx].weight_black;
     else return pos[pos_idx].weight_black - pos[pos_idx].weight_white;
   } 
+  else if (nnue_active) {
+    return nnue.evaluate(pos[pos_idx].white_move);
+  }
   else {
-    if (pos[pos_idx].white_move) return 5000 * (pos[pos_idx].weight_white - pos[pos_idx].weight_black + pos[pos_idx].weight_both) / (pos[pos_idx].weight_white + pos[pos_idx].weight_black + 2000);
-    else return 5000 * (pos[pos_idx].weight_black - pos[pos_idx].weight_white - pos[pos_idx].weight_both) / (pos[pos_idx].weight_white + pos[pos_idx].weight_black + 2000);
+    int phase = pos[pos_idx].phase;
+    if (phase > PHASE_MAX) phase = PHASE_MAX;
+    else if (phase < 0) phase = 0;
+
+    const PawnHashEntry & pawns = probe_pawns(pos_idx);
+
+    int mg       = pos[pos_idx].score_mg + pawns.score_mg + pawns.shield_mg;
+    int eg       = pos[pos_idx].score_eg + pawns.score_eg;
+    int mg_share = taper_weight[phase];
+    int weight   = pos[pos_idx].weight_white - pos[pos_idx].weight_black + 
+                   ((mg * mg_share + eg * (256 - mg_share)) >> 8);
+
+    return (pos[pos_idx].white_move) ? weight : -weight;
   }
 }
 
 void 
-ChessEngine::kingpositions()
+ChessEngine::init_piece_lists()
 {
-  for (int i = 0; i < 64; i++) {
+  piece_count[0] = piece_count[1] = 0;
+
+  for (int8_t i = 0; i < 64; i++) {
+    if (board[i] == NO_FIG) continue;
+
+    int side = is_white_fig(board[i]) ? 0 : 1;
+    if (piece_count[side] < 16) add_piece(side, i);
+
     if (board[i] ==  KING) idx_white_king = i;
     if (board[i] == -KING) idx_black_king = i;
   }
 }
 
+int
+ChessEngine::depth_reached()
+{
+  int max_depth = 0;
+  for (int i = 0; i < thread_count; i++) max_depth = std::max<int>(max_depth, thread_data[i]->depth);
+  return max_depth;
+}
+
 std::string 
 ChessEngine::get_time(long time)
 {
@@ -1191,7 +1282,8 @@ ChessEngine::is_draw()
   bool draw = false;
   int cn = 0, cbw = 0, cbb = 0, co = 0, cb = 0, cw = 0;
   
-  for (int board_idx = 0; board_idx < 64; board_idx++) {
+  for (int i = 0; i < piece_count[0] + piece_count[1]; i++) {
+    int8_t board_idx = (i < piece_count[0]) ? piece_list[0][i] : piece_list[1][i - piece_count[0]];
 
     if (abs(board[board_idx]) == PAWN) co++;
     if (abs(board[board_idx]) > BISHOP && abs(board[board_idx]) < KING) co++;
@@ -1275,16 +1367,134 @@ ChessEngine::active(Step & step)
   return 0;
 }
 
+// Retrieve the least valuable figure of one side attacking a board location. 
+// Returns NO_FIG if there is none. Pieces hidden behind a slider are found 
+// once the slider has been removed from the board, which takes care of x-rays.
+int8_t
+ChessEngine::least_attacker(int8_t board_idx, bool white, int8_t & from_idx)
+{
+  int8_t sign  = white ? 1 : -1;
+  int8_t queen = -1;
+  int8_t f2;
+  int    j;
+
+  if (white) {
+    if ((column[board_idx] > 1) && (board_idx < 56) && (board[board_idx + 7] ==  PAWN)) { from_idx = board_idx + 7; return PAWN; }
+    if ((column[board_idx] < 8) && (board_idx < 55) && (board[board_idx + 9] ==  PAWN)) { from_idx = board_idx + 9; return PAWN; }
+  }
+  else {
+    if ((column[board_idx] > 1) && (board_idx >  8) && (board[board_idx - 9] == -PAWN)) { from_idx = board_idx - 9; return PAWN; }
+    if ((column[board_idx] < 8) && (board_idx >  6) && (board[board_idx - 7] == -PAWN)) { from_idx = board_idx - 7; return PAWN; }
+  }
+
+  j = 0;
+  while (knight_step[board_idx][j] != 99) {
+    if (board[knight_step[board_idx][j]] == sign * KNIGHT) { from_idx = knight_step[board_idx][j]; return KNIGHT; }
+    j++;
+  }
+
+  f2 = NO_FIG;
+  j  = 0;
+  while (diag_step[board_idx][j] != 99) {
+    if (diag_step[board_idx][j] == 88) f2 = NO_FIG;
+    else if (f2 == NO_FIG) {
+      f2 = board[diag_step[board_idx][j]];
+      if (f2 == sign * BISHOP) { from_idx = diag_step[board_idx][j]; return BISHOP; }
+      if (f2 == sign * QUEEN ) queen = diag_step[board_idx][j];
+    }
+    j++;
+  }
+
+  f2 = NO_FIG;
+  j  = 0;
+  while (stra_step[board_idx][j] != 99) {
+    if (stra_step[board_idx][j] == 88) f2 = NO_FIG;
+    else if (f2 == NO_FIG) {
+      f2 = board[stra_step[board_idx][j]];
+      if (f2 == sign * ROOK ) { from_idx = stra_step[board_idx][j]; return ROOK; }
+      if (f2 == sign * QUEEN) queen = stra_step[board_idx][j];
+    }
+    j++;
+  }
+
+  if (queen != -1) { from_idx = queen; return QUEEN; }
+
+  j = 0;
+  while (king_step[board_idx][j] != 99) {
+    if (board[king_step[board_idx][j]] == sign * KING) { from_idx = king_step[board_idx][j]; return KING; }
+    j++;
+  }
+
+  return NO_FIG;
+}
+
+// Static Exchange Evaluation of a capture: the material balance, from the
+// moving side point of view, of the full sequence of captures on the 
+// target location, each side always using its least valuable attacker 
+// and being free to stop capturing (swap algorithm). 
+int
+ChessEngine::see(const Step & step)
+{
+  static const int see_weight[7] = { 0, 100, 320, 330, 500, 900, 20000 };
+
+  // A capture by a less or equally valuable figure cannot lose material.
+
+  if ((abs(step.f1) == KING) || (see_weight[abs(step.f2)] >= see_weight[abs(step.f1)])) {
+    return see_weight[abs(step.f2)] - ((abs(step.f1) == KING) ? 0 : see_weight[abs(step.f1)]);
+  }
+
+  int    gain[32];
+  int8_t removed_idx[32];
+  int8_t removed_fig[32];
+  int    removed_count = 0;
+  int    d             = 0;
+  int    on_target     = see_weight[abs(step.f1)];
+  bool   white         = step.f1 < 0;
+  int8_t from_idx      = step.c1;
+  int8_t fig;
+
+  gain[0] = see_weight[abs(step.f2)];
+
+  removed_idx[removed_count]   = step.c1;
+  removed_fig[removed_count++] = board[step.c1];
+  board[step.c1] = NO_FIG;
+
+  while ((d < 31) && ((fig = least_attacker(step.c2, white, from_idx)) != NO_FIG)) {
+    d++;
+    gain[d] = on_target - gain[d - 1];
+    if (std::max(-gain[d - 1], gain[d]) < 0) break;
+
+    on_target = see_weight[fig];
+    white     = !white;
+
+    removed_idx[removed_count]   = from_idx;
+    removed_fig[removed_count++] = board[from_idx];
+    board[from_idx] = NO_FIG;
+  }
+
+  while (--d > 0) gain[d - 1] = -std::max(-gain[d - 1], gain[d]);
+
+  while (removed_count > 0) {
+    removed_count--;
+    board[removed_idx[removed_count]] = removed_fig[removed_count];
+  }
+
+  return gain[0];
+}
+
+template <bool WHITE>
 int 
 ChessEngine::quiescence(int pos_idx, int alpha, int beta, int depth_left)
 {
   if (depth_left <= 0) {
-    if (pos_idx > depth) depth = pos_idx;
+    if (pos_idx > cur_thread->depth.load(std::memory_order_relaxed)) {
+      cur_thread->depth.store(pos_idx, std::memory_order_relaxed);
+    }
     return evaluate(pos_idx);
   }
 
   int score = -20000;
-  generate_steps(pos_idx);
+  generate_steps<WHITE>(pos_idx);
 
   if (!pos[pos_idx].check_on_table) {
     int weight = evaluate(pos_idx);
@@ -1301,20 +1511,26 @@ ChessEngine::quiescence(int pos_idx, int alpha, int beta, int depth_left)
     if (!pos[pos_idx].check_on_table) {
       act = active(pos[pos_idx].steps[i]);
       if (act == -1) continue;
+
+      // Captures losing material in the exchange cannot raise the stand pat score
+
+      if ((pos[pos_idx].steps[i].f2 != NO_FIG) && 
+          (pos[pos_idx].steps[i].type == MoveType::SIMPLE) && 
+          (see(pos[pos_idx].steps[i]) < 0)) continue;
     }
-    move_step(pos_idx, pos[pos_idx].steps[i]);
+    move_step<WHITE>(pos[pos_idx].steps[i]);
     check = false;
     if (act == 0) {
-      check = (pos[pos_idx].white_move) ? checkd_b() : checkd_w();
+      check = checkd<!WHITE>();
       pos[pos_idx].steps[i].check = check ? CheckType::CHECK : CheckType::NONE;
       if (!check) {
-        back_step(pos_idx, pos[pos_idx].steps[i]);
+        back_step<WHITE>(pos[pos_idx].steps[i]);
         continue;
       }
     }
-    checked = (pos[pos_idx].white_move) ? check_on_white_king() : check_on_black_king();
+    checked = check_on_king<WHITE>();
     if (checked) {
-      back_step(pos_idx, pos[pos_idx].steps[i]); 
+      back_step<WHITE>(pos[pos_idx].steps[i]); 
       continue;
     }
 
@@ -1323,9 +1539,9 @@ ChessEngine::quiescence(int pos_idx, int alpha, int beta, int depth_left)
     assert(i <= MAXSTEPS);
     pos[pos_idx].cur_step = i;
 
-    move_pos(pos_idx, pos[pos_idx].steps[i]);
-    int tmp = -quiescence(pos_idx + 1, -beta, -alpha, depth_left - 1);
-    back_step(pos_idx, pos[pos_idx].steps[i]);
+    move_pos<WHITE>(pos_idx, pos[pos_idx].steps[i]);
+    int tmp = -quiescence<!WHITE>(pos_idx + 1, -beta, -alpha, depth_left - 1);
+    back_step<WHITE>(pos[pos_idx].steps[i]);
     if (draw_repeat(pos_idx)) tmp = 0;
     if (tmp > score) score = tmp;
     if (score > alpha) {
@@ -1343,18 +1559,53 @@ ChessEngine::quiescence(int pos_idx, int alpha, int beta, int depth_left)
   return score;
 }
 
+template <bool WHITE>
 int 
 ChessEngine::alpha_beta(int pos_idx, int alpha, int beta, int depth_left)
 {
-  int score = -20000, check, ext, tmp;
+  int score = -20000, ext, tmp;
+  bool null_ok = !skip_null;
+  skip_null = false;
+
+  cur_thread->pv_length[pos_idx] = pos_idx;
+
+  if ((pos_idx > 0) && ((piece_count[0] + piece_count[1]) < bitbase_pieces)) {
+    WDL wdl;
+    if (bitbases.probe(board, WHITE, wdl)) {
+      increment(cur_thread->bitbase_hits);
+      switch (wdl) {
+        case WDL::WIN:  return   BITBASE_WIN_SCORE - pos_idx;
+        case WDL::LOSS: return -(BITBASE_WIN_SCORE - pos_idx);
+        default:        return 0;
+      }
+    }
+  }
+
   if (depth_left <= 0) {
     int fd = fdepth; //4-6-8
     if ((pos_idx > 0) && pos[pos_idx - 1].steps[pos[pos_idx - 1].cur_step].f2 != NO_FIG) fd += 2;
-    return quiescence(pos_idx, alpha, beta, fd);
+    return quiescence<WHITE>(pos_idx, alpha, beta, fd);
   }
-  if (pos_idx > 0) generate_steps(pos_idx);
-  if ((pos_idx >= null_depth) && !zero && (depth_left > 2)) {//2
-    if ((pos_idx > 0) && !pos[pos_idx].check_on_table && (pos[pos_idx - 1].steps[pos[pos_idx - 1].cur_step].f2 == NO_FIG))  {
+  if (pos_idx > 0) generate_steps<WHITE>(pos_idx);
+
+  // Null move: if passing the turn still gives a score at or above beta, the
+  // node is not worth a full search. The reduction grows with the depth. As 
+  // zugzwang positions are not seen that way, there is no null move when the
+  // side to move has only pawns left, and a fail high is verified by a 
+  // reduced search of the node itself when few pieces are left or when the
+  // depth is large.
+
+  if (null_ok && (pos_idx >= null_depth) && !zero && (depth_left > 2)) {//2
+    int pieces;
+    if ((pos_idx > 0) && 
+        !pos[pos_idx].check_on_table && 
+        (pos[pos_idx - 1].steps[pos[pos_idx - 1].cur_step].f2 == NO_FIG) &&
+        ((pieces = piece_phase(WHITE ? 0 : 1)) > 0)) {
+      int r     = (depth_left > NULL_MOVE_R3_DEPTH) ? 3 : 2;
+      int nodes = cur_thread->move_count;
+
+      increment(cur_thread->null_tries);
+
       zero = true;
       pos[pos_idx + 1].white_castle_kingside_ok  = pos[pos_idx].white_castle_kingside_ok;
       pos[pos_idx + 1].white_castle_queenside_ok = pos[pos_idx].white_castle_queenside_ok;
@@ -1362,15 +1613,30 @@ ChessEngine::alpha_beta(int pos_idx, int alpha, int beta, int depth_left)
       pos[pos_idx + 1].black_castle_queenside_ok = pos[pos_idx].black_castle_queenside_ok;
       pos[pos_idx + 1].weight_white              = pos[pos_idx].weight_white;
       pos[pos_idx + 1].weight_black              = pos[pos_idx].weight_black;
-      pos[pos_idx + 1].weight_both               = pos[pos_idx].weight_both;
+      pos[pos_idx + 1].score_mg                  = pos[pos_idx].score_mg;
+      pos[pos_idx + 1].score_eg                  = pos[pos_idx].score_eg;
+      pos[pos_idx + 1].phase                     = pos[pos_idx].phase;
+      pos[pos_idx + 1].pawn_key                  = pos[pos_idx].pawn_key;
       pos[pos_idx + 1].en_passant_pp             = 0;
 
-      pos[pos_idx].cur_step           = MAXSTEPS;
-      pos[pos_idx].steps[MAXSTEPS].f2 = NO_FIG;
+      pos[pos_idx].cur_step              = MAXSTEPS;
+      pos[pos_idx].steps[MAXSTEPS].f2    = NO_FIG;
+      pos[pos_idx].steps[MAXSTEPS].check = CheckType::NONE;
 
-      int tmpz = -alpha_beta(pos_idx + 1, -beta, -beta + 1, depth_left - 3);
+      int tmpz = -alpha_beta<!WHITE>(pos_idx + 1, -beta, -beta + 1, depth_left - 1 - r);
       zero = false;
-      if (tmpz >= beta) return beta;
+
+      increment(cur_thread->null_nodes, cur_thread->move_count - nodes);
+
+      if (tmpz >= beta) {
+        increment(cur_thread->null_cutoffs);
+        if ((pieces > NULL_VERIFY_PIECES) && (depth_left < NULL_VERIFY_DEPTH)) return beta;
+
+        skip_null = true;
+        if (alpha_beta<WHITE>(pos_idx, beta - 1, beta, std::max(1, depth_left - 1 - r)) >= beta) return beta;
+
+        increment(cur_thread->null_verify_fails);
+      }
     }
   }
   if ((pos_idx > 4)                && 
@@ -1385,58 +1651,21 @@ ChessEngine::alpha_beta(int pos_idx, int alpha, int beta, int depth_left)
   for (int i = 0; i < pos[pos_idx].steps_count; i++) {
     ext = 0;
     if (pos_idx == 0) {
-      depth = depth_left;
+      cur_thread->depth = depth_left;
       if (level < 7) if (pos[0].steps[pos[0].cur_step].check != CheckType::NONE) ext = 2;
     }
-    move_step(pos_idx, pos[pos_idx].steps[i]);
-    if (pos[pos_idx].white_move) check = check_on_white_king();
-    else check = check_on_black_king();
-
-    if (check) {
-      back_step(pos_idx, pos[pos_idx].steps[i]);
-      continue;
-    }
-
-    assert(i <= MAXSTEPS);
-    pos[pos_idx].cur_step = i;
-    move_pos(pos_idx, pos[pos_idx].steps[i]);
 
-    if (TRACE > 0) {
-      if (pos_idx == 0) {
-        std::cout << step_to_str(pos[0].steps[i]) << "  " << i + 1 << '/' << pos[0].steps_count;
-        //if (pos[0].steps[i].weight<-9000) { Serial.println(F(" checkmate")); continue; }
-      } 
-      else if (TRACE > pos_idx) {
-        std::cout << std::endl;
-        for (int ll = 0; ll < pos_idx; ll++) std::cout << "      ";
-        std::cout << pos_idx + 1 << "- " << step_to_str(pos[pos_idx].steps[i]);
-      }
-    } //TRACE
-
-    if ((pos_idx > 2) && !lazy && !zero && lazy_eval && pos[pos_idx].steps[i].f2 != NO_FIG && 
-        (pos[0].steps[pos[0].cur_step].check == CheckType::NONE) && 
-        (evaluate(pos_idx + 1) + 100 <= alpha) &&
-        (( pos[pos_idx].white_move && !check_on_black_king()) ||
-         (!pos[pos_idx].white_move && !check_on_white_king()))) {
-      lazy = true;
-      if (-alpha_beta(pos_idx + 1, -beta, -alpha, depth_left - 3) <= alpha) tmp = alpha;
-      else {
-        lazy = false;
-        tmp = -alpha_beta(pos_idx + 1, -beta, -alpha, depth_left - 1 + ext);
-      }
-      lazy = false;
-    } 
-    else tmp = -alpha_beta(pos_idx + 1, -beta, -alpha, depth_left - 1 + ext);
+    tmp = search_step<WHITE>(pos_idx, i, alpha, beta, depth_left, ext);
+    if (tmp == ILLEGAL_STEP) continue;
 
-    back_step(pos_idx, pos[pos_idx].steps[i]);
-    if (draw_repeat(pos_idx)) tmp = 0;
     if (tmp > score) score = tmp;
     pos[pos_idx].steps[i].weight = tmp;
 
     if (score > alpha) {
       alpha = score;
       pos[pos_idx].best = pos[pos_idx].steps[i];
-      if (pos_idx == 0 && level > 3) {
+      update_pv(pos_idx, pos[pos_idx].steps[i]);
+      if (pos_idx == 0 && level > 3 && pv_index == 0) {
         if (print_best(depth_left)) return alpha;
       }
     }
@@ -1454,8 +1683,30 @@ ChessEngine::alpha_beta(int pos_idx, int alpha, int beta, int depth_left)
     auto end_time = std::chrono::steady_clock::now();
     unsigned long duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count();
 
-    if (halt || (pos_idx < 3 && duration > time_limit)) //
+    if ((node_limit != 0) && (pos_idx < 3) && (total(&ThreadData::move_count, thread_count) >= (int) node_limit)) halt = true;
+
+    if ((interrupt_check != nullptr) && (chunk_time != 0) && (pos_idx < 3) && 
+        (cur_thread == &main_thread_data) && (duration >= next_interrupt_check)) {
+      next_interrupt_check = duration + INTERRUPT_PERIOD;
+      if (interrupt_check()) stopped = halt = true;
+    }
+
+    if (halt || (pos_idx < 3 && duration > search_limit)) //
       return score;
+
+    if ((active_split != nullptr) && split_cutoff()) return score;
+
+    // Young brothers wait: the first step being searched, the remaining 
+    // ones are offered to the idle threads.
+
+    if ((pos_idx > 0)                                   && 
+        (depth_left >= SPLIT_MIN_DEPTH)                 && 
+        (idle_threads > 0)                              && 
+        (cur_thread->split_count < MAX_SPLIT_POINTS)    &&
+        (i + 1 < pos[pos_idx].steps_count)) {
+      score = split<WHITE>(pos_idx, i + 1, alpha, beta, score, depth_left);
+      break;
+    }
   }
   if (score == -20000) {
     if ((pos_idx > 0) && pos[pos_idx].check_on_table) {
@@ -1467,13 +1718,263 @@ ChessEngine::alpha_beta(int pos_idx, int alpha, int beta, int depth_left)
   return score;
 }
 
+// Search the subtree of one step of a node. ILLEGAL_STEP is returned if 
+// the step leaves the king in check.
+template <bool WHITE>
+int
+ChessEngine::search_step(int pos_idx, int step_idx, int alpha, int beta, int depth_left, int ext)
+{
+  Step & step = pos[pos_idx].steps[step_idx];
+  int    tmp;
+
+  move_step<WHITE>(step);
+
+  if (check_on_king<WHITE>()) {
+    back_step<WHITE>(step);
+    return ILLEGAL_STEP;
+  }
+
+  assert(step_idx <= MAXSTEPS);
+  pos[pos_idx].cur_step = step_idx;
+  move_pos<WHITE>(pos_idx, step);
+
+  if (TRACE > 0) {
+    if (pos_idx == 0) {
+      std::cout << step_to_str(step) << "  " << step_idx + 1 << '/' << pos[0].steps_count;
+      //if (pos[0].steps[i].weight<-9000) { Serial.println(F(" checkmate")); continue; }
+    } 
+    else if (TRACE > pos_idx) {
+      std::cout << std::endl;
+      for (int ll = 0; ll < pos_idx; ll++) std::cout << "      ";
+      std::cout << pos_idx + 1 << "- " << step_to_str(step);
+    }
+  } //TRACE
+
+  if ((pos_idx > 2) && !lazy && !zero && lazy_eval && step.f2 != NO_FIG && 
+      (pos[0].steps[pos[0].cur_step].check == CheckType::NONE) && 
+      (evaluate(pos_idx + 1) + 100 <= alpha) &&
+      !check_on_king<!WHITE>()) {
+    lazy = true;
+    if (-alpha_beta<!WHITE>(pos_idx + 1, -beta, -alpha, depth_left - 3) <= alpha) tmp = alpha;
+    else {
+      lazy = false;
+      tmp = -alpha_beta<!WHITE>(pos_idx + 1, -beta, -alpha, depth_left - 1 + ext);
+    }
+    lazy = false;
+  } 
+  else tmp = -alpha_beta<!WHITE>(pos_idx + 1, -beta, -alpha, depth_left - 1 + ext);
+
+  back_step<WHITE>(step);
+  if (draw_repeat(pos_idx)) tmp = 0;
+
+  return tmp;
+}
+
+// Offer the remaining steps of a node, starting at first_step, to the idle 
+// threads, and take part in their search. Returns when all helpers are done.
+template <bool WHITE>
+int
+ChessEngine::split(int pos_idx, int first_step, int alpha, int beta, int score, int depth_left)
+{
+  SplitPoint & sp = cur_thread->split_points[cur_thread->split_count++];
+
+  sp.parent      = active_split;
+  sp.master_pos  = pos;
+  sp.pos_idx     = pos_idx;
+  sp.depth_left  = depth_left;
+  sp.beta        = beta;
+  sp.steps_count = pos[pos_idx].steps_count;
+  sp.white       = WHITE;
+  sp.zero        = zero;
+  sp.lazy        = lazy;
+  sp.helpers     = 0;
+  sp.next_step   = first_step;
+  sp.alpha       = alpha;
+  sp.score       = score;
+  sp.best_found  = false;
+  sp.cutoff      = false;
+  std::memcpy(sp.board, board, sizeof(Board));
+
+  {
+    std::lock_guard<std::mutex> work_guard(work_mutex);
+    std::lock_guard<std::mutex>      guard(sp.lock);
+    sp.open = true;
+  }
+  work_available.notify_all();
+
+  active_split = &sp;
+  search_split<WHITE>(sp);
+
+  {
+    std::unique_lock<std::mutex> guard(sp.lock);
+    sp.open = false;
+    sp.done.wait(guard, [&sp] { return sp.helpers == 0; });
+  }
+
+  active_split = sp.parent;
+  cur_thread->split_count--;
+
+  if (sp.best_found) {
+    pos[pos_idx].best = sp.best;
+    std::copy(sp.pv + pos_idx, sp.pv + sp.pv_length, cur_thread->pv[pos_idx] + pos_idx);
+    cur_thread->pv_length[pos_idx] = sp.pv_length;
+  }
+
+  return sp.score;
+}
+
+// Search the steps of a split point until none is left. Used by both the 
+// master and the helpers.
+template <bool WHITE>
+void
+ChessEngine::search_split(SplitPoint & sp)
+{
+  int pos_idx = sp.pos_idx;
+
+  for (;;) {
+    int i, alpha;
+
+    {
+      std::lock_guard<std::mutex> guard(sp.lock);
+      if (sp.cutoff || (sp.next_step >= sp.steps_count)) break;
+      i     = sp.next_step++;
+      alpha = sp.alpha;
+      if (pos != sp.master_pos) pos[pos_idx].steps[i] = sp.master_pos[pos_idx].steps[i];
+    }
+
+    int tmp = search_step<WHITE>(pos_idx, i, alpha, sp.beta, sp.depth_left, 0);
+    if (tmp == ILLEGAL_STEP) continue;
+    if (split_cutoff()) break;
+
+    {
+      std::lock_guard<std::mutex> guard(sp.lock);
+      if (tmp > sp.score) sp.score = tmp;
+      if (sp.score > sp.alpha) {
+        sp.alpha      = sp.score;
+        sp.best       = pos[pos_idx].steps[i];
+        sp.best_found = true;
+        update_pv(pos_idx, sp.best);
+        sp.pv_length  = cur_thread->pv_length[pos_idx];
+        std::copy(cur_thread->pv[pos_idx] + pos_idx, cur_thread->pv[pos_idx] + sp.pv_length, sp.pv + pos_idx);
+      }
+      if (sp.alpha >= sp.beta) sp.cutoff = true;
+    }
+
+    auto end_time = std::chrono::steady_clock::now();
+    unsigned long duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count();
+
+    if (halt || (pos_idx < 3 && duration > search_limit)) {
+      std::lock_guard<std::mutex> guard(sp.lock);
+      sp.next_step = sp.steps_count;
+      break;
+    }
+  }
+}
+
+// A helper joining a split point gets a copy of the master board and of the 
+// path of positions leading to the split node, before searching its steps.
+void
+ChessEngine::join_split(SplitPoint & sp)
+{
+  const Position * master_pos = sp.master_pos;
+  int              pos_idx    = sp.pos_idx;
+
+  std::memcpy(board, sp.board, sizeof(Board));
+  init_piece_lists();
+  if (nnue_active) nnue.refresh(board);
+
+  for (int i = 0; i <= MAXDEPTH; i++) pos[i].white_move = master_pos[i].white_move;
+
+  // Only the current step of the previous positions is looked at (repetitions, 
+  // check and capture status of the last step)
+
+  for (int i = 0; i < pos_idx; i++) {
+    pos[i].steps[0] = master_pos[i].steps[master_pos[i].cur_step];
+    pos[i].cur_step = 0;
+  }
+
+  Position       & cur    = pos[pos_idx];
+  const Position & master = master_pos[pos_idx];
+
+  cur.white_castle_kingside_ok  = master.white_castle_kingside_ok;
+  cur.white_castle_queenside_ok = master.white_castle_queenside_ok;
+  cur.black_castle_kingside_ok  = master.black_castle_kingside_ok;
+  cur.black_castle_queenside_ok = master.black_castle_queenside_ok;
+  cur.en_passant_pp             = master.en_passant_pp;
+  cur.steps_count               = master.steps_count;
+  cur.check_on_table            = master.check_on_table;
+  cur.weight_white              = master.weight_white;
+  cur.weight_black              = master.weight_black;
+  cur.score_mg                  = master.score_mg;
+  cur.score_eg                  = master.score_eg;
+  cur.phase                     = master.phase;
+  cur.pawn_key                  = master.pawn_key;
+
+  zero         = sp.zero;
+  lazy         = sp.lazy;
+  active_split = &sp;
+
+  if (sp.white) search_split<true >(sp);
+  else          search_split<false>(sp);
+
+  active_split = nullptr;
+
+  std::lock_guard<std::mutex> guard(sp.lock);
+  sp.helpers--;
+  sp.done.notify_one();
+}
+
+void
+ChessEngine::worker(int thread_idx)
+{
+  cur_thread = thread_data[thread_idx];
+  pos        = cur_thread->pos;
+  pawn_hash  = cur_thread->pawn_hash;
+  nnue.use_accumulator(thread_idx);
+
+  for (;;) {
+    SplitPoint * sp;
+
+    {
+      std::unique_lock<std::mutex> guard(work_mutex);
+      idle_threads++;
+      work_available.wait(guard, [&sp] { return stopping || ((sp = find_split_point()) != nullptr); });
+      idle_threads--;
+      if (stopping) return;
+    }
+
+    join_split(*sp);
+  }
+}
+
+void
+ChessEngine::attach_thread()
+{
+  cur_thread = new ThreadData;
+  pos        = cur_thread->pos;
+  pawn_hash  = cur_thread->pawn_hash;
+
+  cur_thread->split_count = 0;
+  for (auto & entry : cur_thread->pawn_hash) entry.key = 0xFFFFFFFFUL;
+}
+
+void
+ChessEngine::detach_thread()
+{
+  if (cur_thread != &main_thread_data) delete cur_thread;
+
+  cur_thread = &main_thread_data;
+  pos        = cur_thread->pos;
+  pawn_hash  = cur_thread->pawn_hash;
+}
+
 bool 
 ChessEngine::print_best(int dep)
 {
   auto end_time = std::chrono::steady_clock::now();
   unsigned long duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count();
 
-  if (halt || (duration > time_limit)) return false;
+  if (halt || (duration > search_limit)) return false;
   
   if (last_best_depth == dep && 
       pos[0].best.type == last_best_step.type &&
@@ -1494,7 +1995,7 @@ ChessEngine::print_best(int dep)
   std::cout << (pos[0].white_move ? "1." : "1...") << st;
 
   for (std::size_t i = 0; i < 10 - st.length(); i++) std::cout << ' ';
-  std::string depf = "/" + std::to_string(depth + 1) + " ";
+  std::string depf = "/" + std::to_string(depth_reached() + 1) + " ";
 
   end_time = std::chrono::steady_clock::now();
   duration = std::chrono::duration_cast<std::chrono::seconds>(end_time - start_time).count();
@@ -1509,7 +2010,7 @@ ChessEngine::print_best(int dep)
     std::cout << std::setprecision(2) << (pos[0].best.weight / 100.);
   }
 
-  std::cout << ") Depth: " << dep << depf << get_time(duration) << " " << (move_count / 1000) << "kN" << std::endl;
+  std::cout << ") Depth: " << dep << depf << get_time(duration) << " " << (total(&ThreadData::move_count, thread_count) / 1000) << "kN" << std::endl;
   return ret;
 }
 
@@ -1536,11 +2037,26 @@ ChessEngine::solve_step()
   int  score;
   bool solved = false;
 
-  move_count  = 0;
+  for (int i = 0; i < thread_count; i++) {
+    thread_data[i]->move_count       = 0;
+    thread_data[i]->pawn_hash_misses = 0;
+    thread_data[i]->depth            = 0;
+    thread_data[i]->null_tries        = 0;
+    thread_data[i]->null_cutoffs      = 0;
+    thread_data[i]->null_verify_fails = 0;
+    thread_data[i]->null_nodes        = 0;
+    thread_data[i]->bitbase_hits      = 0;
+  }
+
   count_in    = 0;
   count_all   = 0;
   zero        = false;
   lazy        = false;
+  halt        = false;
+  stopped     = false;
+  interrupted = false;
+  pv_index    = 0;
+  pv_found    = 0;
 
   for (int i = 1; i < MAXDEPTH; i++) {
     if (i % 2) pos[i].white_move = !pos[0].white_move;
@@ -1550,6 +2066,10 @@ ChessEngine::solve_step()
 
   start_time = std::chrono::steady_clock::now();
 
+  init_piece_lists();
+
+  bitbase_pieces = (bitbases_enabled && bitbases.is_ready()) ? std::min(piece_count[0] + piece_count[1], BITBASE_MAX_PIECES + 1) : 0;
+
   if (is_draw()) {
     std::cout << " DRAW!" << std::endl;
     end_of_game = EndOfGameType::DRAW;
@@ -1564,42 +2084,29 @@ ChessEngine::solve_step()
 
   pos[0].weight_black     = 0;
   pos[0].weight_white     = 0;
+  pos[0].score_mg         = 0;
+  pos[0].score_eg         = 0;
+  pos[0].phase            = 0;
+  pos[0].pawn_key         = 0;
 
   for (int i = 0; i < 64; i++) { //
-    if (board[i] < 0) {
-      pos[0].weight_black += fig_weight[-board[i]];
-    } 
-    else if (board[i] > 0) {
-      pos[0].weight_white += fig_weight[board[i]]; //   8000
-    }
-  }
-
-  if (pos[0].weight_white + pos[0].weight_black < 3500) endgame = true;
-  else endgame = false;  //3500?
-
-  //Serial.println("endgame="+std::string(endgame));
-
-  pos[0].weight_both = 0;
-
-  for (int i = 0; i < 64; i++) { //
-    int f = board[i];
+    int8_t f = board[i];
 
     if (f == NO_FIG) continue;
-    if (abs(f) == KING && endgame) {
-      if (is_black_fig(f))
-        pos[0].weight_both -= stat_weight_black[6][i];
-      else
-        pos[0].weight_both += stat_weight_white[6][i];
+    if (is_black_fig(f)) {
+      pos[0].weight_black += fig_weight[-f];
     } 
     else {
-      if (is_black_fig(f))
-        pos[0].weight_both -= stat_weight_black[-f - 1][i];
-      else
-        pos[0].weight_both += stat_weight_white[f - 1][i];
+      pos[0].weight_white += fig_weight[f]; //   8000
     }
+    pos[0].score_mg += pst_mg(f, i);
+    pos[0].score_eg += pst_eg(f, i);
+    pos[0].phase    += fig_phase[abs(f)];
+    if (abs(f) == PAWN) pos[0].pawn_key ^= pawn_zobrist_key(f, i);
   }
 
-  kingpositions();
+  nnue_active = nnue_enabled && nnue.is_ready();
+  if (nnue_active) nnue.refresh(board);
 
   if (TRACE > 0) std::cout << " start score=" << evaluate(0) << std::endl;
 
@@ -1632,6 +2139,62 @@ ChessEngine::solve_step()
   sort_steps(0);
   pos[0].steps_count = legal;
 
+  // In an ending covered by the bitbases, only the steps keeping the best
+  // outcome are searched. The search then finds its way to that outcome.
+
+  if (bitbases_enabled && bitbases.is_ready() && ((piece_count[0] + piece_count[1]) <= BITBASE_MAX_PIECES)) {
+    WDL  outcomes[MAXSTEPS];  // From the opponent perspective
+    bool found = true;
+
+    for (int i = 0; found && (i < legal); i++) {
+      move_step(0, pos[0].steps[i]);
+      found = bitbases.probe(board, !pos[0].white_move, outcomes[i]);
+      back_step(0, pos[0].steps[i]);
+    }
+
+    if (found) {
+      WDL best = WDL::WIN;
+      for (int i = 0; i < legal; i++) {
+        if      (outcomes[i] == WDL::LOSS) best = WDL::LOSS;
+        else if ((outcomes[i] == WDL::DRAW) && (best == WDL::WIN)) best = WDL::DRAW;
+      }
+
+      int kept = 0;
+      for (int i = 0; i < legal; i++) {
+        if (outcomes[i] == best) pos[0].steps[kept++] = pos[0].steps[i];
+      }
+      legal = pos[0].steps_count = kept;
+
+      std::cout << "Bitbases: " << legal << " steps kept." << std::endl;
+    }
+  }
+
+  // A result from a previous search of this position, with at least the
+  // same time budget, is used as is. Not for a multi-PV analysis, as only
+  // the best step is kept.
+
+  uint64_t key    = AnalysisCache::position_key(board, pos[0]);
+  uint16_t budget = std::min<unsigned long>(time_limit / 100, UINT16_MAX);
+
+  if (analysis_cache.is_ready() && (pv_count == 1)) {
+    CacheEntry entry;
+
+    if (analysis_cache.lookup(key, budget, entry)) {
+      for (int i = 0; i < legal; i++) {
+        if ((pos[0].steps[i].c1 == entry.c1) && (pos[0].steps[i].c2 == entry.c2) && (pos[0].steps[i].type == entry.type)) {
+          pos[0].steps[i].check = entry.check;
+          pos[0].best           = pos[0].steps[i];
+          pos[0].best.weight    = entry.score;
+
+          std::cout << (pos[0].white_move ? "1." : "1...") << step_to_str(pos[0].best) 
+                    << " (cached, depth " << +entry.depth << ')' << std::endl;
+
+          return entry.score > 9900;
+        }
+      }
+    }
+  }
+
   int alpha = -20000;
   int beta  =  20000;
 
@@ -1644,6 +2207,63 @@ ChessEngine::solve_step()
 
   stats = true;
 
+  // Resume an interrupted search of this position. Only searches done in
+  // chunks use the checkpoint: searches done in one go (e.g. the engine
+  // playing a move) leave it untouched, to be resumed later.
+
+  bool chunked = (chunk_time != 0);
+
+  if (chunked && (checkpoint.key == key) && (checkpoint.time_limit == time_limit) && (checkpoint.steps_count == legal)) {
+    std::memcpy(pos[0].steps, checkpoint.steps, legal * sizeof(Step));
+
+    pos[0].best     = checkpoint.best;
+    last_best_step  = checkpoint.last_best_step;
+    last_best_depth = checkpoint.last_best_depth;
+    level           = checkpoint.level;
+    samebest        = checkpoint.samebest;
+    alpha           = checkpoint.alpha;
+    beta            = checkpoint.beta;
+    stats           = checkpoint.stats;
+    start_time     -= std::chrono::milliseconds(checkpoint.elapsed);
+
+    std::cout << "Search resumed at level " << level << ", " << checkpoint.elapsed << " ms spent." << std::endl;
+  }
+  else if (chunked) {
+    checkpoint.chunks = 0;
+  }
+
+  if (chunked) checkpoint.key = 0;
+
+  // An iteration cut by the end of a chunk is searched again from its start.
+  // The chunk is doubled each time this happens, for the iteration to be
+  // eventually completed.
+
+  unsigned long elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count();
+
+  search_limit = (chunk_time == 0) ? time_limit 
+                                   : std::min<unsigned long>(time_limit, elapsed + (chunk_time << std::min<int>(checkpoint.chunks, 4)));
+
+  next_interrupt_check = elapsed;
+
+  // State before the next iteration
+
+  auto record_checkpoint = [&]() {
+    checkpoint.time_limit      = time_limit;
+    checkpoint.chunks          = (checkpoint.level == level) ? checkpoint.chunks : 0;
+    checkpoint.level           = level;
+    checkpoint.samebest        = samebest;
+    checkpoint.alpha           = alpha;
+    checkpoint.beta            = beta;
+    checkpoint.stats           = stats;
+    checkpoint.last_best_depth = last_best_depth;
+    checkpoint.last_best_step  = last_best_step;
+    checkpoint.best            = pos[0].best;
+    checkpoint.steps_count     = pos[0].steps_count;
+    std::memcpy(checkpoint.steps, pos[0].steps, pos[0].steps_count * sizeof(Step));
+  };
+
+  if (chunked) record_checkpoint();
+
   while (level <= 20) {
     if (TRACE > 0) {
       std::cout << "******* LEVEL=" << level << std::endl;
@@ -1659,7 +2279,12 @@ ChessEngine::solve_step()
       if (pos[0].white_move) pos[0].steps[i].check = check_on_black_king() ? CheckType::CHECK : CheckType::NONE;
       else pos[0].steps[i].check = check_on_white_king() ? CheckType::CHECK : CheckType::NONE;
 
-      pos[0].steps[i].weight += evaluate(0) + ((int)(pos[0].steps[i].check)) * 500;
+      // The position after the step is evaluated with its own pawn key (the
+      // pawn hash entry of the root key must hold the root pawn structure)
+
+      move_pos(0, pos[0].steps[i]);
+
+      pos[0].steps[i].weight += -evaluate(1) + ((int)(pos[0].steps[i].check)) * 500;
 
       if (pos[0].steps[i].f2 != NO_FIG) pos[0].steps[i].weight -= pos[0].steps[i].f1;
       back_step(0, pos[0].steps[i]);
@@ -1674,7 +2299,10 @@ ChessEngine::solve_step()
     //beta=10000; alpha=9900;
     //int sec=(millis()-start_time)/1000;
     fdepth = 4;
-    score  = alpha_beta(0, alpha, beta, level);
+    score  = pos[0].white_move ? alpha_beta<true >(0, alpha, beta, level)
+                               : alpha_beta<false>(0, alpha, beta, level);
+
+    if (pv_count > 1) search_pv_lines();
 
     auto end_time = std::chrono::steady_clock::now();
     unsigned long duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count();
@@ -1682,7 +2310,7 @@ ChessEngine::solve_step()
     bool out = 0;
     if (score >= beta) out = 1;
 
-    if (multi_pov || samebest > 2 || out) {
+    if ((pv_count > 1) || samebest > 2 || out) {
       samebest = 0;
       alpha = -20000;
       beta  =  20000;
@@ -1692,7 +2320,7 @@ ChessEngine::solve_step()
       beta  = score + 100;
     }
 
-    if ((duration > (time_limit * 0.2)) && !out) {
+    if ((duration > (time_limit * 0.2)) && !out && (pv_count == 1)) {
       stats = false;
       alpha = score - 300;
       beta  = score + 300;
@@ -1703,7 +2331,15 @@ ChessEngine::solve_step()
       solved = true;
       break;
     }
-    if (duration > time_limit || halt) break;
+    if (duration > search_limit || halt) {
+      interrupted = (stopped || !halt) && (duration <= time_limit);
+      if (interrupted) {
+        checkpoint.key     = key;
+        checkpoint.elapsed = duration;
+        if (!stopped) checkpoint.chunks++; // Only a chunk too short is made longer
+      }
+      break;
+    }
     if (pos[0].best.type == last_best_step.type && pos[0].best.c1 == last_best_step.c1 && pos[0].best.c2 == last_best_step.c2) {
       samebest++;
     } 
@@ -1711,14 +2347,134 @@ ChessEngine::solve_step()
 
     level++;
 
+    if (chunked) record_checkpoint();
+
     //Serial.println(level);
     //Serial.println(duration/1000);
   } //while level
+
+  // The last iteration may have been cut by the time limit
+
+  if (analysis_cache.is_ready() && !halt && !interrupted && (pos[0].best.c1 != -1)) {
+    CacheEntry entry = {
+      .key    = key,
+      .score  = pos[0].best.weight,
+      .budget = budget,
+      .depth  = (int8_t)(solved ? level : level - 1),
+      .c1     = pos[0].best.c1,
+      .c2     = pos[0].best.c2,
+      .type   = pos[0].best.type,
+      .check  = pos[0].best.check
+    };
+    analysis_cache.store(entry);
+  }
+
+  if (TRACE > 0) {
+    int nodes = total(&ThreadData::move_count, thread_count);
+
+    std::cout << "Pawn hash misses: " << total(&ThreadData::pawn_hash_misses, thread_count) << '/' << nodes << std::endl;
+    std::cout << "Null moves: "       << total(&ThreadData::null_tries,        thread_count) << " tries, "
+                                      << total(&ThreadData::null_cutoffs,      thread_count) << " cutoffs, "
+                                      << total(&ThreadData::null_verify_fails, thread_count) << " refuted by verification, "
+                                      << total(&ThreadData::null_nodes,        thread_count) << '/' << nodes << " nodes" << std::endl;
+    std::cout << "Bitbase hits: "     << total(&ThreadData::bitbase_hits,      thread_count) << std::endl;
+  }
   //Serial.println(std::string(count_in)+"/"+std::string(count_all));
   //Serial.println("Task load: "+std::string(0.1*task_execute/(millis()-start_time))+"%");
   return solved;
 }
 
+// Multi-PV: once the main search of an iteration is done, each further line
+// is the best step of a new full window search of the root, the root steps
+// of the lines already found being moved past the end of the steps list.
+// The lines replace those of the previous iteration only when they are all
+// found in time.
+
+void
+ChessEngine::search_pv_lines()
+{
+  PrincipalVariation lines[MAX_PV];
+
+  Step best        = pos[0].best;
+  int  steps_count = pos[0].steps_count;
+  int  count       = 0;
+
+  auto elapsed = [this]() -> unsigned long {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count();
+  };
+
+  while ((count < pv_count) && (count < steps_count)) {
+    if (count > 0) {
+      int last = steps_count - count;
+      for (int i = 0; i <= last; i++) {
+        if ((pos[0].steps[i].c1   == lines[count - 1].steps[0].c1) && 
+            (pos[0].steps[i].c2   == lines[count - 1].steps[0].c2) &&
+            (pos[0].steps[i].type == lines[count - 1].steps[0].type)) {
+          std::swap(pos[0].steps[i], pos[0].steps[last]);
+          break;
+        }
+      }
+
+      pos[0].steps_count = last;
+      pos[0].best.c1     = -1;
+      pv_index           = count;
+
+      if (pos[0].white_move) alpha_beta<true >(0, -20000, 20000, level);
+      else                   alpha_beta<false>(0, -20000, 20000, level);
+    }
+
+    if (halt || (elapsed() > search_limit) || (pos[0].best.c1 == -1) || (cur_thread->pv_length[0] == 0)) break;
+
+    PrincipalVariation & line = lines[count++];
+
+    line.score  = pos[0].best.weight;
+    line.depth  = level;
+    line.length = cur_thread->pv_length[0];
+    std::copy(cur_thread->pv[0], cur_thread->pv[0] + line.length, line.steps);
+  }
+
+  if ((count == std::min(pv_count, steps_count)) || (pv_found == 0)) {
+    std::copy(lines, lines + count, pv_lines);
+    pv_found = count;
+  }
+
+  pos[0].steps_count = steps_count;
+  pos[0].best        = best;
+  pv_index           = 0;
+}
+
+// Score of position 0, in centipawns from the side to move perspective,
+// using a search bounded by time_ms. Used for game analysis: the engine
+// time limit and end of game status are left untouched.
+
+int
+ChessEngine::analyse_position(uint32_t time_ms)
+{
+  unsigned long saved_time_limit  = time_limit;
+  EndOfGameType saved_end_of_game = end_of_game;
+
+  time_limit  = time_ms;
+  end_of_game = EndOfGameType::NONE;
+
+  for (int i = 0; i < MAXEPD; i++) best_move[i].c1 = -1;
+  pos[0].best.c1 = -1;
+
+  solve_step();
+
+  int score;
+  switch (end_of_game) {
+    case EndOfGameType::CHECKMATE: score = -10000; break;
+    case EndOfGameType::PAT:
+    case EndOfGameType::DRAW:      score =      0; break;
+    default:                       score = (pos[0].best.c1 == -1) ? 0 : pos[0].best.weight; break;
+  }
+
+  time_limit  = saved_time_limit;
+  end_of_game = saved_end_of_game;
+
+  return score;
+}
+
 bool 
 ChessEngine::load_board_from_fen(std::string str)
 {
@@ -1792,9 +2548,30 @@ ChessEngine::load_board_from_fen(std::string str)
     if (spaces == 4) break;
   }
 
+  init_piece_lists();
+
   return load;
 }
 
+// Position without castling nor en passant
+
+void
+ChessEngine::set_board(const Board & new_board, bool white_move)
+{
+  std::memcpy(board, new_board, sizeof(Board));
+
+  pos[0].white_move                = white_move;
+  pos[0].white_castle_kingside_ok  = false;
+  pos[0].white_castle_queenside_ok = false;
+  pos[0].black_castle_kingside_ok  = false;
+  pos[0].black_castle_queenside_ok = false;
+  pos[0].en_passant_pp             = 0;
+  pos[0].cur_step                  = 0;
+  pos[0].steps_count               = 0;
+
+  init_piece_lists();
+}
+
 std::string 
 ChessEngine::export_pos_to_fen(int pos_idx)
 {
@@ -1917,38 +2694,125 @@ ChessEngine::get_best_move(int move_idx)
 }
 
 static void
-chess_task_start()
+worker_start(int thread_idx)
 {
-  chess_engine_task.exec();
+  chess_engine.worker(thread_idx);
 }
 
 void
-ChessEngine::setup(int32_t time)
+ChessEngine::setup(int32_t time, int max_threads)
 { 
-  #if CHESS_LINUX_BUILD
-    mq_unlink("/chess_task");
-    mq_unlink("/chess_engine");
-
-    task_queue      = mq_open("/chess_task",      O_RDWR|O_CREAT, S_IRWXU, &task_attr);
-    if (task_queue == -1) { std::cerr << "Unable to open task_queue:" << errno << std::endl; return; }
+  // Pseudo-random pawn keys (xorshift32). Key 0 is kept for the 
+  // position without pawns, so the table entries are initially 
+  // marked with a key that cannot be found.
+
+  uint32_t seed = 2463534242UL;
+  for (int color = 0; color < 2; color++) {
+    for (int board_idx = 0; board_idx < 64; board_idx++) {
+      seed ^= seed << 13;
+      seed ^= seed >> 17;
+      seed ^= seed <<  5;
+      pawn_zobrist[color][board_idx] = seed;
+    }
+  }
 
-    engine_queue    = mq_open("/chess_engine",    O_RDWR|O_CREAT, S_IRWXU, &engine_attr);
-    if (engine_queue == -1) { std::cerr << "Unable to open engine_queue:" << errno << std::endl; return; }
+  max_threads = std::clamp(max_threads, 1, MAX_SEARCH_THREADS);
 
-    chess_task = std::thread(chess_task_start); 
+  #if CHESS_LINUX_BUILD
+    thread_count = std::min<int>(max_threads, std::max(1U, std::thread::hardware_concurrency()));
   #else
-    task_queue      = xQueueCreate(5, sizeof(TaskQueueData));
-    engine_queue    = xQueueCreate(5, sizeof(EngineQueueData));
+    thread_count = max_threads;
 
-    auto cfg = create_config("chessTask", 1, 20 * 1024, configMAX_PRIORITIES - 2);
+    auto cfg = create_config("chessTask", 1, 32 * 1024, configMAX_PRIORITIES - 2);
     cfg.inherit_cfg = true;
     esp_pthread_set_cfg(&cfg);
-    chess_task = std::thread(chess_task_start);
   #endif
 
+  for (int thread_idx = 1; thread_idx < thread_count; thread_idx++) {
+    thread_data[thread_idx] = new (std::nothrow) ThreadData;
+    if (thread_data[thread_idx] == nullptr) {
+      std::cerr << "Unable to allocate search thread data." << std::endl;
+      thread_count = thread_idx;
+      break;
+    }
+  }
+
+  for (int thread_idx = 0; thread_idx < thread_count; thread_idx++) {
+    thread_data[thread_idx]->split_count = 0;
+    for (auto & entry : thread_data[thread_idx]->pawn_hash) entry.key = 0xFFFFFFFFUL;
+  }
+
+  for (int thread_idx = 1; thread_idx < thread_count; thread_idx++) {
+    workers.threads[thread_idx - 1] = std::thread(worker_start, thread_idx);
+  }
+
   set_engine_time(time);
 }
 
+// The checkpoint file holds a version byte followed by the SearchCheckpoint 
+// structure. Without a pending checkpoint, the file is removed.
+
+static const uint8_t CHECKPOINT_FILE_VERSION = 1;
+
+bool
+ChessEngine::save_checkpoint(const char * filename)
+{
+  if (checkpoint.key == 0) {
+    remove(filename);
+    return true;
+  }
+
+  FILE * file = fopen(filename, "wb");
+  if (file == nullptr) {
+    std::cerr << "Unable to save search checkpoint: " << filename << std::endl;
+    return false;
+  }
+
+  bool res = (fwrite(&CHECKPOINT_FILE_VERSION, 1, 1, file) == 1) &&
+             (fwrite(&checkpoint, sizeof(SearchCheckpoint), 1, file) == 1);
+
+  fclose(file);
+  return res;
+}
+
+bool
+ChessEngine::load_checkpoint(const char * filename)
+{
+  checkpoint.key = 0;
+
+  FILE * file = fopen(filename, "rb");
+  if (file == nullptr) return false;
+
+  uint8_t version;
+  bool    res = (fread(&version, 1, 1, file) == 1) && (version == CHECKPOINT_FILE_VERSION) &&
+                (fread(&checkpoint, sizeof(SearchCheckpoint), 1, file) == 1)             &&
+                (checkpoint.steps_count > 0) && (checkpoint.steps_count <= MAXSTEPS);
+
+  fclose(file);
+
+  if (!res) checkpoint.key = 0;
+  return res;
+}
+
+bool
+ChessEngine::open_analysis_cache(const char * folder)
+{
+  return analysis_cache.open(folder);
+}
+
+int
+ChessEngine::load_bitbases(const char * folder)
+{
+  return bitbases.load(folder);
+}
+
+bool
+ChessEngine::load_nnue(const char * filename)
+{
+  nnue_active = false;
+  return nnue.load(filename);
+}
+
 void 
 ChessEngine::set_engine_time(int32_t time) 
 { 
@@ -9,50 +9,16 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <cinttypes>
 #include <string>
 #include <thread>
 
-#if CHESS_LINUX_BUILD
-  #include <mqueue.h>
-#else
-  #include "freertos/FreeRTOS.h"
-  #include "freertos/task.h"
-  #include "freertos/queue.h"
-  
-  // #include "freertos/semphr.h"
-#endif
-
-#include "chess_engine.hpp"
 #include "chess_engine_types.hpp"
 
-class ChessTask 
-{
-  public:
-    ChessTask() { }
-
-    void exec();
-
-    inline void set_pos_idx(int pos_idx) { task_pos_idx = pos_idx; }
-    void     retrieve_steps(int pos_idx);
-
-  private:
-
-    int                task_pos_idx;
-
-    Step steps[MAXSTEPS]; 
-    int      steps_count;
-
-    void  add_one_step(int c1, int c2);
-    void add_king_step(int8_t board_idx);
-
-};
-
-#if CHESS_ENGINE
-  ChessTask   chess_engine_task;
-#else
-  extern ChessTask   chess_engine_task;
-#endif
+struct PawnHashEntry;
+struct SplitPoint;
 
 class ChessEngine
 {
@@ -60,41 +26,92 @@ class ChessEngine
 
     ChessEngine() : 
               TRACE(0),
+         chunk_time(0),
+    interrupt_check(nullptr),
         best_solved(false),
-               zero(false),
               level(2),
               stats(true), 
-         move_count(0),
            count_in(0),
           count_all(0),
-          null_move(false),
-          multi_pov(false),
+          null_move(true),
+           pv_count(1),
+           pv_index(0),
+           pv_found(0),
            futility(true),
           lazy_eval(true),
+        nnue_active(false),
+       nnue_enabled(true),
+   bitbases_enabled(true),
              fdepth(4),
-              depth(0),
          null_depth(0),
-               lazy(false),
+       thread_count(1),
     last_best_depth(0),
+         node_limit(0),
                halt(false),
-            endgame(false) { }
+            stopped(false),
+        interrupted(false) { checkpoint.key = 0; }
 
 
     static const uint8_t    row[64];
     static const uint8_t column[64];
 
-    void                      setup(int32_t time);
+    void                      setup(int32_t time, int max_threads = MAX_SEARCH_THREADS);
 
     void                   new_game() { end_of_game = EndOfGameType::NONE; }
 
     void            set_engine_time(int32_t time);
+
+    // Search limits and features, mostly used to compare engine settings
+    // (see tools/selfplay.cpp). A node limit of 0 means no limit.
+
+    inline void      set_time_limit(uint32_t time_ms) { time_limit       = time_ms; }
+    inline void      set_node_limit(uint32_t nodes)   { node_limit       = nodes;   }
+    inline void       set_null_move(bool active)      { null_move        = active;  }
+    inline void        set_futility(bool active)      { futility         = active;  }
+    inline void       set_lazy_eval(bool active)      { lazy_eval        = active;  }
+    inline void            set_nnue(bool active)      { nnue_enabled     = active;  }
+    inline void        set_bitbases(bool active)      { bitbases_enabled = active;  }
+
+    bool                  load_nnue(const char * filename);
+    bool        open_analysis_cache(const char * folder);
+    int               load_bitbases(const char * folder);
+    void                     worker(int thread_idx);
     void             generate_steps(int pos_idx);
 
     bool        load_board_from_fen(std::string str);
+    void                  set_board(const Board & new_board, bool white_move);
     std::string   export_pos_to_fen(int pos_idx);
 
     bool                 solve_step();
 
+    // Long searches can be done in chunks of at most chunk_time ms (0 = no
+    // chunks). When a search is interrupted at the end of a chunk, its state
+    // is kept in a checkpoint, and the next call to solve_step() for the same
+    // position and time limit resumes it. The checkpoint can be saved to,
+    // and loaded from, a file.
+
+    inline void     set_chunk_time(uint32_t time_ms) { chunk_time = time_ms; }
+
+    // A search done in chunks also stops, as at the end of a chunk, when the
+    // interrupt check returns true (e.g. a key is waiting to be processed).
+    // It is called by the main search thread only, every INTERRUPT_PERIOD ms.
+
+    typedef bool (*InterruptCheck)();
+    inline void set_interrupt_check(InterruptCheck check) { interrupt_check = check; }
+    inline bool is_search_interrupted() const { return interrupted; }
+    bool            save_checkpoint(const char * filename);
+    bool            load_checkpoint(const char * filename);
+    int            analyse_position(uint32_t time_ms);
+
+    // Multi-PV analysis: with a count above 1, solve_step() also finds the
+    // next best root steps, each one by a new search of the root without the
+    // steps of the lines already found. The lines of the last completed
+    // iteration are kept, best first.
+
+    inline void        set_pv_count(int count) { pv_count = std::max(1, std::min(count, MAX_PV)); }
+    inline int         get_pv_found() const    { return pv_found; }
+    inline const PrincipalVariation & get_pv(int idx) const { return pv_lines[idx]; }
+
     void                  back_step(int pos_idx, Step & step);
     void                  move_step(int pos_idx, Step & step);
     void                   move_pos(int pos_idx, Step & step);
@@ -110,10 +127,18 @@ class ChessEngine
     bool        check_on_white_king();
     bool        check_on_black_king();
 
+    template <bool WHITE> bool check_on_king();
+
     bool               is_checkmate();
 
     inline EndOfGameType get_end_of_game_type() { return end_of_game; }
 
+    // A thread other than the search threads (e.g. a tool using the move
+    // generator) gets its own board and positions with attach_thread().
+
+    void                attach_thread();
+    void                detach_thread();
+
 #if 0
     void                      getbm(int n, Step ep);
 #endif
@@ -124,52 +149,88 @@ class ChessEngine
   private:
     int TRACE;
 
-    std::thread chess_task;
-
     bool      print_best(int dep);
-    bool        checkd_w();
-    bool        checkd_b();
+    void search_pv_lines();
+
+    // Side to move specialized versions. WHITE is true when white is to move.
+
+    template <bool WHITE> bool         checkd();
+    template <bool WHITE> void      move_step(Step & step);
+    template <bool WHITE> void      back_step(Step & step);
+    template <bool WHITE> void       move_pos(int pos_idx, Step & step);
+    template <bool WHITE> void generate_steps(int pos_idx);
+    template <bool WHITE> int      quiescence(int pos_idx, int alpha, int beta, int depth_left);
+    template <bool WHITE> int      alpha_beta(int pos_idx, int alpha, int beta, int depth_left);
+    template <bool WHITE> int     search_step(int pos_idx, int step_idx, int alpha, int beta, int depth_left, int ext);
+    template <bool WHITE> int           split(int pos_idx, int first_step, int alpha, int beta, int score, int depth_left);
+    template <bool WHITE> void   search_split(SplitPoint & sp);
+    template <bool WHITE> void add_pawn_steps(int pos_idx, int8_t board_idx);
+
+    void      join_split(SplitPoint & sp);
+
     bool     draw_repeat(int pos_idx);
     int           active(Step & step);
-    int       quiescence(int pos_idx, int alpha, int beta, int depth_left);
-    int       alpha_beta(int pos_idx, int alpha, int beta, int depth_left);
+    int              see(const Step & step);
+    int8_t least_attacker(int8_t board_idx, bool white, int8_t & from_idx);
     int         evaluate(int pos_idx);
-    void   kingpositions();
+    void  evaluate_pawns(PawnHashEntry & entry);
+    void evaluate_shield(PawnHashEntry & entry);
+    const PawnHashEntry & probe_pawns(int pos_idx);
+    void init_piece_lists();
     bool         is_draw();
     void      sort_steps(int pos_idx);
+    void    add_one_step(int pos_idx, int c1, int c2);
+    void add_promotion_steps(int pos_idx, int c1, int c2);
     void   add_king_step(int pos_idx, int board_idx);
     void add_knight_step(int pos_idx, int board_idx);
     void   add_stra_step(int pos_idx, int board_idx);
     void   add_diag_step(int pos_idx, int board_idx);
 
+    int        depth_reached();
+
     std::string get_time(long tim);
 
     unsigned long time_limit;
+    unsigned long search_limit;  // time_limit, or the end of the current chunk
+    static constexpr unsigned long INTERRUPT_PERIOD = 20;
+
+    uint32_t      chunk_time;
+    InterruptCheck interrupt_check;
+    unsigned long  next_interrupt_check;  // Search time of the next interrupt check, in ms
     std::chrono::time_point<std::chrono::steady_clock> start_time;
 
     bool   best_solved;
-    bool   zero;
     int    level;
 
     bool   stats;
-    int    move_count;
     int    count_in;
     int    count_all;
 
     bool   null_move;
-    bool   multi_pov;
+    int    pv_count;     // Lines searched by the multi-PV analysis
+    int    pv_index;     // Line being searched, 0 being the main one
+    int    pv_found;     // Lines available in pv_lines
     bool   futility;
     bool   lazy_eval;
+    bool   nnue_active;
+    bool   nnue_enabled;
+    bool   bitbases_enabled;
 
     int    fdepth;
 
-    int    depth;
     int    null_depth;
-    bool   lazy;
+    int    thread_count;
     int    last_best_depth;
 
-    bool   halt;
-    bool   endgame;
+    uint32_t node_limit;
+
+    std::atomic<bool> halt;  // Set by the first search thread reaching the node limit, or by an interrupt
+    bool   stopped;          // The search was halted by the interrupt check
+    bool   interrupted;
+
+    SearchCheckpoint checkpoint;
+
+    PrincipalVariation pv_lines[MAX_PV];
 
     Step   last_best_step;
     Step   best_move[MAXEPD];
@@ -0,0 +1,306 @@
+// Chess-InkPlate chess engine
+//
+// Endgame bitbases
+//
+// (c) 2021 - GPL-3.0
+
+#define __BITBASE__ 1
+#include "chess_engine_bitbase.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <dirent.h>
+
+#if CHESS_LINUX_BUILD
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+static const char fig_letter[] = " PNBRQK";
+
+Bitbases::~Bitbases()
+{
+  for (int i = 0; i < table_count; i++) {
+    #if CHESS_LINUX_BUILD
+      munmap(tables[i].buffer, tables[i].size);
+    #else
+      free(tables[i].buffer);
+    #endif
+  }
+}
+
+void
+Bitbases::material_name(const int8_t * first,  int first_count,
+                        const int8_t * second, int second_count,
+                        char name[8], bool & flipped)
+{
+  int8_t a[BITBASE_MAX_PIECES], b[BITBASE_MAX_PIECES];
+
+  std::copy(first,  first  + first_count,  a);
+  std::copy(second, second + second_count, b);
+  std::sort(a, a + first_count,  std::greater<int8_t>());
+  std::sort(b, b + second_count, std::greater<int8_t>());
+
+  flipped = (second_count > first_count) ||
+            ((second_count == first_count) && std::lexicographical_compare(a, a + first_count, b, b + second_count));
+
+  const int8_t * strong       = flipped ? b : a;
+  const int8_t * weak         = flipped ? a : b;
+  int            strong_count = flipped ? second_count : first_count;
+  int            weak_count   = flipped ? first_count  : second_count;
+
+  int len = 0;
+  name[len++] = 'K';
+  for (int i = 0; i < strong_count; i++) name[len++] = fig_letter[strong[i]];
+  name[len++] = 'K';
+  for (int i = 0; i < weak_count;   i++) name[len++] = fig_letter[weak[i]];
+  name[len] = 0;
+}
+
+bool
+Bitbases::table_name(const Board & board, char name[8], bool & flipped)
+{
+  int8_t white[BITBASE_MAX_PIECES], black[BITBASE_MAX_PIECES];
+  int    white_count = 0, black_count = 0;
+
+  for (int board_idx = 0; board_idx < 64; board_idx++) {
+    int8_t fig = board[board_idx];
+
+    if ((fig == NO_FIG) || (fig == KING) || (fig == -KING)) continue;
+    if ((white_count + black_count) >= (BITBASE_MAX_PIECES - 2)) return false;
+
+    if (fig > 0) white[white_count++] =  fig;
+    else         black[black_count++] = -fig;
+  }
+
+  material_name(white, white_count, black, black_count, name, flipped);
+  return true;
+}
+
+uint32_t
+Bitbases::position_count(const char * name)
+{
+  uint32_t count = 2 * 32 * 64;
+  for (int i = strlen(name) - 2; i > 0; i--) count *= 64;
+  return count;
+}
+
+// The position is first brought in the table frame: flipped vertically
+// with colors swapped if black is the strong side, then mirrored
+// horizontally if the strong king is on columns e to h. Pieces of the
+// same kind are taken in ascending location order, in that frame.
+
+uint32_t
+Bitbases::position_index(const Board & board, bool white_move, const char * name, bool flipped)
+{
+  int8_t flip   = flipped ? 56 : 0;
+  int8_t strong = flipped ? -1 : 1;  // Sign of the strong side figures
+  int8_t wk     = 0, bk = 0;
+
+  for (int8_t board_idx = 0; board_idx < 64; board_idx++) {
+    if      (board[board_idx] ==  strong * KING) wk = board_idx ^ flip;
+    else if (board[board_idx] == -strong * KING) bk = board_idx ^ flip;
+  }
+
+  int8_t mirror = ((wk & 7) > 3) ? 7 : 0;
+  int8_t frame  = flip ^ mirror;
+
+  wk ^= mirror;
+  bk ^= mirror;
+
+  uint32_t index = ((white_move != flipped) ? 0 : 1);
+  index = index * 32 + (wk >> 3) * 4 + (wk & 7);
+  index = index * 64 + bk;
+
+  bool   used[64] = { false };
+  int8_t sign     = strong;
+
+  for (const char * letter = name + 1; *letter; letter++) {
+    if (*letter == 'K') {
+      sign = -strong;
+      continue;
+    }
+
+    int8_t fig = sign * (strchr(fig_letter, *letter) - fig_letter);
+    int8_t idx = 0;
+
+    while ((idx < 63) && (used[idx] || (board[idx ^ frame] != fig))) idx++;
+
+    used[idx] = true;
+    index     = index * 64 + idx;
+  }
+
+  return index;
+}
+
+uint32_t
+Bitbases::compress(const uint8_t * values, uint32_t position_count, uint32_t * offsets, uint8_t * data)
+{
+  uint32_t block_count = (position_count + BITBASE_BLOCK_SIZE - 1) / BITBASE_BLOCK_SIZE;
+  uint32_t size        = 0;
+  uint8_t  value       = (uint8_t) WDL::DRAW;
+
+  for (uint32_t block = 0; block < block_count; block++) {
+    uint32_t idx = block * BITBASE_BLOCK_SIZE;
+    uint32_t end = std::min<uint32_t>(idx + BITBASE_BLOCK_SIZE, position_count);
+
+    offsets[block] = size;
+
+    while (idx < end) {
+      if (values[idx] != INVALID_VALUE) value = values[idx];
+
+      uint32_t length = 1;
+      while ((idx + length < end) && (length < 64) &&
+             ((values[idx + length] == value) || (values[idx + length] == INVALID_VALUE))) {
+        length++;
+      }
+
+      data[size++] = (value << 6) | (length - 1);
+      idx         += length;
+    }
+  }
+
+  offsets[block_count] = size;
+
+  return size;
+}
+
+WDL
+Bitbases::decode(const Table & table, uint32_t index)
+{
+  uint32_t        remaining = index % BITBASE_BLOCK_SIZE;
+  const uint8_t * run       = table.data + table.offsets[index / BITBASE_BLOCK_SIZE    ];
+  const uint8_t * end       = table.data + table.offsets[index / BITBASE_BLOCK_SIZE + 1];
+
+  while (run < end) {
+    uint32_t length = (*run & 0x3F) + 1;
+    if (remaining < length) return (WDL)(*run >> 6);
+    remaining -= length;
+    run++;
+  }
+
+  return WDL::DRAW;
+}
+
+bool
+Bitbases::load_table(const std::string & filename)
+{
+  Table & table = tables[table_count];
+
+  #if CHESS_LINUX_BUILD
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      return false;
+    }
+
+    table.size   = st.st_size;
+    table.buffer = (table.size > 0) ? mmap(nullptr, table.size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+
+    if (table.buffer == MAP_FAILED) return false;
+  #else
+    FILE * file = fopen(filename.c_str(), "rb");
+    if (file == nullptr) return false;
+
+    fseek(file, 0, SEEK_END);
+    table.size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    table.buffer = malloc(table.size);
+    if ((table.buffer == nullptr) || (fread(table.buffer, 1, table.size, file) != table.size)) {
+      free(table.buffer);
+      fclose(file);
+      return false;
+    }
+    fclose(file);
+  #endif
+
+  const BitbaseHeader * header = (const BitbaseHeader *) table.buffer;
+  size_t                offset = sizeof(BitbaseHeader);
+
+  bool ok = (table.size >= offset)                                        &&
+            (memcmp(header->magic, "CIBB", 4) == 0)                       &&
+            (header->version == BITBASE_VERSION)                          &&
+            (header->name[7] == 0)                                        &&
+            (strlen(header->name) <= BITBASE_MAX_PIECES)                  &&
+            (header->position_count == position_count(header->name))     &&
+            ((uint32_t) header->block_count * BITBASE_BLOCK_SIZE >= header->position_count);
+
+  if (ok) {
+    memcpy(table.name, header->name, sizeof(table.name));
+    table.position_count = header->position_count;
+    table.block_count    = header->block_count;
+    table.offsets        = (const uint32_t *)((const uint8_t *) table.buffer + offset);
+
+    offset    += (table.block_count + 1) * sizeof(uint32_t);
+    table.data = (const uint8_t *) table.buffer + offset;
+
+    ok = (table.size >= offset) && (table.size - offset >= table.offsets[table.block_count]);
+  }
+
+  if (!ok) {
+    std::cerr << "Invalid bitbase file: " << filename << std::endl;
+    #if CHESS_LINUX_BUILD
+      munmap(table.buffer, table.size);
+    #else
+      free(table.buffer);
+    #endif
+    return false;
+  }
+
+  table_count++;
+  return true;
+}
+
+int
+Bitbases::load(const char * folder)
+{
+  DIR * dir = opendir(folder);
+  if (dir == nullptr) return 0;
+
+  struct dirent * entry;
+  while ((table_count < BITBASE_MAX_TABLES) && ((entry = readdir(dir)) != nullptr)) {
+    int len = strlen(entry->d_name);
+    if ((len > 5) && (strcmp(entry->d_name + len - 5, ".cibb") == 0)) {
+      load_table(std::string(folder) + "/" + entry->d_name);
+    }
+  }
+  closedir(dir);
+
+  std::cout << "Bitbases: " << table_count << " tables loaded." << std::endl;
+
+  return table_count;
+}
+
+bool
+Bitbases::probe(const Board & board, bool white_move, WDL & wdl) const
+{
+  char name[8];
+  bool flipped;
+
+  if (!table_name(board, name, flipped)) return false;
+
+  if (strcmp(name, "KK") == 0) {
+    wdl = WDL::DRAW;
+    return true;
+  }
+
+  for (int i = 0; i < table_count; i++) {
+    if (strcmp(tables[i].name, name) == 0) {
+      wdl = decode(tables[i], position_index(board, white_move, name, flipped));
+      return true;
+    }
+  }
+
+  return false;
+}
@@ -0,0 +1,132 @@
+// Chess-InkPlate chess engine
+//
+// Endgame bitbases
+//
+// (c) 2021 - GPL-3.0
+
+#pragma once
+
+#include <cinttypes>
+#include <cstddef>
+#include <string>
+
+#include "chess_engine_types.hpp"
+
+// Win/draw/loss (WDL) tables of endings with up to BITBASE_MAX_PIECES pieces,
+// kings included, as built by the bitbase_gen tool (see tools/). Castling and
+// en passant are not taken into account.
+//
+// Table names give the material of the strong side, then of the other side,
+// pieces ordered as Q, R, B, N, P (e.g. KRKP). The strong side is the one
+// with more pieces, or with the strongest pieces for the same count. A
+// position where the strong side is black is looked up with colors swapped
+// and the board flipped vertically.
+//
+// Position index in a table:
+//
+//   (((stm * 32 + wk) * 64 + bk) * 64 + p1) * 64 + p2 ...
+//
+// with stm = 0 when the strong side is to move, wk the strong side king
+// location (row * 4 + column, the board being mirrored horizontally to have
+// that king on columns a to d), bk the other king location and p1, p2 the
+// locations of the other pieces, in table name order. Locations are board
+// indexes (0 = a8, 63 = h1).
+//
+// File format (little endian), <name>.cibb:
+//
+//   char     magic[4]                    "CIBB"
+//   uint16_t version                     BITBASE_VERSION
+//   uint16_t block_count
+//   uint32_t position_count
+//   char     name[8]                     Zero padded
+//   uint32_t offsets[block_count + 1]    Block offsets in data
+//   uint8_t  data[]
+//
+// Each block holds the values of BITBASE_BLOCK_SIZE positions, run length
+// encoded: each byte is a value (bits 7-6, a WDL) and a run length minus
+// one (bits 5-0). Invalid positions (e.g. the side not to move in check)
+// are given the value of the previous position, to get longer runs.
+
+const int      BITBASE_MAX_PIECES = 4;
+const int      BITBASE_MAX_TABLES = 32;
+const int      BITBASE_BLOCK_SIZE = 4096;
+const uint16_t BITBASE_VERSION    = 1;
+const int      BITBASE_WIN_SCORE  = 8000;  // Below the mate scores
+
+// From the side to move perspective
+
+enum class WDL : uint8_t { DRAW = 0, WIN = 1, LOSS = 2 };
+
+#pragma pack(push, 1)
+struct BitbaseHeader {
+  char     magic[4];
+  uint16_t version;
+  uint16_t block_count;
+  uint32_t position_count;
+  char     name[8];
+};
+#pragma pack(pop)
+
+class Bitbases
+{
+  public:
+    Bitbases() : table_count(0) { }
+   ~Bitbases();
+
+    // Load all tables (*.cibb) found in folder. On Linux, they are memory
+    // mapped, on the ESP32 read in memory.
+
+    int  load(const char * folder);
+    inline bool is_ready() const { return table_count > 0; }
+
+    bool probe(const Board & board, bool white_move, WDL & wdl) const;
+
+    // Shared with the generator
+
+    // Table name of the material of a position. flipped is set when black
+    // is the strong side. false if there is too much material.
+
+    static bool table_name(const Board & board, char name[8], bool & flipped);
+
+    // Table name of the given material (figures without sign, kings
+    // excluded). flipped is set when the second side is the strong one.
+
+    static void material_name(const int8_t * first,  int first_count,
+                              const int8_t * second, int second_count,
+                              char name[8], bool & flipped);
+
+    static uint32_t position_count(const char * name);
+    static uint32_t position_index(const Board & board, bool white_move, const char * name, bool flipped);
+
+    // Run length encoding of a table (one WDL per position, INVALID_VALUE
+    // for positions that cannot be met). data must be able to hold
+    // position_count bytes. Returns the size of the data.
+
+    static const uint8_t INVALID_VALUE = 0xFF;
+
+    static uint32_t compress(const uint8_t * values, uint32_t position_count,
+                             uint32_t * offsets, uint8_t * data);
+
+  private:
+    struct Table {
+      char             name[8];
+      uint32_t         position_count;
+      uint16_t         block_count;
+      const uint32_t * offsets;
+      const uint8_t  * data;
+      void           * buffer;
+      size_t           size;
+    };
+
+    Table tables[BITBASE_MAX_TABLES];
+    int   table_count;
+
+    bool load_table(const std::string & filename);
+    static WDL decode(const Table & table, uint32_t index);
+};
+
+#if __BITBASE__
+  Bitbases bitbases;
+#else
+  extern Bitbases bitbases;
+#endif
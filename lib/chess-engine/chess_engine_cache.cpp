@@ -0,0 +1,234 @@
+// Chess-InkPlate chess engine
+//
+// Persistent analysis cache
+//
+// (c) 2021 - GPL-3.0
+
+#define __CACHE__ 1
+#include "chess_engine_cache.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+// FNV-1a over the board and the state of the side to move. The key has to
+// be the same from one run to the next, as it is kept on disk.
+
+uint64_t
+AnalysisCache::position_key(const Board & board, const Position & pos)
+{
+  uint64_t key = 14695981039346656037ULL;
+
+  auto add = [&key](uint8_t value) {
+    key ^= value;
+    key *= 1099511628211ULL;
+  };
+
+  for (int board_idx = 0; board_idx < 64; board_idx++) add(board[board_idx]);
+
+  add(pos.white_move);
+  add(pos.white_castle_kingside_ok);
+  add(pos.white_castle_queenside_ok);
+  add(pos.black_castle_kingside_ok);
+  add(pos.black_castle_queenside_ok);
+  add(pos.en_passant_pp);
+
+  return key;
+}
+
+bool
+AnalysisCache::open(const char * folder)
+{
+  log_filename   = std::string(folder) + "/analysis.log";
+  index_filename = std::string(folder) + "/analysis.idx";
+  log_count      = 0;
+  ready          = false;
+
+  // A log bigger than expected (e.g. left by a build with a larger
+  // CACHE_LOG_ENTRIES) is merged as it is read, then rewritten with what
+  // remains in memory.
+
+  bool   merged = false;
+  FILE * file   = fopen(log_filename.c_str(), "rb");
+
+  if (file != nullptr) {
+    CacheEntry entry;
+    while (fread(&entry, sizeof(CacheEntry), 1, file) == 1) {
+      if (log_count >= CACHE_LOG_ENTRIES) {
+        if (!merge_log()) {
+          fclose(file);
+          return false;
+        }
+        merged = true;
+      }
+      log[log_count++] = entry;
+    }
+    fclose(file);
+  }
+
+  if (merged) {
+    file = fopen(log_filename.c_str(), "wb");
+    if (file != nullptr) {
+      fwrite(log, sizeof(CacheEntry), log_count, file);
+      fclose(file);
+    }
+  }
+
+  ready = true;
+
+  std::cout << "Analysis cache: " << log_count << " log entries." << std::endl;
+
+  return true;
+}
+
+bool
+AnalysisCache::search_index(uint64_t key, CacheEntry & entry)
+{
+  FILE * file = fopen(index_filename.c_str(), "rb");
+  if (file == nullptr) return false;
+
+  fseek(file, 0, SEEK_END);
+  long low   = 0;
+  long high  = ftell(file) / sizeof(CacheEntry) - 1;
+  bool found = false;
+
+  while (low <= high) {
+    long mid = (low + high) / 2;
+    fseek(file, mid * sizeof(CacheEntry), SEEK_SET);
+    if (fread(&entry, sizeof(CacheEntry), 1, file) != 1) break;
+
+    if      (entry.key < key) low  = mid + 1;
+    else if (entry.key > key) high = mid - 1;
+    else {
+      found = true;
+      break;
+    }
+  }
+
+  fclose(file);
+  return found;
+}
+
+bool
+AnalysisCache::lookup(uint64_t key, uint16_t budget, CacheEntry & entry)
+{
+  if (!ready) return false;
+
+  bool found = false;
+
+  for (int i = 0; i < log_count; i++) {
+    if ((log[i].key == key) && (!found || better(log[i], entry))) {
+      entry = log[i];
+      found = true;
+    }
+  }
+
+  CacheEntry indexed;
+  if (search_index(key, indexed) && (!found || better(indexed, entry))) {
+    entry = indexed;
+    found = true;
+  }
+
+  return found && (entry.budget >= budget);
+}
+
+void
+AnalysisCache::store(const CacheEntry & entry)
+{
+  if (!ready) return;
+
+  CacheEntry existing;
+  if (lookup(entry.key, 0, existing) && !better(entry, existing)) return;
+
+  if (log_count >= CACHE_LOG_ENTRIES) {
+    if (!merge_log()) {
+      ready = false;
+      return;
+    }
+
+    FILE * file = fopen(log_filename.c_str(), "wb");
+    if (file != nullptr) fclose(file);
+  }
+
+  FILE * file = fopen(log_filename.c_str(), "ab");
+  if (file == nullptr) {
+    std::cerr << "Unable to open analysis cache log: " << log_filename << std::endl;
+    return;
+  }
+  fwrite(&entry, sizeof(CacheEntry), 1, file);
+  fclose(file);
+
+  log[log_count++] = entry;
+}
+
+// Merge the in-memory log into the index. The sorted log and the index are
+// read in step and written to a new index file, keeping the best entry for
+// each key. The log file itself is left untouched.
+
+bool
+AnalysisCache::merge_log()
+{
+  std::string tmp_filename = index_filename + ".tmp";
+
+  std::stable_sort(log, log + log_count, [](const CacheEntry & a, const CacheEntry & b) {
+    return a.key < b.key;
+  });
+
+  FILE * in  = fopen(index_filename.c_str(), "rb");
+  FILE * out = fopen(tmp_filename.c_str(),   "wb");
+
+  if (out == nullptr) {
+    std::cerr << "Unable to create analysis cache index: " << tmp_filename << std::endl;
+    if (in != nullptr) fclose(in);
+    return false;
+  }
+
+  CacheEntry indexed;
+  bool       has_indexed = (in != nullptr) && (fread(&indexed, sizeof(CacheEntry), 1, in) == 1);
+  int        log_idx     = 0;
+  bool       ok          = true;
+
+  while (ok && (has_indexed || (log_idx < log_count))) {
+    CacheEntry best;
+
+    if (!has_indexed || ((log_idx < log_count) && (log[log_idx].key < indexed.key))) {
+      best = log[log_idx++];
+    }
+    else {
+      best        = indexed;
+      has_indexed = fread(&indexed, sizeof(CacheEntry), 1, in) == 1;
+    }
+
+    // Entries of the same key in the log and in the index
+
+    while ((log_idx < log_count) && (log[log_idx].key == best.key)) {
+      if (better(log[log_idx], best)) best = log[log_idx];
+      log_idx++;
+    }
+    if (has_indexed && (indexed.key == best.key)) {
+      if (better(indexed, best)) best = indexed;
+      has_indexed = fread(&indexed, sizeof(CacheEntry), 1, in) == 1;
+    }
+
+    ok = fwrite(&best, sizeof(CacheEntry), 1, out) == 1;
+  }
+
+  if (in != nullptr) fclose(in);
+  fclose(out);
+
+  if (!ok) {
+    std::cerr << "Unable to write analysis cache index: " << tmp_filename << std::endl;
+    remove(tmp_filename.c_str());
+    return false;
+  }
+
+  remove(index_filename.c_str());
+  if (rename(tmp_filename.c_str(), index_filename.c_str()) != 0) {
+    std::cerr << "Unable to rename analysis cache index: " << tmp_filename << std::endl;
+    return false;
+  }
+
+  log_count = 0;
+
+  return true;
+}
@@ -0,0 +1,79 @@
+// Chess-InkPlate chess engine
+//
+// Persistent analysis cache
+//
+// (c) 2021 - GPL-3.0
+
+#pragma once
+
+#include <cinttypes>
+#include <cstdio>
+#include <string>
+
+#include "chess_engine_types.hpp"
+
+// Results of previous searches (score, depth and best step), keyed by a
+// 64 bits hash of the position, kept on the SD card (or disk). It is looked
+// up before a search and updated after it.
+//
+// New results are appended to a log file, also kept in memory. Once the log
+// holds CACHE_LOG_ENTRIES entries, it is merged into the index file, where
+// entries are sorted by key and searched with a binary search. Both files are
+// made of CacheEntry records.
+//
+// A cached result is used when it was obtained with a search time budget at
+// least as large as the current one. A result replaces an existing one for
+// the same position only if it comes from a larger budget, or from the same
+// budget with a deeper search.
+
+const int CACHE_LOG_ENTRIES = 128;
+
+#pragma pack(push, 1)
+struct CacheEntry {
+  uint64_t key;
+  int16_t  score;     // From the side to move perspective
+  uint16_t budget;    // Search time limit, in 100 ms units
+  int8_t   depth;     // Depth of the last completed iteration
+  int8_t    c1, c2;   // Best step
+  MoveType  type;
+  CheckType check;
+};
+#pragma pack(pop)
+
+class AnalysisCache
+{
+  public:
+    AnalysisCache() :
+      log_count(0),
+          ready(false) { }
+
+    bool   open(const char * folder);
+    inline bool is_ready() const { return ready; }
+
+    static uint64_t position_key(const Board & board, const Position & pos);
+
+    bool lookup(uint64_t key, uint16_t budget, CacheEntry & entry);
+    void  store(const CacheEntry & entry);
+
+  private:
+    std::string log_filename;
+    std::string index_filename;
+
+    CacheEntry  log[CACHE_LOG_ENTRIES];
+    int         log_count;
+
+    bool ready;
+
+    static inline bool better(const CacheEntry & a, const CacheEntry & b) {
+      return (a.budget > b.budget) || ((a.budget == b.budget) && (a.depth > b.depth));
+    }
+
+    bool search_index(uint64_t key, CacheEntry & entry);
+    bool    merge_log();
+};
+
+#if __CACHE__
+  AnalysisCache analysis_cache;
+#else
+  extern AnalysisCache analysis_cache;
+#endif
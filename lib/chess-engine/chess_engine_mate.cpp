@@ -0,0 +1,271 @@
+// Chess-InkPlate chess engine
+//
+// Mate solver (proof-number search)
+//
+// (c) 2021 - GPL-3.0
+
+#define __MATE__ 1
+#include "chess_engine_mate.hpp"
+#include "chess_engine.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+static const uint32_t INFINITE = 100000000;
+
+static inline uint32_t
+saturated_add(uint32_t a, uint32_t b)
+{
+  return std::min(a + b, INFINITE);
+}
+
+// The attacker is to move on even plies (OR nodes), the defender on odd
+// plies (AND nodes).
+
+static inline bool
+is_attacker(int ply)
+{
+  return (ply & 1) == 0;
+}
+
+static inline bool
+king_in_check(Position * pos, int ply, bool own)
+{
+  return (pos[ply].white_move == own) ? chess_engine.check_on_white_king()
+                                      : chess_engine.check_on_black_king();
+}
+
+// The step of the current path at a ply is kept in the extra entry of the
+// steps list, such that the list can be regenerated when expanding a node.
+
+void
+MateSolver::make(int ply, const Step & step)
+{
+  Position * pos = chess_engine.get_pos(0);
+
+  pos[ply].steps[MAXSTEPS] = step;
+  pos[ply].cur_step        = MAXSTEPS;
+
+  chess_engine.move_step(ply, pos[ply].steps[MAXSTEPS]);
+  chess_engine.move_pos (ply, pos[ply].steps[MAXSTEPS]);
+}
+
+void
+MateSolver::unmake(int ply)
+{
+  Position * pos = chess_engine.get_pos(0);
+
+  chess_engine.back_step(ply, pos[ply].steps[MAXSTEPS]);
+}
+
+// Number of legal steps, or checking steps only, of the side to move at ply.
+
+int
+MateSolver::count_replies(int ply, bool checks_only)
+{
+  Position * pos   = chess_engine.get_pos(0);
+  int        count = 0;
+
+  chess_engine.generate_steps(ply);
+
+  for (int i = 0; i < pos[ply].steps_count; i++) {
+    chess_engine.move_step(ply, pos[ply].steps[i]);
+    if (!king_in_check(pos, ply, true) && (!checks_only || king_in_check(pos, ply, false))) count++;
+    chess_engine.back_step(ply, pos[ply].steps[i]);
+  }
+
+  return count;
+}
+
+// Create the children of a leaf node. The proof and disproof numbers of
+// each child are initialized from the number of replies of its side to move:
+// a mated defender is proven, an attacker without checks (or out of moves)
+// is disproven. Returns false if the pool is exhausted.
+
+bool
+MateSolver::expand(int node_idx, int ply)
+{
+  Position * pos      = chess_engine.get_pos(0);
+  int        first    = node_count;
+  bool       attacker = is_attacker(ply);
+
+  chess_engine.generate_steps(ply);
+
+  for (int i = 0; i < pos[ply].steps_count; i++) {
+    Step & step = pos[ply].steps[i];
+
+    chess_engine.move_step(ply, step);
+
+    bool check = !king_in_check(pos, ply, true) && king_in_check(pos, ply, false);
+
+    if (king_in_check(pos, ply, true) || (attacker && !check)) {
+      chess_engine.back_step(ply, step);
+      continue;
+    }
+
+    if (node_count >= MATE_NODES) {
+      chess_engine.back_step(ply, step);
+      node_count = first;
+      return false;
+    }
+
+    step.check        = check ? CheckType::CHECK : CheckType::NONE;
+    pos[ply].cur_step = i;
+    chess_engine.move_pos(ply, step);
+
+    Node & child = nodes[node_count++];
+
+    child.parent      = node_idx;
+    child.first_child = -1;
+    child.child_count = 0;
+    child.step        = step;
+
+    if (attacker) {
+      int replies = count_replies(ply + 1, false);
+      if (replies == 0) {
+        child.step.check = CheckType::CHECKMATE;
+        child.proof      = 0;
+        child.disproof   = INFINITE;
+      }
+      else {
+        child.proof      = replies;
+        child.disproof   = 1;
+      }
+    }
+    else {
+      int checks = (ply + 1 < max_plies) ? count_replies(ply + 1, true) : 0;
+      if (checks == 0) {
+        child.proof      = INFINITE;
+        child.disproof   = 0;
+      }
+      else {
+        child.proof      = 1;
+        child.disproof   = checks;
+      }
+    }
+
+    chess_engine.back_step(ply, step);
+  }
+
+  nodes[node_idx].first_child = first;
+  nodes[node_idx].child_count = node_count - first;
+
+  return true;
+}
+
+void
+MateSolver::set_values(int node_idx, int ply)
+{
+  Node   & node  = nodes[node_idx];
+  uint32_t proof = is_attacker(ply) ? INFINITE : 0;
+  uint32_t disproof = is_attacker(ply) ? 0 : INFINITE;
+
+  for (int i = node.first_child; i < node.first_child + node.child_count; i++) {
+    if (is_attacker(ply)) {
+      proof    = std::min(proof, nodes[i].proof);
+      disproof = saturated_add(disproof, nodes[i].disproof);
+    }
+    else {
+      proof    = saturated_add(proof, nodes[i].proof);
+      disproof = std::min(disproof, nodes[i].disproof);
+    }
+  }
+
+  node.proof    = proof;
+  node.disproof = disproof;
+}
+
+// Most proving child: the easiest to prove for the attacker, the easiest
+// to disprove for the defender.
+
+int
+MateSolver::select(int node_idx, int ply)
+{
+  Node & node = nodes[node_idx];
+  int    best = node.first_child;
+
+  for (int i = node.first_child + 1; i < node.first_child + node.child_count; i++) {
+    if (is_attacker(ply) ? (nodes[i].proof    < nodes[best].proof   )
+                         : (nodes[i].disproof < nodes[best].disproof)) best = i;
+  }
+
+  return best;
+}
+
+MateResult
+MateSolver::solve(int moves, Step & step)
+{
+  Position * pos = chess_engine.get_pos(0);
+
+  max_plies = std::min(2 * moves - 1, MAXDEPTH - 3);
+  if (max_plies < 1) return MateResult::NO_MATE;
+
+  for (int i = 1; i < MAXDEPTH; i++) {
+    pos[i].white_move = (i % 2) ? !pos[0].white_move : pos[0].white_move;
+  }
+
+  nodes = (Node *) malloc(MATE_NODES * sizeof(Node));
+  if (nodes == nullptr) {
+    std::cerr << "Unable to allocate the mate solver tree." << std::endl;
+    return MateResult::UNKNOWN;
+  }
+
+  node_count = 1;
+  nodes[0].parent      = -1;
+  nodes[0].first_child = -1;
+  nodes[0].child_count = 0;
+  nodes[0].proof       = 1;
+  nodes[0].disproof    = 1;
+
+  while ((nodes[0].proof != 0) && (nodes[0].disproof != 0)) {
+
+    // Walk down to the most proving node
+
+    int node_idx = 0;
+    int ply      = 0;
+
+    while (nodes[node_idx].first_child >= 0) {
+      node_idx = select(node_idx, ply);
+      make(ply++, nodes[node_idx].step);
+    }
+
+    // When the pool is full, the leaf is left as it is: without children,
+    // set_values() would take it as proven or disproven. The search stops
+    // and the result is unknown.
+
+    if (!expand(node_idx, ply)) {
+      while (ply > 0) unmake(--ply);
+      break;
+    }
+
+    // Back up the proof and disproof numbers up to the root
+
+    for (;;) {
+      set_values(node_idx, ply);
+      if (node_idx == 0) break;
+      unmake(--ply);
+      node_idx = nodes[node_idx].parent;
+    }
+  }
+
+  MateResult result = MateResult::UNKNOWN;
+
+  if (nodes[0].proof == 0) {
+    for (int i = nodes[0].first_child; i < nodes[0].first_child + nodes[0].child_count; i++) {
+      if (nodes[i].proof == 0) {
+        step   = nodes[i].step;
+        result = MateResult::FOUND;
+        break;
+      }
+    }
+  }
+  else if (nodes[0].disproof == 0) {
+    result = MateResult::NO_MATE;
+  }
+
+  free(nodes);
+  nodes = nullptr;
+
+  return result;
+}
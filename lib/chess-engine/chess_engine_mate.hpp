@@ -0,0 +1,65 @@
+// Chess-InkPlate chess engine
+//
+// Mate solver (proof-number search)
+//
+// (c) 2021 - GPL-3.0
+
+#pragma once
+
+#include <cinttypes>
+
+#include "chess_engine_types.hpp"
+
+// Looks for a forced mate of the side to move in the current position
+// (position 0 of the engine), using a best-first proof-number search. The
+// attacker is only trying checking steps, the defender all its legal steps
+// (evasions). Unlike the general search, there is no positional evaluation:
+// a node is proven when the defender is mated and disproven when the
+// attacker has no more check to give or is out of moves.
+//
+// The search tree is kept in a pool of MATE_NODES nodes, allocated for the
+// duration of a call. MateResult::UNKNOWN is returned when the pool is
+// exhausted before the root position is proven or disproven.
+
+class MateSolver
+{
+  public:
+    MateSolver() :
+            nodes(nullptr),
+       node_count(0),
+        max_plies(0) { }
+
+    // Search for a mate in at most <moves> moves. On success, step receives
+    // the first step of the mate. The steps list of position 0 is regenerated.
+
+    MateResult solve(int moves, Step & step);
+
+    inline int get_node_count() const { return node_count; }
+
+  private:
+    struct Node {
+      uint32_t proof;        // Proof number
+      uint32_t disproof;     // Disproof number
+      int32_t  parent;
+      int32_t  first_child;  // Children are contiguous in the pool. -1 if not expanded
+      uint8_t  child_count;
+      Step     step;         // Step leading to this node
+    };
+
+    Node * nodes;
+    int    node_count;
+    int    max_plies;
+
+    bool          expand(int node_idx, int ply);
+    void      set_values(int node_idx, int ply);
+    int           select(int node_idx, int ply);
+    int    count_replies(int ply, bool checks_only);
+    void            make(int ply, const Step & step);
+    void          unmake(int ply);
+};
+
+#if __MATE__
+  MateSolver mate_solver;
+#else
+  extern MateSolver mate_solver;
+#endif
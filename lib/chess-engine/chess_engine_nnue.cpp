@@ -0,0 +1,268 @@
+// Chess-InkPlate chess engine
+//
+// Small quantized neural network evaluator (NNUE-like)
+//
+// (c) 2021 - GPL-3.0
+
+#define __NNUE__ 1
+#include "chess_engine_nnue.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#if defined(__AVX2__)
+  #include <immintrin.h>
+#elif defined(__SSE2__)
+  #include <emmintrin.h>
+#endif
+
+// ===== Vector kernels ===================================================
+//
+// AVX2 and SSE2 versions are used on Linux when available. The scalar
+// version is used on the ESP32.
+
+static inline void
+vec_add(int16_t * acc, const int16_t * weights)
+{
+  #if defined(__AVX2__)
+    for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+      __m256i a = _mm256_load_si256 ((const __m256i *) &acc[i]);
+      __m256i w = _mm256_loadu_si256((const __m256i *) &weights[i]);
+      _mm256_store_si256((__m256i *) &acc[i], _mm256_add_epi16(a, w));
+    }
+  #elif defined(__SSE2__)
+    for (int i = 0; i < NNUE_HIDDEN; i += 8) {
+      __m128i a = _mm_load_si128 ((const __m128i *) &acc[i]);
+      __m128i w = _mm_loadu_si128((const __m128i *) &weights[i]);
+      _mm_store_si128((__m128i *) &acc[i], _mm_add_epi16(a, w));
+    }
+  #else
+    for (int i = 0; i < NNUE_HIDDEN; i++) acc[i] += weights[i];
+  #endif
+}
+
+static inline void
+vec_sub(int16_t * acc, const int16_t * weights)
+{
+  #if defined(__AVX2__)
+    for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+      __m256i a = _mm256_load_si256 ((const __m256i *) &acc[i]);
+      __m256i w = _mm256_loadu_si256((const __m256i *) &weights[i]);
+      _mm256_store_si256((__m256i *) &acc[i], _mm256_sub_epi16(a, w));
+    }
+  #elif defined(__SSE2__)
+    for (int i = 0; i < NNUE_HIDDEN; i += 8) {
+      __m128i a = _mm_load_si128 ((const __m128i *) &acc[i]);
+      __m128i w = _mm_loadu_si128((const __m128i *) &weights[i]);
+      _mm_store_si128((__m128i *) &acc[i], _mm_sub_epi16(a, w));
+    }
+  #else
+    for (int i = 0; i < NNUE_HIDDEN; i++) acc[i] -= weights[i];
+  #endif
+}
+
+// Sum of clip(acc[i]) * weights[i]
+
+static inline int32_t
+vec_clipped_dot(const int16_t * acc, const int16_t * weights)
+{
+  #if defined(__AVX2__)
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i clip = _mm256_set1_epi16(NNUE_CLIP);
+    __m256i       sum  = _mm256_setzero_si256();
+    for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+      __m256i a = _mm256_load_si256 ((const __m256i *) &acc[i]);
+      __m256i w = _mm256_loadu_si256((const __m256i *) &weights[i]);
+      a   = _mm256_min_epi16(_mm256_max_epi16(a, zero), clip);
+      sum = _mm256_add_epi32(sum, _mm256_madd_epi16(a, w));
+    }
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(s);
+  #elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i clip = _mm_set1_epi16(NNUE_CLIP);
+    __m128i       sum  = _mm_setzero_si128();
+    for (int i = 0; i < NNUE_HIDDEN; i += 8) {
+      __m128i a = _mm_load_si128 ((const __m128i *) &acc[i]);
+      __m128i w = _mm_loadu_si128((const __m128i *) &weights[i]);
+      a   = _mm_min_epi16(_mm_max_epi16(a, zero), clip);
+      sum = _mm_add_epi32(sum, _mm_madd_epi16(a, w));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+  #else
+    int32_t sum = 0;
+    for (int i = 0; i < NNUE_HIDDEN; i++) {
+      int16_t a = acc[i];
+      if      (a < 0        ) a = 0;
+      else if (a > NNUE_CLIP) a = NNUE_CLIP;
+      sum += a * weights[i];
+    }
+    return sum;
+  #endif
+}
+
+// ===== NNUE =============================================================
+
+thread_local NNUE::Accumulator * NNUE::accumulator = &nnue.accumulators[0];
+
+static inline int
+feature_index(int8_t fig, int8_t board_idx, bool white_perspective)
+{
+  if (white_perspective) {
+    return (((fig > 0) ? 0 : 6) + abs(fig) - 1) * 64 + board_idx;
+  }
+  else {
+    return (((fig < 0) ? 0 : 6) + abs(fig) - 1) * 64 + (board_idx ^ 56);
+  }
+}
+
+bool
+NNUE::load(const char * filename)
+{
+  ready = false;
+
+  FILE * file = fopen(filename, "rb");
+  if (file == nullptr) {
+    std::cout << "No neural network file: " << filename << std::endl;
+    return false;
+  }
+
+  char     magic[4];
+  uint16_t version, inputs, hidden;
+  int8_t   weights[2 * NNUE_HIDDEN];
+
+  if (feature_weights == nullptr) {
+    feature_weights = (int16_t *) malloc(NNUE_INPUTS * NNUE_HIDDEN * sizeof(int16_t));
+  }
+
+  for (;;) {
+    if (feature_weights == nullptr) break;
+
+    if ((fread(magic,    sizeof(magic),   1, file) != 1) || (memcmp(magic, "CINN", 4) != 0)) break;
+    if ((fread(&version, sizeof(version), 1, file) != 1) || (version != NNUE_VERSION      )) break;
+    if ((fread(&inputs,  sizeof(inputs),  1, file) != 1) || (inputs  != NNUE_INPUTS       )) break;
+    if ((fread(&hidden,  sizeof(hidden),  1, file) != 1) || (hidden  != NNUE_HIDDEN       )) break;
+
+    if (fread(feature_weights, sizeof(int16_t), NNUE_INPUTS * NNUE_HIDDEN, file) !=
+        (std::size_t) (NNUE_INPUTS * NNUE_HIDDEN)) break;
+    if (fread(feature_biases,  sizeof(int16_t), NNUE_HIDDEN,     file) != NNUE_HIDDEN    ) break;
+    if (fread(weights,         sizeof(int8_t),  2 * NNUE_HIDDEN, file) != 2 * NNUE_HIDDEN) break;
+    if (fread(&output_bias,    sizeof(int32_t), 1,               file) != 1              ) break;
+
+    for (int i = 0; i < 2 * NNUE_HIDDEN; i++) output_weights[i] = weights[i];
+
+    ready = true;
+    break;
+  }
+
+  fclose(file);
+
+  if (!ready) {
+    std::cerr << "Unable to load neural network file: " << filename << std::endl;
+    free(feature_weights);
+    feature_weights = nullptr;
+  }
+  else {
+    std::cout << "Neural network loaded: " << filename << std::endl;
+  }
+
+  return ready;
+}
+
+void
+NNUE::add_feature(int8_t fig, int8_t board_idx)
+{
+  vec_add((*accumulator)[0], &feature_weights[feature_index(fig, board_idx, true ) * NNUE_HIDDEN]);
+  vec_add((*accumulator)[1], &feature_weights[feature_index(fig, board_idx, false) * NNUE_HIDDEN]);
+}
+
+void
+NNUE::remove_feature(int8_t fig, int8_t board_idx)
+{
+  vec_sub((*accumulator)[0], &feature_weights[feature_index(fig, board_idx, true ) * NNUE_HIDDEN]);
+  vec_sub((*accumulator)[1], &feature_weights[feature_index(fig, board_idx, false) * NNUE_HIDDEN]);
+}
+
+void
+NNUE::refresh(const Board & board)
+{
+  memcpy((*accumulator)[0], feature_biases, sizeof(feature_biases));
+  memcpy((*accumulator)[1], feature_biases, sizeof(feature_biases));
+
+  for (int8_t board_idx = 0; board_idx < 64; board_idx++) {
+    if (board[board_idx] != NO_FIG) add_feature(board[board_idx], board_idx);
+  }
+}
+
+// Features changed by a step. When forward is false, the step is taken back.
+
+void
+NNUE::update(const Step & step, bool forward)
+{
+  int8_t placed = step.f1;
+  int8_t rook   = (step.f1 > 0) ? ROOK : -ROOK;
+
+  if (step.type > MoveType::CASTLE_QUEENSIDE) {
+    placed = (step.f1 > 0) ? (int)(step.type) - 2 : 2 - (int)(step.type);
+  }
+
+  struct { int8_t fig, board_idx; } removed[2], added[2];
+  int removed_count = 0, added_count = 0;
+
+  removed[removed_count++] = { step.f1, step.c1 };
+  added[added_count++]     = { placed,  step.c2 };
+
+  if (step.f2 != NO_FIG) {
+    int8_t capture_idx = step.c2;
+    if (step.type == MoveType::EN_PASSANT) capture_idx += (step.f1 > 0) ? 8 : -8;
+    removed[removed_count++] = { step.f2, capture_idx };
+  }
+  else if (step.type == MoveType::CASTLE_KINGSIDE) {
+    removed[removed_count++] = { rook, (int8_t)(step.c2 + 1) };
+    added[added_count++]     = { rook, (int8_t)(step.c2 - 1) };
+  }
+  else if (step.type == MoveType::CASTLE_QUEENSIDE) {
+    removed[removed_count++] = { rook, (int8_t)(step.c2 - 2) };
+    added[added_count++]     = { rook, (int8_t)(step.c2 + 1) };
+  }
+
+  if (forward) {
+    for (int i = 0; i < removed_count; i++) remove_feature(removed[i].fig, removed[i].board_idx);
+    for (int i = 0; i <   added_count; i++)    add_feature(  added[i].fig,   added[i].board_idx);
+  }
+  else {
+    for (int i = 0; i <   added_count; i++) remove_feature(  added[i].fig,   added[i].board_idx);
+    for (int i = 0; i < removed_count; i++)    add_feature(removed[i].fig, removed[i].board_idx);
+  }
+}
+
+void
+NNUE::move(const Step & step)
+{
+  update(step, true);
+}
+
+void
+NNUE::unmove(const Step & step)
+{
+  update(step, false);
+}
+
+int
+NNUE::evaluate(bool white_move)
+{
+  int us   = white_move ? 0 : 1;
+  int them = 1 - us;
+
+  int32_t sum = vec_clipped_dot((*accumulator)[us  ], &output_weights[0          ]) +
+                vec_clipped_dot((*accumulator)[them], &output_weights[NNUE_HIDDEN]) +
+                output_bias;
+
+  return sum >> NNUE_OUTPUT_SHIFT;
+}
@@ -0,0 +1,89 @@
+// Chess-InkPlate chess engine
+//
+// Small quantized neural network evaluator (NNUE-like)
+//
+// (c) 2021 - GPL-3.0
+
+#pragma once
+
+#include <cinttypes>
+
+#include "chess_engine_types.hpp"
+
+// The network has a single hidden layer fed by 768 binary features
+// (2 colors x 6 figures x 64 locations), seen from each side perspective.
+// The hidden layer values (the accumulators) are kept up to date
+// incrementally as figures are moved on the board. The output is computed
+// from the clipped accumulators of the side to move and the other side.
+//
+// Network file format (little endian):
+//
+//   char     magic[4]          "CINN"
+//   uint16_t version           NNUE_VERSION
+//   uint16_t inputs            NNUE_INPUTS
+//   uint16_t hidden            NNUE_HIDDEN
+//   int16_t  feature_weights[NNUE_INPUTS][NNUE_HIDDEN]
+//   int16_t  feature_biases[NNUE_HIDDEN]
+//   int8_t   output_weights[2 * NNUE_HIDDEN]   Side to move first
+//   int32_t  output_bias
+//
+// Feature index, from the white perspective, of a figure located at board_idx
+// (0 = a8, 63 = h1):  ((own ? 0 : 6) + abs(fig) - 1) * 64 + board_idx
+// From the black perspective, colors are swapped and board_idx is mirrored
+// vertically (board_idx ^ 56).
+//
+// Score in centipawns = (sum(clip(acc) * output_weights) + output_bias) >> NNUE_OUTPUT_SHIFT
+// with clip(x) = min(max(x, 0), NNUE_CLIP).
+
+const int NNUE_VERSION      =   1;
+const int NNUE_INPUTS       = 768;
+const int NNUE_HIDDEN       = 128;
+const int NNUE_CLIP         = 127;
+const int NNUE_OUTPUT_SHIFT =   6;
+
+class NNUE
+{
+  public:
+    NNUE() :
+      feature_weights(nullptr),
+             ready(false) { }
+
+    bool     load(const char * filename);
+    inline bool is_ready() const { return ready; }
+
+    void  refresh(const Board & board);
+    void     move(const Step & step);
+    void   unmove(const Step & step);
+    int  evaluate(bool white_move);
+
+    // Each search thread has its own accumulators. Called once at the start 
+    // of a thread, the main thread is using the first ones.
+
+    inline void use_accumulator(int thread_idx) { accumulator = &accumulators[thread_idx]; }
+
+  private:
+    typedef int16_t Accumulator[2][NNUE_HIDDEN];
+
+    int16_t * feature_weights;                    // [NNUE_INPUTS][NNUE_HIDDEN]
+    int16_t   feature_biases[NNUE_HIDDEN];
+    int16_t   output_weights[2 * NNUE_HIDDEN];    // Widened from int8 at load time
+    int32_t   output_bias;
+
+    // [0] = white perspective, [1] = black perspective
+
+    alignas(32) Accumulator accumulators[MAX_SEARCH_THREADS];
+
+    static thread_local Accumulator * accumulator;
+
+    bool ready;
+
+    void    add_feature(int8_t fig, int8_t board_idx);
+    void remove_feature(int8_t fig, int8_t board_idx);
+    void  update(const Step & step, bool forward);
+};
+
+#if __NNUE__
+  NNUE nnue;
+#else
+  extern NNUE nnue;
+#endif
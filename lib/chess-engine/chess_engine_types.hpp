@@ -14,6 +14,24 @@
 const int MAXSTEPS = 150;
 const int MAXDEPTH =  30;
 const int MAXEPD   =   5;
+const int MAX_PV   =   5; // Multi-PV analysis lines
+
+#if CHESS_LINUX_BUILD
+  const int PAWN_HASH_SIZE     =   4096; // Must be a power of 2
+  const int MAX_SEARCH_THREADS =      4;
+  const int MATE_NODES         = 262144; // Mate solver tree size
+#else
+  const int PAWN_HASH_SIZE     =    512; // Must be a power of 2
+  const int MAX_SEARCH_THREADS =      2; // One per ESP32 core
+  const int MATE_NODES         =  32768; // Mate solver tree size
+#endif
+
+const int MAX_SPLIT_POINTS =  4; // Per search thread
+const int SPLIT_MIN_DEPTH  =  4; // Minimum depth left for a node to be searched in parallel
+
+const int NULL_MOVE_R3_DEPTH =  6; // Null move reduction is 3 above this depth, 2 otherwise
+const int NULL_VERIFY_DEPTH  =  7; // Null move fail highs are verified from this depth...
+const int NULL_VERIFY_PIECES =  2; // ... or when the side to move has no more pieces than this (game phase units)
 
 // Figures
 
@@ -29,6 +47,7 @@ enum class CheckType : int8_t { NONE, CHECK, CHECKMATE };
 enum class MoveType  : int8_t { UNKNOWN = -1, SIMPLE, EN_PASSANT, CASTLE_KINGSIDE, CASTLE_QUEENSIDE, 
                                 PROMOTE_TO_KNIGHT, PROMOTE_TO_BISHOP, PROMOTE_TO_ROOK, PROMOTE_TO_QUEEN };
 enum class EndOfGameType : int8_t { NONE, CHECKMATE, PAT, DRAW };
+enum class MateResult    : int8_t { FOUND, NO_MATE, UNKNOWN };
 
 const int fig_weight[] = { 0, 100, 320, 330, 500, 900, 0 };
 const char  fig_symb[] = "  NBRQK";
@@ -38,7 +57,7 @@ typedef int8_t Board[64];
 
 #pragma pack(push, 1)
 struct Step {
-  short       weight;   // Step value
+  short      weight;   // Step value
   int8_t      f1, f2;   // Figure located at c1 (f1) and c2 (f2)
   int8_t      c1, c2;   // Board location for the move, from c1 to c2
   CheckType   check;    // Indicates what king of check occurs with this step
@@ -60,7 +79,39 @@ struct Position {
   int     cur_step;
   Step    best;
   bool    check_on_table;
-  short   weight_white;
-  short   weight_black;
-  short   weight_both;
+  short   weight_white;          // Material, white side
+  short   weight_black;          // Material, black side
+  short   score_mg;              // Middle game positional score (white - black)
+  short   score_eg;              // End game positional score (white - black)
+  int8_t  phase;                 // Game phase, PHASE_MAX (opening) down to 0 (pawn ending)
+  uint32_t pawn_key;             // Zobrist key of the pawns location only
+};
+
+// A line of the multi-PV analysis: a root step (steps[0]) followed by the
+// expected replies, with its score from the side to move perspective.
+
+struct PrincipalVariation {
+  short    score;
+  int8_t   depth;              // Search iteration the line comes from
+  int8_t   length;
+  Step     steps[MAXDEPTH];
+};
+
+// Root search state at the end of the last completed iteration, such that a
+// search cut in chunks can be resumed later, possibly after a deep sleep.
+
+struct SearchCheckpoint {
+  uint64_t key;                // Root position key, 0 if there is no checkpoint
+  uint32_t time_limit;         // Time limit of the search, in ms
+  uint32_t elapsed;            // Search time spent so far, in ms
+  int8_t   level;              // Next iteration to search
+  int8_t   chunks;             // Chunks already spent on the next iteration
+  int8_t   samebest;
+  int16_t  alpha, beta;        // Aspiration window of the next iteration
+  bool     stats;
+  int8_t   last_best_depth;
+  Step     last_best_step;
+  Step     best;
+  int16_t  steps_count;
+  Step     steps[MAXSTEPS];    // Root steps ordering and scores
 };
@@ -156,3 +156,51 @@ EXTERN const int8_t stat_weight_black[7][64]
   }
 #endif
 ;
+
+// Game phase contribution of each figure (no_fig, pawn, knight, bishop, rook, queen, king).
+// The phase counter goes from PHASE_MAX (all pieces on board) down to 0 (pawns and kings only).
+
+const int PHASE_MAX = 24;
+
+EXTERN const int8_t fig_phase[7]
+#if _WEIGHTS_
+  = { 0, 0, 1, 1, 2, 4, 0 }
+#endif
+;
+
+// Middle game share of the tapered evaluation, in 1/256th, indexed by the phase
+// counter. Used to interpolate between middle game and end game scores
+// without a division: (mg * taper[phase] + eg * (256 - taper[phase])) >> 8
+
+EXTERN const int16_t taper_weight[PHASE_MAX + 1]
+#if _WEIGHTS_
+  = {
+      0,  11,  21,  32,  43,  53,  64,  75,  85,  96, 107, 117, 128, 
+    139, 149, 160, 171, 181, 192, 203, 213, 224, 235, 245, 256 
+  }
+#endif
+;
+
+// Pawn structure weights, middle game (MG) and end game (EG)
+
+const int    DOUBLED_PAWN_MG = -10, DOUBLED_PAWN_EG = -20;
+const int   ISOLATED_PAWN_MG = -10, ISOLATED_PAWN_EG = -15;
+const int   BACKWARD_PAWN_MG =  -8, BACKWARD_PAWN_EG = -10;
+
+const int  SHIELD_PAWN_CLOSE =  10;  // Shield pawn right in front of the king
+const int    SHIELD_PAWN_FAR =   5;  // Shield pawn two rows in front of the king
+const int SHIELD_PAWN_MISSING = -10; // No shield pawn on the file
+
+// Passed pawn bonus, indexed by the relative row of the pawn (0 = first row)
+
+EXTERN const int8_t passed_pawn_mg[8]
+#if _WEIGHTS_
+  = { 0,  5, 10, 15, 25, 40,  60, 0 }
+#endif
+;
+
+EXTERN const int8_t passed_pawn_eg[8]
+#if _WEIGHTS_
+  = { 0, 10, 15, 25, 45, 70, 110, 0 }
+#endif
+;
@@ -10,10 +10,12 @@
 
 #define __SCREEN__ 1
 #include "screen.hpp"
+#include "alloc.hpp"
 #include "esp.hpp"
 
 #include <iomanip>
 #include <cstring>
+#include <algorithm>
 
 #define BYTES_PER_PIXEL 3
 
@@ -22,210 +24,392 @@ Screen Screen::singleton;
 uint16_t Screen::WIDTH;
 uint16_t Screen::HEIGHT;
 
-const uint8_t Screen::LUT1BIT[8]     = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
-const uint8_t Screen::LUT1BIT_INV[8] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80 };
 
-void 
-Screen::draw_bitmap(
-  const unsigned char * bitmap_data, 
-  Dim                   dim,
-  Pos                   pos)
+void
+Screen::add_dirty_region(int16_t x_min, int16_t y_min, int16_t x_max, int16_t y_max)
 {
-  if (bitmap_data == nullptr) return;
-  
-  // if (show) {
-  //   unsigned char * p = bitmap_data;
-  //   for (int j = 0; j < image_height; j++) {
-  //     for (int i = 0; i < image_width; i++) {
-  //       std::cout << std::setw(2) << std::setfill('0') << std::hex << (int) *p++;
-  //     }
-  //     std::cout << std::endl;
-  //   }
-  // }   
+  if (x_min < 0     ) x_min = 0;
+  if (y_min < 0     ) y_min = 0;
+  if (x_max > WIDTH ) x_max = WIDTH;
+  if (y_max > HEIGHT) y_max = HEIGHT;
 
-  if (pos.x < 0) pos.x = 0;
-  if (pos.y < 0) pos.y = 0;
+  if ((x_min >= x_max) || (y_min >= y_max)) return;
 
-  uint32_t x_max = pos.x + dim.width;
-  uint32_t y_max = pos.y + dim.height;
+  Region * region = nullptr;
 
-  if (y_max > HEIGHT) y_max = HEIGHT;
-  if (x_max > WIDTH ) x_max = WIDTH;
+  for (int8_t i = 0; i < dirty_count; i++) {
+    if ((x_min <= dirty_regions[i].x_max) && (dirty_regions[i].x_min <= x_max) &&
+        (y_min <= dirty_regions[i].y_max) && (dirty_regions[i].y_min <= y_max)) {
+      region = &dirty_regions[i];
+      break;
+    }
+  }
 
-  if (pixel_resolution == PixelResolution::ONE_BIT) {
-    static int16_t err[1201]; // This is the maximum width of all Inkplate devices + 1
-    int16_t error;
-    memset(err, 0, 1201*2);
-
-    if (orientation == Orientation::LEFT) {
-      for (int j = pos.y, q = 0; j < y_max; j++, q++) {
-        for (int i = pos.x, p = q * dim.width, k = 0; i < (x_max - 1); i++, p++, k++) {
-          int32_t v = bitmap_data[p] + err[k + 1];
-          if (v > 128) {
-            error = (v - 255);
-            set_pixel_o_left_1bit(i, j, 0);
-          }
-          else {
-            error = v;
-            set_pixel_o_left_1bit(i, j, 1);
-          }
-          if (k != 0) {
-            err[k - 1] += error / 8;
-          }
-          err[k]     += 3 * error / 8;
-          err[k + 1]  =     error / 8;
-          err[k + 2] += 3 * error / 8;
-        }
-      }
+  if ((region == nullptr) && (dirty_count == MAX_DIRTY_REGIONS)) {
+    region = &dirty_regions[0];
+    for (int8_t i = 1; i < dirty_count; i++) {
+      region->x_min = std::min(region->x_min, dirty_regions[i].x_min);
+      region->y_min = std::min(region->y_min, dirty_regions[i].y_min);
+      region->x_max = std::max(region->x_max, dirty_regions[i].x_max);
+      region->y_max = std::max(region->y_max, dirty_regions[i].y_max);
     }
-    else if (orientation == Orientation::RIGHT) {
-      for (int j = pos.y, q = 0; j < y_max; j++, q++) {
-        for (int i = pos.x, p = q * dim.width, k = 0; i < (x_max - 1); i++, p++, k++) {
-          int32_t v = bitmap_data[p] + err[k + 1];
-          if (v > 128) {
-            error = (v - 255);
-            set_pixel_o_right_1bit(i, j, 0);
-          }
-          else {
-            error = v;
-            set_pixel_o_right_1bit(i, j, 1);
-          }
-          if (k != 0) {
-            err[k - 1] += error / 8;
-          }
-          err[k]     += 3 * error / 8;
-          err[k + 1]  =     error / 8;
-          err[k + 2] += 3 * error / 8;
-        }
+    dirty_count = 1;
+  }
+
+  if (region == nullptr) {
+    dirty_regions[dirty_count++] = { x_min, y_min, x_max, y_max };
+  }
+  else {
+    region->x_min = std::min(region->x_min, x_min);
+    region->y_min = std::min(region->y_min, y_min);
+    region->x_max = std::max(region->x_max, x_max);
+    region->y_max = std::max(region->y_max, y_max);
+  }
+}
+
+// ----- Frame buffer addressing -----
+//
+// Specialized at compile time for each orientation. A panel line holds a
+// screen column (LEFT and RIGHT orientations) or a screen row (BOTTOM). In
+// a line, the pixel at position k is bit k (from the least significant bit
+// of the first byte) at 1 bit per pixel. At 3 bits per pixel, it is a
+// nibble of byte k >> 1, the high one when (k is odd) == HIGH_ODD.
+
+template <Screen::Orientation O>
+struct Panel {
+  static constexpr bool ROW_LINES = (O == Screen::Orientation::BOTTOM);  ///< A line per screen row
+  static constexpr bool HIGH_ODD  = (O != Screen::Orientation::BOTTOM);
+  static constexpr int  STEP      = (O == Screen::Orientation::RIGHT) ? -1 : 1; ///< Position step along a line
+
+  uint8_t * data;
+  int32_t   line_size;
+  int32_t   data_size;
+  int32_t   line_pixels;
+
+  template <class FrameBuffer>
+  Panel(FrameBuffer * frame_buffer, int8_t pixels_per_byte) :
+    data(frame_buffer->get_data()),
+    line_size(frame_buffer->get_line_size()),
+    data_size(frame_buffer->get_data_size()),
+    line_pixels(frame_buffer->get_line_size() * pixels_per_byte) { }
+
+  inline uint8_t * line(int16_t x, int16_t y) const;
+  inline int32_t   position(int16_t x, int16_t y) const;
+};
+
+template <> inline uint8_t * Panel<Screen::Orientation::LEFT  >::line(int16_t x, int16_t y) const { return data + data_size - (line_size * (x + 1)); }
+template <> inline uint8_t * Panel<Screen::Orientation::RIGHT >::line(int16_t x, int16_t y) const { return data + (line_size * x); }
+template <> inline uint8_t * Panel<Screen::Orientation::BOTTOM>::line(int16_t x, int16_t y) const { return data + (line_size * y); }
+
+template <> inline int32_t Panel<Screen::Orientation::LEFT  >::position(int16_t x, int16_t y) const { return y; }
+template <> inline int32_t Panel<Screen::Orientation::RIGHT >::position(int16_t x, int16_t y) const { return line_pixels - 1 - y; }
+template <> inline int32_t Panel<Screen::Orientation::BOTTOM>::position(int16_t x, int16_t y) const { return x; }
+
+// Bit reversal of a byte. Glyph bitmaps are packed from the most significant bit.
+
+static const uint8_t REVERSED[256] = {
+  #define R2(n)    n,     n + 2*64,     n + 1*64,     n + 3*64
+  #define R4(n) R2(n), R2(n + 2*16), R2(n + 1*16), R2(n + 3*16)
+  #define R6(n) R4(n), R4(n + 2*4 ), R4(n + 1*4 ), R4(n + 3*4 )
+  R6(0), R6(2), R6(1), R6(3)
+  #undef R6
+  #undef R4
+  #undef R2
+};
+
+static inline void
+put_bit(uint8_t * line, int32_t k, bool black)
+{
+  if (black) line[k >> 3] |=  (1 << (k & 7));
+  else       line[k >> 3] &= ~(1 << (k & 7));
+}
+
+// Bits [first, last) of a line
+
+static inline void
+fill_bits(uint8_t * line, int32_t first, int32_t last, bool black)
+{
+  if (first >= last) return;
+
+  int32_t first_byte = first >> 3;
+  int32_t last_byte  = (last - 1) >> 3;
+  uint8_t first_mask = 0xFF << (first & 7);
+  uint8_t last_mask  = 0xFF >> (7 - ((last - 1) & 7));
+
+  if (first_byte == last_byte) first_mask &= last_mask;
+
+  if (black) line[first_byte] |=  first_mask;
+  else       line[first_byte] &= ~first_mask;
+
+  if (first_byte != last_byte) {
+    memset(line + first_byte + 1, black ? 0xFF : 0x00, last_byte - first_byte - 1);
+    if (black) line[last_byte] |=  last_mask;
+    else       line[last_byte] &= ~last_mask;
+  }
+}
+
+template <bool HIGH_ODD>
+static inline void
+put_nibble(uint8_t * line, int32_t k, uint8_t color)
+{
+  uint8_t * b = line + (k >> 1);
+  if (((k & 1) != 0) == HIGH_ODD) *b = (*b & 0x0F) | (color << 4);
+  else                            *b = (*b & 0xF0) | color;
+}
+
+// Nibbles [first, last) of a line
+
+template <bool HIGH_ODD>
+static inline void
+fill_nibbles(uint8_t * line, int32_t first, int32_t last, uint8_t color)
+{
+  if (first >= last) return;
+
+  if (first & 1) put_nibble<HIGH_ODD>(line, first++, color);
+  if (last  & 1) put_nibble<HIGH_ODD>(line, --last,  color);
+
+  if (first < last) memset(line + (first >> 1), color * 0x11, (last - first) >> 1);
+}
+
+// Screen region [x_min, x_max) x [y_min, y_max), one line span at a time
+
+template <Screen::Orientation O, int8_t BITS>
+static void
+fill_region(const Panel<O> & panel, int16_t x_min, int16_t y_min, int16_t x_max, int16_t y_max, uint8_t color)
+{
+  if ((x_min >= x_max) || (y_min >= y_max)) return;
+
+  auto fill = [&](uint8_t * line, int32_t k1, int32_t k2) {
+    if (k1 > k2) std::swap(k1, k2);
+    if (BITS == 1) fill_bits(line, k1, k2 + 1, color == 1);
+    else           fill_nibbles<Panel<O>::HIGH_ODD>(line, k1, k2 + 1, color);
+  };
+
+  if (Panel<O>::ROW_LINES) {
+    for (int16_t y = y_min; y < y_max; y++) {
+      fill(panel.line(x_min, y), panel.position(x_min, y), panel.position(x_max - 1, y));
+    }
+  }
+  else {
+    for (int16_t x = x_min; x < x_max; x++) {
+      fill(panel.line(x, y_min), panel.position(x, y_min), panel.position(x, y_max - 1));
+    }
+  }
+}
+
+// 1 bit glyphs: only black pixels are drawn. When panel lines are screen
+// rows, glyph rows are ORed a byte at a time. Otherwise, the pixels of a
+// glyph column are gathered by panel byte before being ORed.
+
+template <Screen::Orientation O>
+static void
+glyph_1bit(const Panel<O> & panel, const uint8_t * bitmap, Dim dim, Pos pos, uint16_t pitch, int16_t x_max, int16_t y_max)
+{
+  int16_t i_min = (pos.x < 0) ? -pos.x : 0;
+  int16_t j_min = (pos.y < 0) ? -pos.y : 0;
+  int16_t i_max = x_max - pos.x;
+  int16_t j_max = y_max - pos.y;
+
+  if (Panel<O>::ROW_LINES && (i_min == 0) && (i_max == dim.width)) {
+    int16_t bytes     = (dim.width + 7) >> 3;
+    uint8_t last_mask = 0xFF >> (((bytes << 3) - dim.width));  // After reversal
+
+    for (int16_t j = j_min; j < j_max; j++) {
+      const uint8_t * src  = bitmap + (j * pitch);
+      uint8_t       * line = panel.line(pos.x, pos.y + j);
+      int32_t         k    = panel.position(pos.x, pos.y + j);
+
+      for (int16_t n = 0; n < bytes; n++, k += 8) {
+        uint8_t v = REVERSED[src[n]];
+        if (n == (bytes - 1)) v &= last_mask;
+        if (v == 0) continue;
+
+        uint8_t * b     = line + (k >> 3);
+        int8_t    shift = k & 7;
+
+        *b |= v << shift;
+        if ((shift != 0) && (v >> (8 - shift))) b[1] |= v >> (8 - shift);
       }
     }
-    else { // Orientation::BOTTOM
-      for (int j = pos.y, q = 0; j < y_max; j++, q++) {
-        for (int i = pos.x, p = q * dim.width, k = 0; i < (x_max - 1); i++, p++, k++) {
-          int32_t v = bitmap_data[p] + err[k + 1];
-          if (v > 128) {
-            error = (v - 255);
-            set_pixel_o_bottom_1bit(i, j, 0);
-          }
-          else {
-            error = v;
-            set_pixel_o_bottom_1bit(i, j, 1);
-          }
-          if (k != 0) {
-            err[k - 1] += error / 8;
-          }
-          err[k]     += 3 * error / 8;
-          err[k + 1]  =     error / 8;
-          err[k + 2] += 3 * error / 8;
-        }
+  }
+  else if (Panel<O>::ROW_LINES) {
+    for (int16_t j = j_min; j < j_max; j++) {
+      const uint8_t * src  = bitmap + (j * pitch);
+      uint8_t       * line = panel.line(pos.x, pos.y + j);
+      int32_t         k    = panel.position(pos.x + i_min, pos.y + j);
+
+      for (int16_t i = i_min; i < i_max; i++, k += Panel<O>::STEP) {
+        if (src[i >> 3] & (0x80 >> (i & 7))) line[k >> 3] |= 1 << (k & 7);
       }
     }
   }
   else {
-    if (orientation == Orientation::LEFT) {
-      for (int j = pos.y, q = 0; j < y_max; j++, q++) {
-        for (int i = pos.x, p = q * dim.width; i < x_max; i++, p++) {
-          int8_t v = bitmap_data[p] >> 5;
-          set_pixel_o_left_3bit(i, j, v);
+    for (int16_t i = i_min; i < i_max; i++) {
+      const uint8_t * src      = bitmap + (i >> 3);
+      uint8_t         src_mask = 0x80 >> (i & 7);
+      uint8_t       * line     = panel.line(pos.x + i, pos.y);
+      int32_t         k        = panel.position(pos.x + i, pos.y + j_min);
+      int32_t         byte_idx = -1;
+      uint8_t         acc      = 0;
+
+      for (int16_t j = j_min; j < j_max; j++, k += Panel<O>::STEP) {
+        if ((src[j * pitch] & src_mask) == 0) continue;
+        if ((k >> 3) != byte_idx) {
+          if (acc) line[byte_idx] |= acc;
+          byte_idx = k >> 3;
+          acc      = 0;
         }
+        acc |= 1 << (k & 7);
       }
+      if (acc) line[byte_idx] |= acc;
     }
-    else if (orientation == Orientation::RIGHT) {
-      for (int j = pos.y, q = 0; j < y_max; j++, q++) {
-        for (int i = pos.x, p = q * dim.width; i < x_max; i++, p++) {
-          int8_t v = bitmap_data[p] >> 5;
-          set_pixel_o_right_3bit(i, j, v);
-        }
+  }
+}
+
+// 8 bits glyphs, shown with 8 levels of gray. White pixels are not drawn.
+
+template <Screen::Orientation O>
+static void
+glyph_3bit(const Panel<O> & panel, const uint8_t * bitmap, Pos pos, uint16_t pitch, int16_t x_max, int16_t y_max)
+{
+  int16_t i_min = (pos.x < 0) ? -pos.x : 0;
+  int16_t j_min = (pos.y < 0) ? -pos.y : 0;
+  int16_t i_max = x_max - pos.x;
+  int16_t j_max = y_max - pos.y;
+
+  if (Panel<O>::ROW_LINES) {
+    for (int16_t j = j_min; j < j_max; j++) {
+      const uint8_t * src  = bitmap + (j * pitch);
+      uint8_t       * line = panel.line(pos.x, pos.y + j);
+      int32_t         k    = panel.position(pos.x + i_min, pos.y + j);
+
+      for (int16_t i = i_min; i < i_max; i++, k += Panel<O>::STEP) {
+        uint8_t v = 7 - (src[i] >> 5);
+        if (v != 7) put_nibble<Panel<O>::HIGH_ODD>(line, k, v);
       }
     }
-    else { // BOTTOM
-      for (int j = pos.y, q = 0; j < y_max; j++, q++) {
-        for (int i = pos.x, p = q * dim.width; i < x_max; i++, p++) {
-          int8_t v = bitmap_data[p] >> 5;
-          set_pixel_o_bottom_3bit(i, j, v);
-        }
+  }
+  else {
+    for (int16_t i = i_min; i < i_max; i++) {
+      uint8_t * line = panel.line(pos.x + i, pos.y);
+      int32_t   k    = panel.position(pos.x + i, pos.y + j_min);
+
+      for (int16_t j = j_min; j < j_max; j++, k += Panel<O>::STEP) {
+        uint8_t v = 7 - (bitmap[(j * pitch) + i] >> 5);
+        if (v != 7) put_nibble<Panel<O>::HIGH_ODD>(line, k, v);
       }
     }
   }
 }
 
+// Gray scale images, dithered (Floyd-Steinberg like) at 1 bit per pixel
+
+template <Screen::Orientation O>
+static void
+bitmap_1bit(const Panel<O> & panel, const uint8_t * bitmap, Dim dim, Pos pos, int16_t x_max, int16_t y_max)
+{
+  static int16_t err[1201]; // This is the maximum width of all Inkplate devices + 1
+  int16_t error;
+  memset(err, 0, 1201*2);
+
+  for (int j = pos.y, q = 0; j < y_max; j++, q++) {
+    for (int i = pos.x, p = q * dim.width, k = 0; i < (x_max - 1); i++, p++, k++) {
+      int32_t v = bitmap[p] + err[k + 1];
+      if (v > 128) {
+        error = (v - 255);
+        put_bit(panel.line(i, j), panel.position(i, j), false);
+      }
+      else {
+        error = v;
+        put_bit(panel.line(i, j), panel.position(i, j), true);
+      }
+      if (k != 0) {
+        err[k - 1] += error / 8;
+      }
+      err[k]     += 3 * error / 8;
+      err[k + 1]  =     error / 8;
+      err[k + 2] += 3 * error / 8;
+    }
+  }
+}
+
+template <Screen::Orientation O>
+static void
+bitmap_3bit(const Panel<O> & panel, const uint8_t * bitmap, Dim dim, Pos pos, int16_t x_max, int16_t y_max)
+{
+  for (int j = pos.y, q = 0; j < y_max; j++, q++) {
+    for (int i = pos.x, p = q * dim.width; i < x_max; i++, p++) {
+      put_nibble<Panel<O>::HIGH_ODD>(panel.line(i, j), panel.position(i, j), bitmap[p] >> 5);
+    }
+  }
+}
+
+template <Screen::Orientation O, int8_t BITS>
+static void
+rectangle(const Panel<O> & panel, Pos pos, int16_t x_max, int16_t y_max, uint8_t color)
+{
+  fill_region<O, BITS>(panel, pos.x,     pos.y,     x_max, pos.y + 1, color);
+  fill_region<O, BITS>(panel, pos.x,     y_max - 1, x_max, y_max,     color);
+  fill_region<O, BITS>(panel, pos.x,     pos.y,     pos.x + 1, y_max, color);
+  fill_region<O, BITS>(panel, x_max - 1, pos.y,     x_max, y_max,     color);
+}
+
+void 
+Screen::draw_bitmap(
+  const unsigned char * bitmap_data, 
+  Dim                   dim,
+  Pos                   pos)
+{
+  if (bitmap_data == nullptr) return;
+
+  if (pos.x < 0) pos.x = 0;
+  if (pos.y < 0) pos.y = 0;
+
+  int16_t x_max = pos.x + dim.width;
+  int16_t y_max = pos.y + dim.height;
+
+  if (y_max > HEIGHT) y_max = HEIGHT;
+  if (x_max > WIDTH ) x_max = WIDTH;
+
+  add_dirty_region(pos.x, pos.y, x_max, y_max);
+
+  if (pixel_resolution == PixelResolution::ONE_BIT) {
+    if      (orientation == Orientation::LEFT ) bitmap_1bit(Panel<Orientation::LEFT  >(frame_buffer_1bit, 8), bitmap_data, dim, pos, x_max, y_max);
+    else if (orientation == Orientation::RIGHT) bitmap_1bit(Panel<Orientation::RIGHT >(frame_buffer_1bit, 8), bitmap_data, dim, pos, x_max, y_max);
+    else                                        bitmap_1bit(Panel<Orientation::BOTTOM>(frame_buffer_1bit, 8), bitmap_data, dim, pos, x_max, y_max);
+  }
+  else {
+    if      (orientation == Orientation::LEFT ) bitmap_3bit(Panel<Orientation::LEFT  >(frame_buffer_3bit, 2), bitmap_data, dim, pos, x_max, y_max);
+    else if (orientation == Orientation::RIGHT) bitmap_3bit(Panel<Orientation::RIGHT >(frame_buffer_3bit, 2), bitmap_data, dim, pos, x_max, y_max);
+    else                                        bitmap_3bit(Panel<Orientation::BOTTOM>(frame_buffer_3bit, 2), bitmap_data, dim, pos, x_max, y_max);
+  }
+}
+
 void 
 Screen::draw_rectangle(
   Dim     dim,
   Pos     pos,
   uint8_t color)
 {
-  uint32_t x_max = pos.x + dim.width;
-  uint32_t y_max = pos.y + dim.height;
+  int16_t x_max = pos.x + dim.width;
+  int16_t y_max = pos.y + dim.height;
 
   if (y_max > HEIGHT) y_max = HEIGHT;
   if (x_max > WIDTH ) x_max = WIDTH;
-  
+
+  add_dirty_region(pos.x, pos.y, x_max, y_max);
+
   if (pixel_resolution == PixelResolution::ONE_BIT) {
     uint8_t col = color == BLACK_COLOR ? 1 : 0;
   
-    if (orientation == Orientation::LEFT) {
-      for (int i = pos.x; i < x_max; i++) {
-        set_pixel_o_left_1bit(i, pos.y, col);
-        set_pixel_o_left_1bit(i, y_max - 1, col);
-      }
-      for (int j = pos.y; j < y_max; j++) {
-        set_pixel_o_left_1bit(pos.x, j, col);
-        set_pixel_o_left_1bit(x_max - 1, j, col);
-      }
-    }
-    else if (orientation == Orientation::RIGHT) {
-      for (int i = pos.x; i < x_max; i++) {
-        set_pixel_o_right_1bit(i, pos.y, col);
-        set_pixel_o_right_1bit(i, y_max - 1, col);
-      }
-      for (int j = pos.y; j < y_max; j++) {
-        set_pixel_o_right_1bit(pos.x, j, col);
-        set_pixel_o_right_1bit(x_max - 1, j, col);
-      }
-    }
-    else {
-      for (int i = pos.x; i < x_max; i++) {
-        set_pixel_o_bottom_1bit(i, pos.y, col);
-        set_pixel_o_bottom_1bit(i, y_max - 1, col);
-      }
-      for (int j = pos.y; j < y_max; j++) {
-        set_pixel_o_bottom_1bit(pos.x, j, col);
-        set_pixel_o_bottom_1bit(x_max - 1, j, col);
-      }
-    }
+    if      (orientation == Orientation::LEFT ) rectangle<Orientation::LEFT,   1>(Panel<Orientation::LEFT  >(frame_buffer_1bit, 8), pos, x_max, y_max, col);
+    else if (orientation == Orientation::RIGHT) rectangle<Orientation::RIGHT,  1>(Panel<Orientation::RIGHT >(frame_buffer_1bit, 8), pos, x_max, y_max, col);
+    else                                        rectangle<Orientation::BOTTOM, 1>(Panel<Orientation::BOTTOM>(frame_buffer_1bit, 8), pos, x_max, y_max, col);
   }
   else {
-    if (orientation == Orientation::LEFT) {
-      for (int i = pos.x; i < x_max; i++) {
-        set_pixel_o_left_3bit(i, pos.y, color);
-        set_pixel_o_left_3bit(i, y_max - 1, color);
-      }
-      for (int j = pos.y; j < y_max; j++) {
-        set_pixel_o_left_3bit(pos.x, j, color);
-        set_pixel_o_left_3bit(x_max - 1, j, color);
-      }
-    }
-    else if (orientation == Orientation::RIGHT) {
-      for (int i = pos.x; i < x_max; i++) {
-        set_pixel_o_right_3bit(i, pos.y, color);
-        set_pixel_o_right_3bit(i, y_max - 1, color);
-      }
-      for (int j = pos.y; j < y_max; j++) {
-        set_pixel_o_right_3bit(pos.x, j, color);
-        set_pixel_o_right_3bit(x_max - 1, j, color);
-      }
-    }
-    else {
-      for (int i = pos.x; i < x_max; i++) {
-        set_pixel_o_bottom_3bit(i, pos.y, color);
-        set_pixel_o_bottom_3bit(i, y_max - 1, color);
-      }
-      for (int j = pos.y; j < y_max; j++) {
-        set_pixel_o_bottom_3bit(pos.x, j, color);
-        set_pixel_o_bottom_3bit(x_max - 1, j, color);
-      }
-    }
+    if      (orientation == Orientation::LEFT ) rectangle<Orientation::LEFT,   3>(Panel<Orientation::LEFT  >(frame_buffer_3bit, 2), pos, x_max, y_max, color);
+    else if (orientation == Orientation::RIGHT) rectangle<Orientation::RIGHT,  3>(Panel<Orientation::RIGHT >(frame_buffer_3bit, 2), pos, x_max, y_max, color);
+    else                                        rectangle<Orientation::BOTTOM, 3>(Panel<Orientation::BOTTOM>(frame_buffer_3bit, 2), pos, x_max, y_max, color);
   }
 }
 
@@ -233,7 +417,7 @@ void
 Screen::colorize_region(
   Dim     dim,
   Pos     pos,
-  uint8_t color) //, bool show)
+  uint8_t color)
 {
   int16_t x_max = pos.x + dim.width;
   int16_t y_max = pos.y + dim.height;
@@ -241,52 +425,19 @@ Screen::colorize_region(
   if (y_max > HEIGHT) y_max = HEIGHT;
   if (x_max > WIDTH ) x_max = WIDTH;
 
+  add_dirty_region(pos.x, pos.y, x_max, y_max);
+
   if (pixel_resolution == PixelResolution::ONE_BIT) {
-    int8_t col = color == BLACK_COLOR ? 1 : 0;
-    if (orientation == Orientation::LEFT) {
-      for (int j = pos.y; j < y_max; j++) {
-        for (int i = pos.x; i < x_max; i++) {
-          set_pixel_o_left_1bit(i, j, color);
-        }
-      }
-    }
-    else if (orientation == Orientation::RIGHT) {
-      for (int j = pos.y; j < y_max; j++) {
-        for (int i = pos.x; i < x_max; i++) {
-          set_pixel_o_right_1bit(i, j, col);
-        }
-      }
-    }
-    else {
-      for (int j = pos.y; j < y_max; j++) {
-        for (int i = pos.x; i < x_max; i++) {
-          set_pixel_o_bottom_1bit(i, j, col);
-        }
-      }
-    }
+    uint8_t col = color == BLACK_COLOR ? 1 : 0;
+
+    if      (orientation == Orientation::LEFT ) fill_region<Orientation::LEFT,   1>(Panel<Orientation::LEFT  >(frame_buffer_1bit, 8), pos.x, pos.y, x_max, y_max, col);
+    else if (orientation == Orientation::RIGHT) fill_region<Orientation::RIGHT,  1>(Panel<Orientation::RIGHT >(frame_buffer_1bit, 8), pos.x, pos.y, x_max, y_max, col);
+    else                                        fill_region<Orientation::BOTTOM, 1>(Panel<Orientation::BOTTOM>(frame_buffer_1bit, 8), pos.x, pos.y, x_max, y_max, col);
   }
   else {
-    if (orientation == Orientation::LEFT) {
-      for (int j = pos.y; j < y_max; j++) {
-        for (int i = pos.x; i < x_max; i++) {
-          set_pixel_o_left_3bit(i, j, color);
-        }
-      }
-    }
-    else if (orientation == Orientation::RIGHT) {
-      for (int j = pos.y; j < y_max; j++) {
-        for (int i = pos.x; i < x_max; i++) {
-          set_pixel_o_right_3bit(i, j, color);
-        }
-      }
-    }
-    else {
-      for (int j = pos.y; j < y_max; j++) {
-        for (int i = pos.x; i < x_max; i++) {
-          set_pixel_o_bottom_3bit(i, j, color);
-        }
-      }
-    }
+    if      (orientation == Orientation::LEFT ) fill_region<Orientation::LEFT,   3>(Panel<Orientation::LEFT  >(frame_buffer_3bit, 2), pos.x, pos.y, x_max, y_max, color);
+    else if (orientation == Orientation::RIGHT) fill_region<Orientation::RIGHT,  3>(Panel<Orientation::RIGHT >(frame_buffer_3bit, 2), pos.x, pos.y, x_max, y_max, color);
+    else                                        fill_region<Orientation::BOTTOM, 3>(Panel<Orientation::BOTTOM>(frame_buffer_3bit, 2), pos.x, pos.y, x_max, y_max, color);
   }
 }
 
@@ -297,70 +448,117 @@ Screen::draw_glyph(
   Pos                   pos, 
   uint16_t              pitch)
 {
-  int x_max = pos.x + dim.width;
-  int y_max = pos.y + dim.height;
+  int16_t x_max = pos.x + dim.width;
+  int16_t y_max = pos.y + dim.height;
 
   if (y_max > HEIGHT) y_max = HEIGHT;
   if (x_max > WIDTH ) x_max = WIDTH;
 
+  add_dirty_region(pos.x, pos.y, x_max, y_max);
+
   if (pixel_resolution == PixelResolution::ONE_BIT) {
-    if (orientation == Orientation::LEFT) {
-      for (uint32_t j = pos.y, q = 0; j < y_max; j++, q++) {  // row
-        for (uint32_t i = pos.x, p = (q * pitch) << 3; i < x_max; i++, p++) { // column
-          uint8_t v = bitmap_data[p >> 3] & LUT1BIT[p & 7];
-          // set_pixel_o_left_1bit(i, j, v ? 1 : 0);
-          if (v) set_pixel_o_left_1bit(i, j, 1);
-        }
-      }
-    }
-    else if (orientation == Orientation::RIGHT) {
-      for (uint32_t j = pos.y, q = 0; j < y_max; j++, q++) {  // row
-        for (uint32_t i = pos.x, p = (q * pitch) << 3; i < x_max; i++, p++) { // column
-          uint8_t v = bitmap_data[p >> 3] & LUT1BIT[p & 7];
-          // set_pixel_o_right_1bit(i, j, v ? 1 : 0);
-          if (v) set_pixel_o_right_1bit(i, j, 1);
-        }
-      }
-    }
-    else {
-      for (uint32_t j = pos.y, q = 0; j < y_max; j++, q++) {  // row
-        for (uint32_t i = pos.x, p = (q * pitch) << 3; i < x_max; i++, p++) { // column
-          uint8_t v = bitmap_data[p >> 3] & LUT1BIT[p & 7];
-          // set_pixel_o_bottom_1bit(i, j, v ? 1 : 0);
-          if (v) set_pixel_o_bottom_1bit(i, j, 1);
-        }
-      }
-    }
+    if      (orientation == Orientation::LEFT ) glyph_1bit(Panel<Orientation::LEFT  >(frame_buffer_1bit, 8), bitmap_data, dim, pos, pitch, x_max, y_max);
+    else if (orientation == Orientation::RIGHT) glyph_1bit(Panel<Orientation::RIGHT >(frame_buffer_1bit, 8), bitmap_data, dim, pos, pitch, x_max, y_max);
+    else                                        glyph_1bit(Panel<Orientation::BOTTOM>(frame_buffer_1bit, 8), bitmap_data, dim, pos, pitch, x_max, y_max);
   }
   else {
-    if (orientation == Orientation::LEFT) {
-      for (uint32_t j = pos.y, q = 0; j < y_max; j++, q++) {  // row
-        for (uint32_t i = pos.x, p = q * pitch; i < x_max; i++, p++) { // column
-          uint8_t v = 7 - (bitmap_data[p] >> 5);
-          // set_pixel_o_left_3bit(i, j, v);
-          if (v != 7) set_pixel_o_left_3bit(i, j, v);
-        }
-      }
-    }
-    else if (orientation == Orientation::RIGHT) {
-      for (uint32_t j = pos.y, q = 0; j < y_max; j++, q++) {  // row
-        for (uint32_t i = pos.x, p = q * pitch; i < x_max; i++, p++) { // column
-          uint8_t v = 7 - (bitmap_data[p] >> 5);
-          // set_pixel_o_right_3bit(i, j, v);
-          if (v != 7) set_pixel_o_right_3bit(i, j, v);
-        }
-      }
+    if      (orientation == Orientation::LEFT ) glyph_3bit(Panel<Orientation::LEFT  >(frame_buffer_3bit, 2), bitmap_data, pos, pitch, x_max, y_max);
+    else if (orientation == Orientation::RIGHT) glyph_3bit(Panel<Orientation::RIGHT >(frame_buffer_3bit, 2), bitmap_data, pos, pitch, x_max, y_max);
+    else                                        glyph_3bit(Panel<Orientation::BOTTOM>(frame_buffer_3bit, 2), bitmap_data, pos, pitch, x_max, y_max);
+  }
+}
+
+// The frame buffer is compared with the last frame shown, 32 bits at a time.
+// The words that differ are counted and copied to the shown frame. In 1-bit
+// mode, a set bit is a black pixel. In 3-bit mode, the changed nibbles are
+// counted.
+
+Screen::FrameDiff
+Screen::diff_frame(const uint8_t * data, int32_t size)
+{
+  FrameDiff diff = { 0, 0 };
+
+  const uint32_t * src = (const uint32_t *) data;
+  const uint32_t * end = src + (size >> 2);
+  uint32_t       * dst = (uint32_t *) shown_frame;
+
+  if (pixel_resolution == PixelResolution::ONE_BIT) {
+    for (; src < end; src++, dst++) {
+      uint32_t changes = *src ^ *dst;
+      if (changes == 0) continue;
+      diff.changed  += __builtin_popcount(changes);
+      diff.whitened += __builtin_popcount(changes & *dst);
+      *dst = *src;
     }
-    else {
-      for (uint32_t j = pos.y, q = 0; j < y_max; j++, q++) {  // row
-        for (uint32_t i = pos.x, p = q * pitch; i < x_max; i++, p++) { // column
-          uint8_t v = 7 - (bitmap_data[p] >> 5);
-          // set_pixel_o_bottom_3bit(i, j, v);
-          if (v != 7) set_pixel_o_bottom_3bit(i, j, v);
-        }
-      }
+  }
+  else {
+    for (; src < end; src++, dst++) {
+      uint32_t changes = *src ^ *dst;
+      if (changes == 0) continue;
+      changes |= changes >> 1;
+      changes |= changes >> 2;
+      diff.changed += __builtin_popcount(changes & 0x11111111);
+      *dst = *src;
     }
   }
+
+  return diff;
+}
+
+void
+Screen::update(bool no_full)
+{
+  if (dirty_count == 0) return;
+  dirty_count = 0;
+
+  bool      one_bit = pixel_resolution == PixelResolution::ONE_BIT;
+  bool        first = false;
+  FrameDiff    diff = { 1, 0 }; // Unknown without a copy of the frame shown
+
+  if (shown_frame != nullptr) {
+    if (one_bit) diff = diff_frame(frame_buffer_1bit->get_data(), frame_buffer_1bit->get_data_size());
+    else         diff = diff_frame(frame_buffer_3bit->get_data(), frame_buffer_3bit->get_data_size());
+
+    if (shown_valid && (diff.changed == 0)) return; // The display already shows this frame
+
+    first       = !shown_valid;
+    shown_valid = true;
+  }
+
+  if (!one_bit) {
+    e_ink.update(*frame_buffer_3bit);
+    return;
+  }
+
+  int32_t pixel_count = (int32_t) WIDTH * HEIGHT;
+
+  ghost_count += diff.whitened;
+
+  if (no_full) {
+    e_ink.partial_update(*frame_buffer_1bit);
+    partial_count = 0;
+  }
+  else if (first || (partial_count <= 0)                    ||
+           (diff.changed > (pixel_count / FULL_UPDATE_SHARE)) ||
+           (ghost_count  > (pixel_count / GHOST_SHARE      ))) {
+    e_ink.update(*frame_buffer_1bit);
+    partial_count = PARTIAL_COUNT_ALLOWED;
+    ghost_count   = 0;
+  }
+  else {
+    e_ink.partial_update(*frame_buffer_1bit);
+    partial_count--;
+  }
+}
+
+void
+Screen::setup_shown_frame(int32_t size)
+{
+  free(shown_frame);
+
+  shown_frame = (size > 0) ? (uint8_t *) allocate(size) : nullptr;
+  shown_valid = false;
+  ghost_count = 0;
 }
 
 void 
@@ -384,6 +582,7 @@ Screen::set_pixel_resolution(PixelResolution resolution, bool force)
       if ((frame_buffer_1bit = e_ink.new_frame_buffer_1bit()) != nullptr) {
         frame_buffer_1bit->clear();
       }
+      setup_shown_frame((frame_buffer_1bit == nullptr) ? 0 : frame_buffer_1bit->get_data_size());
       partial_count = 0;
     }
     else {
@@ -394,6 +593,7 @@ Screen::set_pixel_resolution(PixelResolution resolution, bool force)
       if ((frame_buffer_3bit = e_ink.new_frame_buffer_3bit()) != nullptr) {
         frame_buffer_3bit->clear();
       }
+      setup_shown_frame((frame_buffer_3bit == nullptr) ? 0 : frame_buffer_3bit->get_data_size());
     }
   }
 }
@@ -42,12 +42,26 @@ class Screen : NonCopyable
     enum class Orientation     : int8_t { LEFT, RIGHT, BOTTOM };
     enum class PixelResolution : int8_t { ONE_BIT, THREE_BITS };
 
+    /**
+     * @brief Screen region modified since the last update
+     * 
+     * The drawing methods record the regions they modify. Overlapping or
+     * touching regions are merged. When there are more than MAX_DIRTY_REGIONS
+     * of them, they are all merged in their bounding box.
+     */
+    struct Region {
+      int16_t x_min, y_min;
+      int16_t x_max, y_max;  ///< Excluded
+    };
+    static constexpr int8_t MAX_DIRTY_REGIONS = 8;
+
     void     draw_bitmap(const unsigned char * bitmap_data, Dim dim, Pos pos);
     void      draw_glyph(const unsigned char * bitmap_data, Dim dim, Pos pos, uint16_t pitch);
     void  draw_rectangle(Dim dim, Pos pos, uint8_t color);
     void colorize_region(Dim dim, Pos pos, uint8_t color);
 
     inline void clear()  {
+      add_dirty_region(0, 0, WIDTH, HEIGHT);
       if (pixel_resolution == PixelResolution::ONE_BIT) { 
         frame_buffer_1bit->clear();
       }
@@ -56,92 +70,59 @@ class Screen : NonCopyable
       } 
     }
     
-    inline void update(bool no_full = false) { 
-      if (pixel_resolution == PixelResolution::ONE_BIT) {
-        if (no_full) {
-          e_ink.partial_update(*frame_buffer_1bit);
-          partial_count = 0;
-        }
-        else {
-          if (partial_count <= 0) {
-            //e_ink.clean();
-            e_ink.update(*frame_buffer_1bit);
-            partial_count = PARTIAL_COUNT_ALLOWED;
-          }
-          else {
-            e_ink.partial_update(*frame_buffer_1bit);
-            partial_count--;
-          }
-        }
-      }
-      else {
-        e_ink.update(*frame_buffer_3bit);
-      }
-    }
+    /**
+     * @brief Push the frame buffer to the display
+     * 
+     * Nothing is done if no pixel was modified since the last update. The
+     * e-ink driver only updates whole frames: the frame buffer is compared
+     * with the last frame shown, to choose the kind of update. An identical
+     * frame is not sent to the display. In 1-bit mode, a partial update is
+     * done, unless too many pixels changed, or too many pixels went from
+     * black to white since the last full update (the source of ghosting),
+     * or PARTIAL_COUNT_ALLOWED partial updates were done.
+     * 
+     * @param no_full Do a partial update in 1-bit mode. The next update
+     *                will be a full one.
+     */
+    void update(bool no_full = false);
+
+    static constexpr int8_t FULL_UPDATE_SHARE = 3; ///< Full update when more than 1/3 of the pixels changed
+    static constexpr int8_t GHOST_SHARE       = 8; ///< Full update when 1/8 of the pixels went white since the last one
 
   private:
     static constexpr char const * TAG = "Screen";
-    static const uint8_t          LUT1BIT[8];
-    static const uint8_t          LUT1BIT_INV[8];
 
     static Screen singleton;
     Screen() : partial_count(0), 
+               dirty_count(0),
                frame_buffer_1bit(nullptr), 
-               frame_buffer_3bit(nullptr) { };
+               frame_buffer_3bit(nullptr),
+               shown_frame(nullptr),
+               shown_valid(false),
+               ghost_count(0) { };
+
+    /**
+     * @brief Differences between the frame buffer and the last frame shown
+     */
+    struct FrameDiff {
+      int32_t changed;   ///< Pixels changed
+      int32_t whitened;  ///< Pixels changed from black to white (1-bit only)
+    };
 
     int8_t            partial_count;
+    int8_t            dirty_count;
+    Region            dirty_regions[MAX_DIRTY_REGIONS];
     FrameBuffer1Bit * frame_buffer_1bit;
     FrameBuffer3Bit * frame_buffer_3bit;
+    uint8_t         * shown_frame;  ///< Copy of the last frame sent to the display
+    bool              shown_valid;
+    int32_t           ghost_count;  ///< Pixels changed from black to white since the last full update
     PixelResolution   pixel_resolution;
     Orientation       orientation;
 
-    inline void set_pixel_o_left_1bit(uint32_t col, uint32_t row, uint8_t color) {
-      uint8_t * temp = &(frame_buffer_1bit->get_data())[frame_buffer_1bit->get_data_size() - (frame_buffer_1bit->get_line_size() * (col + 1)) + (row >> 3)];
-      if (color == 1)
-        *temp = *temp | LUT1BIT_INV[row & 7];
-      else
-        *temp = (*temp & ~LUT1BIT_INV[row & 7]);
-    }
-
-    inline void set_pixel_o_right_1bit(uint32_t col, uint32_t row, uint8_t color) {
-      uint8_t * temp = &(frame_buffer_1bit->get_data())[(frame_buffer_1bit->get_line_size() * (col + 1)) - (row >> 3) - 1];
-      if (color == 1)
-        *temp = *temp | LUT1BIT[row & 7];
-      else
-        *temp = (*temp & ~LUT1BIT[row & 7]);
-    }
-
-    inline void set_pixel_o_bottom_1bit(uint32_t col, uint32_t row, uint8_t color) {
-      uint8_t * temp = &(frame_buffer_1bit->get_data())[frame_buffer_1bit->get_line_size() * row + (col >> 3)];
-      if (color == 1)
-        *temp = *temp | LUT1BIT_INV[col & 7];
-      else
-        *temp = (*temp & ~LUT1BIT_INV[col & 7]);
-    }
-
-    inline void set_pixel_o_left_3bit(uint32_t col, uint32_t row, uint8_t color) {
-      uint8_t * temp = &(frame_buffer_3bit->get_data())[frame_buffer_3bit->get_data_size() - (frame_buffer_3bit->get_line_size() * (col + 1)) + (row >> 1)];
-      if (row & 1)
-        *temp = (*temp & 0x0F) | (color << 4);
-      else
-        *temp = (*temp & 0xF0) | color;
-    }
-
-    inline void set_pixel_o_right_3bit(uint32_t col, uint32_t row, uint8_t color) {
-      uint8_t * temp = &(frame_buffer_3bit->get_data())[(frame_buffer_3bit->get_line_size() * (col + 1)) - (row >> 1) - 1];
-       if (row & 1)
-        *temp = (*temp & 0xF0) | color;
-      else
-        *temp = (*temp & 0x0F) | (color << 4);
-    }
-
-    inline void set_pixel_o_bottom_3bit(uint32_t col, uint32_t row, uint8_t color) {
-      uint8_t * temp = &(frame_buffer_3bit->get_data())[frame_buffer_3bit->get_line_size() * row + (col >> 1)];
-      if (col & 1)
-        *temp = (*temp & 0xF0) | color;
-      else
-        *temp = (*temp & 0x0F) | (color << 4);
-     }
+    void add_dirty_region(int16_t x_min, int16_t y_min, int16_t x_max, int16_t y_max);
+    FrameDiff diff_frame(const uint8_t * data, int32_t size);
+    void    setup_shown_frame(int32_t size);
 
   public:
     static Screen & get_singleton() noexcept { return singleton; }
@@ -149,6 +130,8 @@ class Screen : NonCopyable
     void set_pixel_resolution(PixelResolution resolution, bool force = false);
     void set_orientation(Orientation orient);
     inline PixelResolution get_pixel_resolution() { return pixel_resolution; }
+    inline int8_t               get_dirty_count() { return dirty_count;      }
+    inline const Region *     get_dirty_regions() { return dirty_regions;    }
 };
 
 #if __SCREEN__
@@ -0,0 +1,394 @@
+// Copyright (c) 2021 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+// Headless screen, painting into a memory frame buffer
+//
+// Colors received from the application are gray levels (0 = black, 255 =
+// white), as with the GTK version. They are reduced to the frame buffer
+// pixel resolution.
+
+#define __SCREEN__ 1
+#include "screen.hpp"
+#include "alloc.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+Screen Screen::singleton;
+
+uint16_t Screen::WIDTH;
+uint16_t Screen::HEIGHT;
+
+static inline void
+put_bit(uint8_t * line, int32_t x, bool black)
+{
+  if (black) line[x >> 3] |=  (0x80 >> (x & 7));
+  else       line[x >> 3] &= ~(0x80 >> (x & 7));
+}
+
+static inline void
+put_nibble(uint8_t * line, int32_t x, uint8_t level)
+{
+  uint8_t * b = &line[x >> 1];
+  if (x & 1) *b = (*b & 0xF0) | level;
+  else       *b = (*b & 0x0F) | (level << 4);
+}
+
+// Fill the pixels [first, last[ of a row
+
+static void
+fill_bits(uint8_t * line, int32_t first, int32_t last, bool black)
+{
+  while ((first < last) && (first & 7)) put_bit(line, first++, black);
+  while ((first < last) && (last  & 7)) put_bit(line, --last,  black);
+  if (first < last) memset(line + (first >> 3), black ? 0xFF : 0x00, (last - first) >> 3);
+}
+
+static void
+fill_nibbles(uint8_t * line, int32_t first, int32_t last, uint8_t level)
+{
+  if ((first < last) && (first & 1)) put_nibble(line, first++, level);
+  if ((first < last) && (last  & 1)) put_nibble(line, --last,  level);
+  if (first < last) memset(line + (first >> 1), level * 0x11, (last - first) >> 1);
+}
+
+void
+Screen::add_dirty_region(int16_t x_min, int16_t y_min, int16_t x_max, int16_t y_max)
+{
+  if (x_min < 0     ) x_min = 0;
+  if (y_min < 0     ) y_min = 0;
+  if (x_max > WIDTH ) x_max = WIDTH;
+  if (y_max > HEIGHT) y_max = HEIGHT;
+
+  if ((x_min >= x_max) || (y_min >= y_max)) return;
+
+  stats.draw_count++;
+  stats.pixels_touched += (x_max - x_min) * (y_max - y_min);
+
+  Region * region = nullptr;
+
+  for (int8_t i = 0; i < dirty_count; i++) {
+    if ((x_min <= dirty_regions[i].x_max) && (dirty_regions[i].x_min <= x_max) &&
+        (y_min <= dirty_regions[i].y_max) && (dirty_regions[i].y_min <= y_max)) {
+      region = &dirty_regions[i];
+      break;
+    }
+  }
+
+  if ((region == nullptr) && (dirty_count == MAX_DIRTY_REGIONS)) {
+    region = &dirty_regions[0];
+    for (int8_t i = 1; i < dirty_count; i++) {
+      region->x_min = std::min(region->x_min, dirty_regions[i].x_min);
+      region->y_min = std::min(region->y_min, dirty_regions[i].y_min);
+      region->x_max = std::max(region->x_max, dirty_regions[i].x_max);
+      region->y_max = std::max(region->y_max, dirty_regions[i].y_max);
+    }
+    dirty_count = 1;
+  }
+
+  if (region == nullptr) {
+    dirty_regions[dirty_count++] = { x_min, y_min, x_max, y_max };
+  }
+  else {
+    region->x_min = std::min(region->x_min, x_min);
+    region->y_min = std::min(region->y_min, y_min);
+    region->x_max = std::max(region->x_max, x_max);
+    region->y_max = std::max(region->y_max, y_max);
+  }
+}
+
+void
+Screen::draw_bitmap(
+  const unsigned char * bitmap_data,
+  Dim                   dim,
+  Pos                   pos)
+{
+  if (bitmap_data == nullptr) return;
+
+  if (pos.x < 0) pos.x = 0;
+  if (pos.y < 0) pos.y = 0;
+
+  int16_t x_max = pos.x + dim.width;
+  int16_t y_max = pos.y + dim.height;
+
+  if (y_max > HEIGHT) y_max = HEIGHT;
+  if (x_max > WIDTH ) x_max = WIDTH;
+
+  add_dirty_region(pos.x, pos.y, x_max, y_max);
+
+  uint8_t * line = frame_buffer + pos.y * line_size;
+
+  if (pixel_resolution == PixelResolution::ONE_BIT) {
+    static int16_t err[601];
+    int16_t error;
+    memset(err, 0, 601*2);
+
+    for (int j = pos.y, q = 0; j < y_max; j++, q++, line += line_size) {
+      for (int i = pos.x, p = q * dim.width, k = 0; i < (x_max - 1); i++, p++, k++) {
+        int32_t v = bitmap_data[p] + err[k + 1];
+        if (v > 128) {
+          error = (v - 255);
+          put_bit(line, i, false);
+        }
+        else {
+          error = v;
+          put_bit(line, i, true);
+        }
+        if (k != 0) {
+          err[k - 1] += error / 8;
+        }
+        err[k]     += 3 * error / 8;
+        err[k + 1]  =     error / 8;
+        err[k + 2] += 3 * error / 8;
+      }
+    }
+  }
+  else {
+    for (int j = pos.y, q = 0; j < y_max; j++, q++, line += line_size) {
+      for (int i = pos.x, p = q * dim.width; i < x_max; i++, p++) {
+        put_nibble(line, i, bitmap_data[p] >> 5);
+      }
+    }
+  }
+}
+
+void
+Screen::draw_rectangle(
+  Dim      dim,
+  Pos      pos,
+  uint8_t  color)
+{
+  int16_t x_max = pos.x + dim.width;
+  int16_t y_max = pos.y + dim.height;
+
+  if (y_max > HEIGHT) y_max = HEIGHT;
+  if (x_max > WIDTH ) x_max = WIDTH;
+
+  add_dirty_region(pos.x, pos.y, x_max, y_max);
+
+  if ((pos.x >= x_max) || (pos.y >= y_max)) return;
+
+  uint8_t * top    = frame_buffer + pos.y * line_size;
+  uint8_t * bottom = frame_buffer + (y_max - 1) * line_size;
+
+  if (pixel_resolution == PixelResolution::ONE_BIT) {
+    bool black = color == BLACK_COLOR;
+    fill_bits(top,    pos.x, x_max, black);
+    fill_bits(bottom, pos.x, x_max, black);
+    for (uint8_t * line = top; line <= bottom; line += line_size) {
+      put_bit(line, pos.x,     black);
+      put_bit(line, x_max - 1, black);
+    }
+  }
+  else {
+    uint8_t level = color >> 5;
+    fill_nibbles(top,    pos.x, x_max, level);
+    fill_nibbles(bottom, pos.x, x_max, level);
+    for (uint8_t * line = top; line <= bottom; line += line_size) {
+      put_nibble(line, pos.x,     level);
+      put_nibble(line, x_max - 1, level);
+    }
+  }
+}
+
+void
+Screen::colorize_region(
+  Dim      dim,
+  Pos      pos,
+  uint8_t  color)
+{
+  int16_t x_max = pos.x + dim.width;
+  int16_t y_max = pos.y + dim.height;
+
+  if (y_max > HEIGHT) y_max = HEIGHT;
+  if (x_max > WIDTH ) x_max = WIDTH;
+
+  add_dirty_region(pos.x, pos.y, x_max, y_max);
+
+  if (pos.x >= x_max) return;
+
+  uint8_t * line = frame_buffer + pos.y * line_size;
+
+  if (pixel_resolution == PixelResolution::ONE_BIT) {
+    bool black = color == BLACK_COLOR;
+    for (int j = pos.y; j < y_max; j++, line += line_size) fill_bits(line, pos.x, x_max, black);
+  }
+  else {
+    uint8_t level = color >> 5;
+    for (int j = pos.y; j < y_max; j++, line += line_size) fill_nibbles(line, pos.x, x_max, level);
+  }
+}
+
+void
+Screen::draw_glyph(
+  const unsigned char * bitmap_data,
+  Dim                   dim,
+  Pos                   pos,
+  uint16_t              pitch)
+{
+  int x_max = pos.x + dim.width;
+  int y_max = pos.y + dim.height;
+
+  if (y_max > HEIGHT) y_max = HEIGHT;
+  if (x_max > WIDTH ) x_max = WIDTH;
+
+  add_dirty_region(pos.x, pos.y, x_max, y_max);
+
+  if (pos.x >= x_max) return;
+
+  uint8_t * line = frame_buffer + pos.y * line_size;
+
+  if (pixel_resolution == PixelResolution::ONE_BIT) {
+
+    // Glyph bytes are or'ed into the frame buffer, shifted to the
+    // glyph position. The last byte of each row is masked to the
+    // visible width.
+
+    int     width = x_max - pos.x;
+    int     shift = pos.x & 7;
+    uint8_t last  = 0xFF << ((8 - (width & 7)) & 7);
+
+    for (int j = pos.y; j < y_max; j++, line += line_size, bitmap_data += pitch) {
+      uint8_t * dst = line + (pos.x >> 3);
+      for (int k = 0, count = (width + 7) >> 3; k < count; k++, dst++) {
+        uint8_t bits = bitmap_data[k];
+        if (k == (count - 1)) bits &= last;
+        if (bits == 0) continue;
+        dst[0] |= bits >> shift;
+        uint8_t spill = bits << (8 - shift);
+        if (spill != 0) dst[1] |= spill;
+      }
+    }
+  }
+  else {
+    for (int j = pos.y; j < y_max; j++, line += line_size, bitmap_data += pitch) {
+      const unsigned char * src = bitmap_data;
+      for (int i = pos.x; i < x_max; i++, src++) {
+        uint8_t v = (255 - *src) & 0xE0;
+        if (v != 0xE0) put_nibble(line, i, v >> 5);
+      }
+    }
+  }
+}
+
+void
+Screen::clear()
+{
+  add_dirty_region(0, 0, WIDTH, HEIGHT);
+  memset(frame_buffer, (pixel_resolution == PixelResolution::ONE_BIT) ? 0x00 : 0x77, line_size * HEIGHT);
+}
+
+void
+Screen::test()
+{
+  static int N = 0;
+
+  clear();
+
+  for (int r = 0; r < HEIGHT; r++) {
+    uint8_t * line = frame_buffer + r * line_size;
+    for (int c = 0; c < WIDTH; c++) {
+      if ((r + N) / 20 % 2 && (c + N) / 20 % 2) {
+        if (pixel_resolution == PixelResolution::ONE_BIT) put_bit(line, c, true);
+        else                                              put_nibble(line, c, 0);
+      }
+    }
+  }
+
+  N = (N + 1) % 100;
+
+  update();
+}
+
+void
+Screen::update(bool no_full)
+{
+  if (dirty_count == 0) return;
+
+  stats.update_count++;
+  for (int8_t i = 0; i < dirty_count; i++) {
+    stats.pixels_updated += (dirty_regions[i].x_max - dirty_regions[i].x_min) *
+                            (dirty_regions[i].y_max - dirty_regions[i].y_min);
+  }
+
+  dirty_count = 0;
+}
+
+bool
+Screen::save_pgm(const char * filename)
+{
+  FILE * f = fopen(filename, "wb");
+  if (f == nullptr) return false;
+
+  fprintf(f, "P5\n%d %d\n255\n", WIDTH, HEIGHT);
+
+  static uint8_t row[800];
+
+  for (int j = 0; j < HEIGHT; j++) {
+    const uint8_t * line = frame_buffer + j * line_size;
+    for (int i = 0; i < WIDTH; i++) {
+      if (pixel_resolution == PixelResolution::ONE_BIT) {
+        row[i] = (line[i >> 3] & (0x80 >> (i & 7))) ? 0 : 255;
+      }
+      else {
+        uint8_t level = (i & 1) ? (line[i >> 1] & 0x0F) : (line[i >> 1] >> 4);
+        row[i] = (level * 255) / 7;
+      }
+    }
+    fwrite(row, WIDTH, 1, f);
+  }
+
+  return fclose(f) == 0;
+}
+
+void
+Screen::setup_frame_buffer()
+{
+  free(frame_buffer);
+
+  line_size    = (pixel_resolution == PixelResolution::ONE_BIT) ? ((WIDTH + 7) >> 3) : ((WIDTH + 1) >> 1);
+  frame_buffer = (uint8_t *) allocate(line_size * HEIGHT);
+
+  if (frame_buffer == nullptr) {
+    std::cerr << "Unable to allocate the frame buffer." << std::endl;
+    std::abort();
+  }
+
+  dirty_count = 0;
+  clear();
+}
+
+void
+Screen::setup(PixelResolution resolution, Orientation orientation)
+{
+  set_orientation(orientation);
+  set_pixel_resolution(resolution, true);
+
+  stats = {};
+}
+
+void
+Screen::set_pixel_resolution(PixelResolution resolution, bool force)
+{
+  if (force || (pixel_resolution != resolution)) {
+    pixel_resolution = resolution;
+    setup_frame_buffer();
+  }
+}
+
+void
+Screen::set_orientation(Orientation orient)
+{
+  orientation = orient;
+  if ((orientation == Orientation::LEFT) || (orientation == Orientation::RIGHT)) {
+    WIDTH  = 600;
+    HEIGHT = 800;
+  }
+  else {
+    WIDTH  = 800;
+    HEIGHT = 600;
+  }
+  if (frame_buffer != nullptr) setup_frame_buffer();
+}
@@ -0,0 +1,122 @@
+// Copyright (c) 2021 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#pragma once
+
+#include "global.hpp"
+#include "non_copyable.hpp"
+
+#include <cinttypes>
+
+/**
+ * @brief Low level logical Screen display
+ *
+ * This class implements the low level methods required to paint
+ * on the display. This headless version paints into a memory frame
+ * buffer, without any window, to run the rendering code in tests and
+ * benchmarks (see tools/ui_bench.cpp). It is used in place of the GTK
+ * version by putting this folder before lib_linux/EPub_InkPlate/src in
+ * the include path.
+ *
+ * The frame buffer is in screen orientation. In 1-bit mode, each row is
+ * a sequence of bits, the leftmost pixel in the most significant bit, 1
+ * for black. In 3-bit mode, each row is a sequence of nibbles, the leftmost
+ * pixel in the high nibble, from 0 (black) to 7 (white).
+ *
+ * This is a singleton. It cannot be instanciated elsewhere. It is not
+ * instanciated in the heap. This is reinforced by the C++ construction
+ * below. It also cannot be copied through the NonCopyable derivation.
+ */
+
+class Screen : NonCopyable
+{
+  public:
+    static uint16_t WIDTH;
+    static uint16_t HEIGHT;
+    static constexpr int8_t   IDENT       =   99;
+    static constexpr uint16_t RESOLUTION  =  166;  ///< Pixels per inch
+    static constexpr uint8_t  BLACK_COLOR = 0x00;
+    static constexpr uint8_t  WHITE_COLOR = 0xFF;
+
+    enum class Orientation     : int8_t { LEFT, RIGHT, BOTTOM };
+    enum class PixelResolution : int8_t { ONE_BIT, THREE_BITS };
+
+    /**
+     * @brief Screen region modified since the last update
+     *
+     * The drawing methods record the regions they modify. Overlapping or
+     * touching regions are merged. When there are more than MAX_DIRTY_REGIONS
+     * of them, they are all merged in their bounding box.
+     */
+    struct Region {
+      int16_t x_min, y_min;
+      int16_t x_max, y_max;  ///< Excluded
+    };
+    static constexpr int8_t MAX_DIRTY_REGIONS = 8;
+
+    /**
+     * @brief Rendering counters
+     *
+     * Accumulated since the setup or the last reset_stats() call.
+     */
+    struct Stats {
+      uint32_t draw_count;      ///< Drawing methods calls on a visible area
+      uint64_t pixels_touched;  ///< Pixels covered by the drawing methods
+      uint32_t update_count;    ///< update() calls with something to show
+      uint64_t pixels_updated;  ///< Pixels in the dirty regions at update() time
+    };
+
+    void     draw_bitmap(const unsigned char * bitmap_data, Dim dim, Pos pos);
+    void      draw_glyph(const unsigned char * bitmap_data, Dim dim, Pos pos, uint16_t pitch);
+    void  draw_rectangle(Dim dim, Pos pos, uint8_t color);
+    void colorize_region(Dim dim, Pos pos, uint8_t color);
+    void           clear();
+    void          update(bool no_full = false); // Parameter only used by the InlPlate version. Only the dirty regions are accounted for.
+    void            test();
+
+    /**
+     * @brief Save the frame buffer content as a PGM (portable graymap) image
+     *
+     * @param filename The image file name.
+     * @return true The image was saved.
+     */
+    bool        save_pgm(const char * filename);
+
+  private:
+    static constexpr char const * TAG = "Screen";
+
+    static Screen singleton;
+    Screen() : frame_buffer(nullptr), line_size(0), dirty_count(0), stats() {};
+
+    uint8_t       * frame_buffer;
+    uint16_t        line_size;  ///< Bytes per row
+    PixelResolution pixel_resolution;
+    Orientation     orientation;
+    int8_t          dirty_count;
+    Region          dirty_regions[MAX_DIRTY_REGIONS];
+    Stats           stats;
+
+    void add_dirty_region(int16_t x_min, int16_t y_min, int16_t x_max, int16_t y_max);
+    void   setup_frame_buffer();
+
+  public:
+    static Screen &               get_singleton() noexcept { return singleton; }
+    void                                  setup(PixelResolution resolution,
+                                                Orientation     orientation);
+    void                   set_pixel_resolution(PixelResolution resolution, bool force = false);
+    void                        set_orientation(Orientation orient);
+    inline PixelResolution get_pixel_resolution() { return pixel_resolution; }
+    inline int8_t               get_dirty_count() { return dirty_count;      }
+    inline const Region *     get_dirty_regions() { return dirty_regions;    }
+    inline const uint8_t *     get_frame_buffer() { return frame_buffer;     }
+    inline uint16_t               get_line_size() { return line_size;        }
+    inline const Stats &              get_stats() { return stats;            }
+    inline void                     reset_stats() { stats = {};              }
+};
+
+#if __SCREEN__
+  Screen & screen = Screen::get_singleton();
+#else
+  extern Screen & screen;
+#endif
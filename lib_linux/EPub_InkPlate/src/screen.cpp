@@ -12,6 +12,7 @@
 
 #include <iomanip>
 #include <cstring>
+#include <algorithm>
 
 #define BYTES_PER_PIXEL 3
 
@@ -20,7 +21,6 @@ Screen Screen::singleton;
 uint16_t Screen::WIDTH;
 uint16_t Screen::HEIGHT;
 
-const uint8_t Screen::LUT1BIT[8] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
 
 void 
 free_pixels(guchar * pixels, gpointer data)
@@ -36,6 +36,48 @@ setrgb(guchar * a, int row, int col, int stride,
   a[p] = a[p+1] = a[p+2] = color;
 }
 
+void
+Screen::add_dirty_region(int16_t x_min, int16_t y_min, int16_t x_max, int16_t y_max)
+{
+  if (x_min < 0     ) x_min = 0;
+  if (y_min < 0     ) y_min = 0;
+  if (x_max > WIDTH ) x_max = WIDTH;
+  if (y_max > HEIGHT) y_max = HEIGHT;
+
+  if ((x_min >= x_max) || (y_min >= y_max)) return;
+
+  Region * region = nullptr;
+
+  for (int8_t i = 0; i < dirty_count; i++) {
+    if ((x_min <= dirty_regions[i].x_max) && (dirty_regions[i].x_min <= x_max) &&
+        (y_min <= dirty_regions[i].y_max) && (dirty_regions[i].y_min <= y_max)) {
+      region = &dirty_regions[i];
+      break;
+    }
+  }
+
+  if ((region == nullptr) && (dirty_count == MAX_DIRTY_REGIONS)) {
+    region = &dirty_regions[0];
+    for (int8_t i = 1; i < dirty_count; i++) {
+      region->x_min = std::min(region->x_min, dirty_regions[i].x_min);
+      region->y_min = std::min(region->y_min, dirty_regions[i].y_min);
+      region->x_max = std::max(region->x_max, dirty_regions[i].x_max);
+      region->y_max = std::max(region->y_max, dirty_regions[i].y_max);
+    }
+    dirty_count = 1;
+  }
+
+  if (region == nullptr) {
+    dirty_regions[dirty_count++] = { x_min, y_min, x_max, y_max };
+  }
+  else {
+    region->x_min = std::min(region->x_min, x_min);
+    region->y_min = std::min(region->y_min, y_min);
+    region->x_max = std::max(region->x_max, x_max);
+    region->y_max = std::max(region->y_max, y_max);
+  }
+}
+
 void 
 Screen::draw_bitmap(
   const unsigned char * bitmap_data, 
@@ -44,8 +86,7 @@ Screen::draw_bitmap(
 {
   if (bitmap_data == nullptr) return;
   
-  GdkPixbuf * pb = gtk_image_get_pixbuf(id.image);
-  guchar    * g  = gdk_pixbuf_get_pixels(pb);
+  guchar * g = gdk_pixbuf_get_pixels(id.pixbuf);
   
   if (pos.x < 0) pos.x = 0;
   if (pos.y < 0) pos.y = 0;
@@ -56,6 +97,8 @@ Screen::draw_bitmap(
   if (y_max > HEIGHT) y_max = HEIGHT;
   if (x_max > WIDTH ) x_max = WIDTH;
 
+  add_dirty_region(pos.x, pos.y, x_max, y_max);
+
   if (pixel_resolution == PixelResolution::ONE_BIT) {
     static int16_t err[601];
     int16_t error;
@@ -96,8 +139,7 @@ Screen::draw_rectangle(
   Pos      pos,
   uint8_t  color) //, bool show)
 {
-  GdkPixbuf * pb = gtk_image_get_pixbuf(id.image);
-  guchar    * g  = gdk_pixbuf_get_pixels(pb);
+  guchar * g = gdk_pixbuf_get_pixels(id.pixbuf);
   
   int16_t x_max = pos.x + dim.width;
   int16_t y_max = pos.y + dim.height;
@@ -105,13 +147,20 @@ Screen::draw_rectangle(
   if (y_max > HEIGHT) y_max = HEIGHT;
   if (x_max > WIDTH ) x_max = WIDTH;
 
-  for (int i = pos.x; i < x_max; i++) {
-    setrgb(g, pos.y, i, id.stride, color);
-    setrgb(g, y_max - 1, i, id.stride, color);
-  }
-  for (int j = pos.y; j < y_max; j++) {
-    setrgb(g, j, pos.x, id.stride, color);
-    setrgb(g, j, x_max - 1, id.stride, color);
+  add_dirty_region(pos.x, pos.y, x_max, y_max);
+
+  if ((pos.x >= x_max) || (pos.y >= y_max)) return;
+
+  int      span   = (x_max - pos.x) * BYTES_PER_PIXEL;
+  guchar * top    = g + pos.y * id.stride + pos.x * BYTES_PER_PIXEL;
+  guchar * bottom = g + (y_max - 1) * id.stride + pos.x * BYTES_PER_PIXEL;
+
+  memset(top,    color, span);
+  memset(bottom, color, span);
+
+  for (guchar * row = top; row <= bottom; row += id.stride) {
+    row[0] = row[1] = row[2] = color;
+    row[span - 3] = row[span - 2] = row[span - 1] = color;
   }
 }
 
@@ -121,8 +170,7 @@ Screen::colorize_region(
   Pos      pos,
   uint8_t  color)
 {
-  GdkPixbuf * pb = gtk_image_get_pixbuf(id.image);
-  guchar    * g  = gdk_pixbuf_get_pixels(pb);
+  guchar * g = gdk_pixbuf_get_pixels(id.pixbuf);
   
   int16_t x_max = pos.x + dim.width;
   int16_t y_max = pos.y + dim.height;
@@ -130,10 +178,18 @@ Screen::colorize_region(
   if (y_max > HEIGHT) y_max = HEIGHT;
   if (x_max > WIDTH ) x_max = WIDTH;
 
-  for (int j = pos.y; j < y_max; j++) {
-    for (int i = pos.x; i < x_max; i++) {
-      setrgb(g, j, i, id.stride, color);
-    }
+  add_dirty_region(pos.x, pos.y, x_max, y_max);
+
+  if (pos.x >= x_max) return;
+
+  // Red, green and blue are all set to the same level: each row of the
+  // region is a single byte span.
+
+  int      span = (x_max - pos.x) * BYTES_PER_PIXEL;
+  guchar * row  = g + pos.y * id.stride + pos.x * BYTES_PER_PIXEL;
+
+  for (int j = pos.y; j < y_max; j++, row += id.stride) {
+    memset(row, color, span);
   }
 }
 
@@ -144,8 +200,7 @@ Screen::draw_glyph(
   Pos                   pos,  
   uint16_t              pitch)
 {
-  GdkPixbuf * pb = gtk_image_get_pixbuf(id.image);
-  guchar    * g  = gdk_pixbuf_get_pixels(pb);
+  guchar * g = gdk_pixbuf_get_pixels(id.pixbuf);
 
   int x_max = pos.x + dim.width;
   int y_max = pos.y + dim.height;
@@ -153,29 +208,35 @@ Screen::draw_glyph(
   if (y_max > HEIGHT) y_max = HEIGHT;
   if (x_max > WIDTH ) x_max = WIDTH;
 
+  add_dirty_region(pos.x, pos.y, x_max, y_max);
+
+  guchar * row = g + pos.y * id.stride + pos.x * BYTES_PER_PIXEL;
+
   if (pixel_resolution == PixelResolution::ONE_BIT) {
-    for (int j = pos.y, q = 0; j < y_max; j++, q++) {
-      for (int i = pos.x, p = (q * pitch) << 3; i < x_max; i++, p++) {
-        // int v = (255 - bitmap_data[p]);
-        // if (v != 255) {
-        //   v &= 0xE0; // 8 levels of grayscale
-        //   setrgb(g, j, i, id.stride, v);
-        // }
-        uint8_t v = bitmap_data[p >> 3] & LUT1BIT[p & 7];
-        if (v) setrgb(g, j, i, id.stride, 0);
+    for (int j = pos.y; j < y_max; j++, row += id.stride, bitmap_data += pitch) {
+      const unsigned char * src = bitmap_data;
+      guchar              * dst = row;
+      for (int i = pos.x; i < x_max; src++) {
+        uint8_t bits = *src;
+        if (bits == 0) {
+          // Nothing to draw for these 8 pixels
+          i   += 8;
+          dst += 8 * BYTES_PER_PIXEL;
+          continue;
+        }
+        for (uint8_t mask = 0x80; mask && (i < x_max); mask >>= 1, i++, dst += BYTES_PER_PIXEL) {
+          if (bits & mask) dst[0] = dst[1] = dst[2] = 0;
+        }
       }
     }
   }
   else {
-    for (int j = pos.y, q = 0; j < y_max; j++, q++) {
-      for (int i = pos.x, p = q * pitch; i < x_max; i++, p++) {
-        // int v = (255 - bitmap_data[p]);
-        // if (v != 255) {
-        //   v &= 0xE0; // 8 levels of grayscale
-        //   setrgb(g, j, i, id.stride, v);
-        // }
-        uint8_t v = (255 - bitmap_data[p]) & 0xE0;
-        if (v != 0xE0) setrgb(g, j, i, id.stride, v);
+    for (int j = pos.y; j < y_max; j++, row += id.stride, bitmap_data += pitch) {
+      const unsigned char * src = bitmap_data;
+      guchar              * dst = row;
+      for (int i = pos.x; i < x_max; i++, src++, dst += BYTES_PER_PIXEL) {
+        uint8_t v = (255 - *src) & 0xE0;
+        if (v != 0xE0) dst[0] = dst[1] = dst[2] = v;
       }
     }
   }
@@ -184,8 +245,8 @@ Screen::draw_glyph(
 void 
 Screen::clear()
 {
-  GdkPixbuf * pb = gtk_image_get_pixbuf(id.image);
-  gdk_pixbuf_fill(pb, 0xFFFFFFFF); // clear to white
+  add_dirty_region(0, 0, WIDTH, HEIGHT);
+  gdk_pixbuf_fill(id.pixbuf, 0xFFFFFFFF); // clear to white
 }
 
 void 
@@ -193,11 +254,11 @@ Screen::test()
 {
   static int N = 0;
 
-  GdkPixbuf * pb = gtk_image_get_pixbuf(id.image);
+  add_dirty_region(0, 0, WIDTH, HEIGHT);
 
-  gdk_pixbuf_fill(pb, 0xFFFFFFFF); // clear to white
+  gdk_pixbuf_fill(id.pixbuf, 0xFFFFFFFF); // clear to white
 
-  guchar * g = gdk_pixbuf_get_pixels(pb);
+  guchar * g = gdk_pixbuf_get_pixels(id.pixbuf);
 
   for (int r = 0; r < id.rows; r++)
     for (int c = 0; c < id.cols; c++)
@@ -209,11 +270,50 @@ Screen::test()
   update();
 }
 
+// The drawing area is invalidated from the GTK main loop, one dirty region
+// at a time. GTK then only redraws these regions from the pixbuf.
+
+struct DirtyArea {
+  GtkWidget * area;
+  int         x, y, width, height;
+};
+
+static gboolean
+queue_draw_area(gpointer data)
+{
+  DirtyArea * dirty = (DirtyArea *) data;
+
+  gtk_widget_queue_draw_area(dirty->area, dirty->x, dirty->y, dirty->width, dirty->height);
+  delete dirty;
+
+  return FALSE;
+}
+
+static gboolean
+draw_area(GtkWidget * widget, cairo_t * cr, gpointer data)
+{
+  gdk_cairo_set_source_pixbuf(cr, (GdkPixbuf *) data, 0, 0);
+  cairo_paint(cr);
+
+  return FALSE;
+}
+
 void 
 Screen::update(bool no_full)
 {
-  gtk_image_set_from_pixbuf(GTK_IMAGE(id.image), gtk_image_get_pixbuf(id.image));
-  g_idle_add((GSourceFunc)gtk_widget_queue_draw,(void*)window);
+  for (int8_t i = 0; i < dirty_count; i++) {
+    DirtyArea * dirty = new DirtyArea;
+
+    dirty->area   = id.area;
+    dirty->x      = dirty_regions[i].x_min;
+    dirty->y      = dirty_regions[i].y_min;
+    dirty->width  = dirty_regions[i].x_max - dirty_regions[i].x_min;
+    dirty->height = dirty_regions[i].y_max - dirty_regions[i].y_min;
+
+    g_idle_add(queue_draw_area, dirty);
+  }
+
+  dirty_count = 0;
   
   // g_main_context_iteration(nullptr, false);
   // while (g_main_context_pending(nullptr)) {
@@ -248,7 +348,7 @@ Screen::setup(PixelResolution resolution, Orientation orientation)
     for (int c = 0; c < WIDTH; c++)
         setrgb(pixels, r, c, id.stride, 255);
 
-  GdkPixbuf *pb = gdk_pixbuf_new_from_data(
+  id.pixbuf = gdk_pixbuf_new_from_data(
     pixels,
     GDK_COLORSPACE_RGB, // colorspace
     0,                  // has_alpha
@@ -260,7 +360,9 @@ Screen::setup(PixelResolution resolution, Orientation orientation)
     nullptr             // destroy_fn_data
   );
 
-  id.image = GTK_IMAGE(gtk_image_new_from_pixbuf(pb));
+  id.area = gtk_drawing_area_new();
+  gtk_widget_set_size_request(id.area, WIDTH, HEIGHT);
+  g_signal_connect(id.area, "draw", G_CALLBACK(draw_area), id.pixbuf);
 
   window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
 
@@ -281,7 +383,7 @@ Screen::setup(PixelResolution resolution, Orientation orientation)
   select_button = gtk_button_new_with_label("Select"       );
     home_button = gtk_button_new_with_label("DClick-Select");
 
-  gtk_box_pack_start(GTK_BOX(vbox1), GTK_WIDGET(id.image     ), FALSE, FALSE, 0);
+  gtk_box_pack_start(GTK_BOX(vbox1), GTK_WIDGET(id.area      ), FALSE, FALSE, 0);
   gtk_box_pack_start(GTK_BOX(hbox1), GTK_WIDGET(up_button    ), FALSE, FALSE, 0);
   gtk_box_pack_start(GTK_BOX(hbox1), GTK_WIDGET(left_button  ), FALSE, TRUE,  0);
   gtk_box_pack_start(GTK_BOX(hbox1), GTK_WIDGET(right_button ), FALSE, TRUE,  0);
@@ -36,30 +36,47 @@ class Screen : NonCopyable
     enum class Orientation     : int8_t { LEFT, RIGHT, BOTTOM };
     enum class PixelResolution : int8_t { ONE_BIT, THREE_BITS };
 
+    /**
+     * @brief Screen region modified since the last update
+     * 
+     * The drawing methods record the regions they modify. Overlapping or
+     * touching regions are merged. When there are more than MAX_DIRTY_REGIONS
+     * of them, they are all merged in their bounding box.
+     */
+    struct Region {
+      int16_t x_min, y_min;
+      int16_t x_max, y_max;  ///< Excluded
+    };
+    static constexpr int8_t MAX_DIRTY_REGIONS = 8;
+
     void     draw_bitmap(const unsigned char * bitmap_data, Dim dim, Pos pos);
     void      draw_glyph(const unsigned char * bitmap_data, Dim dim, Pos pos, uint16_t pitch);
     void  draw_rectangle(Dim dim, Pos pos, uint8_t color);
     void colorize_region(Dim dim, Pos pos, uint8_t color);
     void           clear();
-    void          update(bool no_full = false); // Parameter only used by the InlPlate version
+    void          update(bool no_full = false); // Parameter only used by the InlPlate version. Only the dirty regions are redrawn.
     void            test();
 
   private:
     static constexpr char const * TAG = "Screen";
 
-    static const uint8_t LUT1BIT[8];
 
     static Screen singleton;
-    Screen() {};
+    Screen() : dirty_count(0) {};
 
     struct ImageData {
-      GtkImage * image;
+      GtkWidget * area;    ///< Drawing area showing the pixbuf
+      GdkPixbuf * pixbuf;
       int rows, cols, stride;
     };
 
     ImageData       id;
     PixelResolution pixel_resolution;
     Orientation     orientation;
+    int8_t          dirty_count;
+    Region          dirty_regions[MAX_DIRTY_REGIONS];
+
+    void add_dirty_region(int16_t x_min, int16_t y_min, int16_t x_max, int16_t y_max);
 
   public:
     static Screen &               get_singleton() noexcept { return singleton; }
@@ -68,6 +85,8 @@ class Screen : NonCopyable
     void                   set_pixel_resolution(PixelResolution resolution, bool force = false);
     void                        set_orientation(Orientation orient);
     inline PixelResolution get_pixel_resolution() { return pixel_resolution; }
+    inline int8_t               get_dirty_count() { return dirty_count;      }
+    inline const Region *     get_dirty_regions() { return dirty_regions;    }
     
     GtkWidget
       * window, 
@@ -97,6 +97,22 @@ AppController::key_event(EventMgr::KeyEvent key)
   }
 }
 
+bool
+AppController::idle()
+{
+  if (next_ctrl != Ctrl::NONE) return false;
+
+  switch (current_ctrl) {
+    case Ctrl::BOARD:     return game_controller.idle();
+    case Ctrl::OPTION:
+    case Ctrl::PROMOTION:
+    case Ctrl::NONE:
+    case Ctrl::LAST:      return false;
+  }
+
+  return false;
+}
+
 void
 AppController::going_to_deep_sleep()
 {
@@ -11,6 +11,8 @@
 #include "models/config.hpp"
 #include "logging.hpp"
 
+#include "chess_engine.hpp"
+
 #if CHESS_INKPLATE_BUILD
 
   #include "freertos/FreeRTOS.h"
@@ -113,11 +115,19 @@
     }     
   }
 
+  // Interrupt check of the chunked searches (see ChessEngine::set_interrupt_check())
+
+  static bool
+  key_waiting()
+  {
+    return uxQueueMessagesWaiting(touchpad_key_queue) > 0;
+  }
+
   EventMgr::KeyEvent 
-  EventMgr::get_key() 
+  EventMgr::get_key(uint32_t timeout_ms) 
   {
     KeyEvent key;
-    if (xQueueReceive(touchpad_key_queue, &key, pdMS_TO_TICKS(15E3))) {
+    if (xQueueReceive(touchpad_key_queue, &key, pdMS_TO_TICKS(timeout_ms))) {
       return key;
     }
     else {
@@ -176,8 +186,25 @@
   BUTTON_EVENT(select, "Select Clicked")
   BUTTON_EVENT(home,   "Home Clicked"  )
 
+  // Background work is done every half second while the application is idle.
+  // A chunked search done then stops as soon as an event is waiting.
+
+  static bool
+  key_waiting()
+  {
+    return gtk_events_pending();
+  }
+
+  static gboolean 
+  idle_work(gpointer data)
+  {
+    app_controller.idle();
+    return TRUE;
+  }
+
   void EventMgr::loop()
   {
+    g_timeout_add(500, idle_work, nullptr);
     gtk_main(); // never return
   }
 
@@ -188,17 +215,36 @@ EventMgr::set_orientation(Screen::Orientation orient)
 }
 
 #else
+  static inline int32_t 
+  now_ms() 
+  { 
+    return xTaskGetTickCount() * portTICK_PERIOD_MS; 
+  }
+
   void EventMgr::loop()
   {
+    // Background work is done in chunks during the 15 seconds the device
+    // stays awake after a key, keys being polled between chunks (a chunk
+    // stops as soon as a key is waiting). It does not keep the device
+    // awake: its progress is saved on the way to deep sleep.
+
+    int32_t awake_end = now_ms() + 15000;
+    bool    busy      = true;
+
     while (1) {
       EventMgr::KeyEvent key;
 
-      if ((key = get_key()) != KeyEvent::NONE) {
+      int32_t awake_left = awake_end - now_ms();
+
+      if ((key = get_key(busy ? 0 : std::max<int32_t>(awake_left, 0))) != KeyEvent::NONE) {
         LOG_D("Got key %d", (int)key);
         app_controller.key_event(key);
         ESP::show_heaps_info();
         return;
       }
+      else if (busy && (awake_left > 0)) {
+        busy = app_controller.idle();
+      }
       else {
         // Nothing received in 15 seconds, put the device in Light Sleep Mode.
         // After some delay, the device will then be put in Deep Sleep Mode, 
@@ -227,6 +273,11 @@ EventMgr::set_orientation(Screen::Orientation orient)
             inkplate_platform.deep_sleep();
           }
         }
+
+        // Awake again (or kept awake): background work can be resumed
+
+        awake_end = now_ms() + 15000;
+        busy      = true;
       }
     }
   }
@@ -235,6 +286,8 @@ EventMgr::set_orientation(Screen::Orientation orient)
 bool
 EventMgr::setup()
 {
+  chess_engine.set_interrupt_check(key_waiting);
+
   #if CHESS_LINUX_BUILD
     g_signal_connect(G_OBJECT(  screen.left_button), "clicked", G_CALLBACK(  left_clicked), (gpointer) screen.window);
     g_signal_connect(G_OBJECT( screen.right_button), "clicked", G_CALLBACK( right_clicked), (gpointer) screen.window);
@@ -9,6 +9,7 @@
 #include "viewers/board_viewer.hpp"
 #include "viewers/page.hpp"
 #include "viewers/msg_viewer.hpp"
+#include "models/game_analysis.hpp"
 
 #include "chess_engine_steps.hpp"
 
@@ -21,6 +22,7 @@
 #include <iomanip>
 #include <sstream>
 #include <fstream>
+#include <vector>
 
 static inline bool is_white_fig(int8_t fig) { return fig > 0; }
 static inline bool is_black_fig(int8_t fig) { return fig < 0; }
@@ -43,7 +45,7 @@ GameController::load()
 
   for (;;) {
     if (file.read(reinterpret_cast<char *>(&version), 1).fail()) break;
-    if (version != SAVED_GAME_FILE_VERSION) break;
+    if ((version != 1) && (version != SAVED_GAME_FILE_VERSION)) break;
 
     if (file.read(reinterpret_cast<char *>(&game_play_white), sizeof(game_play_white)).fail()) break;
     if (file.read(reinterpret_cast<char *>(&step_count     ), sizeof(step_count     )).fail()) break;
@@ -52,6 +54,17 @@ GameController::load()
       if (file.read(reinterpret_cast<char *>(&game_steps[i]), sizeof(Step)).fail()) break;
     }
 
+    // Version 2: game over indicator and post-game analysis progress
+
+    game_over = false;
+    game_analysis.reset();
+
+    if (version == 1) break;
+
+    if (file.read(reinterpret_cast<char *>(&game_over), sizeof(game_over)).fail()) break;
+    if (!game_analysis.load(file)) file.clear(); // Analysis will be restarted
+    chess_engine.load_checkpoint(MAIN_FOLDER "/search.save");
+
     break;
   }
 
@@ -92,6 +105,10 @@ GameController::save()
       if (file.write(reinterpret_cast<const char *>(&game_steps[i]), sizeof(Step)).fail()) break;
     }
 
+    if (file.write(reinterpret_cast<const char *>(&game_over), sizeof(game_over)).fail()) break;
+    game_analysis.save(file);
+    chess_engine.save_checkpoint(MAIN_FOLDER "/search.save");
+
     break;
   }
 
@@ -135,6 +152,7 @@ GameController::new_game(bool user_play_white)
   game_started = true;
 
   chess_engine.new_game();
+  game_analysis.reset();
 
   chess_engine.load_board_from_fen(
     "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq -"
@@ -375,6 +393,15 @@ GameController::enter()
     complete_user_move = false;
     complete_move(true);
   }
+  else if (analysis_requested) {
+    analysis_requested = false;
+    analyse();
+  }
+  else if (review_requested) {
+    review_requested = false;
+    reviewing        = true;
+    review(EventMgr::KeyEvent::NONE);
+  }
   else {
     if (msg.empty()) msg = "User play. Please make a move:";
 
@@ -386,6 +413,154 @@ GameController::enter()
   }
 }
 
+// Multi-PV analysis of the current position. The best lines are shown in
+// place of the moves list, until the board is redrawn.
+
+void
+GameController::analyse()
+{
+  if (game_over) {
+    board_viewer.show_board(
+      game_play_white,
+      cursor_pos, from_pos,
+      game_steps, game_play_number,
+      msg = "The game is over.");
+    return;
+  }
+
+  board_viewer.show_board(
+    game_play_white, Pos(-1, -1), Pos(-1, -1), 
+    game_steps, game_play_number,
+    msg = "Analysing the position.");
+
+  Position * pos = chess_engine.get_pos(0);
+
+  pos[0].white_move = game_play_white;
+
+  chess_engine.set_pv_count(ANALYSIS_LINES);
+  event_mgr.set_stay_on(true);
+  chess_engine.analyse_position(ANALYSIS_TIME);
+  event_mgr.set_stay_on(false);
+  chess_engine.set_pv_count(1);
+
+  std::vector<std::string> lines;
+  std::ostringstream       stream;
+
+  for (int i = 0; i < chess_engine.get_pv_found(); i++) {
+    const PrincipalVariation & pv = chess_engine.get_pv(i);
+
+    // Scores are shown from the white side perspective
+
+    int score = game_play_white ? pv.score : -pv.score;
+
+    stream.str(""); stream.clear();
+
+    if (i == 0) {
+      lines.push_back("Analysis, depth " + std::to_string(pv.depth) + ":");
+    }
+
+    stream << (i + 1) << ") ";
+    if      (pv.score >  9000) stream << (game_play_white ? "+M" : "-M") << ((10001 - pv.score) / 2);
+    else if (pv.score < -9000) stream << (game_play_white ? "-M" : "+M") << ((10001 + pv.score) / 2);
+    else stream << std::showpos << std::fixed << std::setprecision(2) << (score / 100.0) << std::noshowpos;
+    stream << ' ';
+
+    for (int j = 0; j < pv.length; j++) {
+      int ply = game_play_number + j;
+      if      ((ply & 1) == 0) stream << ((ply / 2) + 1) << '.';
+      else if (j == 0)         stream << ((ply / 2) + 1) << "...";
+      stream << chess_engine.step_to_str(pv.steps[j]) << ' ';
+    }
+
+    lines.push_back(stream.str());
+  }
+
+  msg = lines.empty() ? "No analysis available." : "User play. Please make a move:";
+
+  board_viewer.show_board(
+    game_play_white,
+    cursor_pos, from_pos,
+    game_steps, game_play_number,
+    msg, lines);
+}
+
+// Called while waiting for a key. Once the game is over, the post-game
+// analysis is done one search chunk at a time. The board is redrawn with
+// the annotations at the end of each analysis pass.
+
+bool
+GameController::idle()
+{
+  if (!game_over || (game_play_number == 0)) return false;
+
+  if (game_analysis.get_step_count() != game_play_number) {
+    game_analysis.start(game_play_number);
+  }
+
+  int8_t pass = game_analysis.get_pass();
+
+  if (!game_analysis.step(game_steps)) return false;
+
+  if (game_analysis.get_pass() != pass) {
+    msg = game_analysis.is_complete() ? "Game analysis completed." : "Game analysis refined.";
+
+    // While the moves are reviewed, the review layout is kept, the message
+    // being shown when returning to the game
+
+    if (reviewing) {
+      review(EventMgr::KeyEvent::NONE);
+    }
+    else {
+      board_viewer.show_board(
+        game_play_white,
+        cursor_pos, from_pos,
+        game_steps, game_play_number,
+        msg);
+    }
+  }
+
+  return true;
+}
+
+// Moves list review. The cursor keys page through the moves list, back in
+// the game with PREV, forward with NEXT, to its first or last page with the
+// double-click variants. SELECT returns to the game play with the last page
+// of the list shown.
+
+void
+GameController::review(EventMgr::KeyEvent key)
+{
+  switch (key) {
+    case EventMgr::KeyEvent::PREV:     board_viewer.scroll_moves(    1); break;
+    case EventMgr::KeyEvent::DBL_PREV: board_viewer.scroll_moves( 1000); break;
+    case EventMgr::KeyEvent::NEXT:     board_viewer.scroll_moves(   -1); break;
+    case EventMgr::KeyEvent::DBL_NEXT: board_viewer.scroll_moves(-1000); break;
+
+    case EventMgr::KeyEvent::SELECT:
+      reviewing = false;
+      board_viewer.show_last_moves();
+      board_viewer.show_board(
+        game_play_white, cursor_pos, from_pos, 
+        game_steps, game_play_number,
+        msg);
+      return;
+
+    case EventMgr::KeyEvent::DBL_SELECT:
+      reviewing = false;
+      board_viewer.show_last_moves();
+      app_controller.set_controller(AppController::Ctrl::OPTION);
+      return;
+
+    case EventMgr::KeyEvent::NONE:
+      break;
+  }
+
+  board_viewer.show_board(
+    game_play_white, Pos(-1, -1), Pos(-1, -1), 
+    game_steps, game_play_number,
+    "Moves review. Select to return to the game.");
+}
+
 void 
 GameController::leave(bool going_to_deep_sleep)
 {
@@ -395,6 +570,11 @@ GameController::leave(bool going_to_deep_sleep)
 void 
 GameController::key_event(EventMgr::KeyEvent key)
 {
+  if (reviewing) {
+    review(key);
+    return;
+  }
+
   switch (key) {
     case EventMgr::KeyEvent::PREV:
       if (game_play_white) cursor_pos.x = (cursor_pos.x == 0) ? 7 : cursor_pos.x - 1;
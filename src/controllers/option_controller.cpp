@@ -115,10 +115,26 @@ new_game_play_black()
   app_controller.set_controller(AppController::Ctrl::LAST);
 }
 
-static MenuViewer::MenuEntry menu[8] = {
+static void
+analyse_position()
+{
+  game_controller.request_analysis();
+  app_controller.set_controller(AppController::Ctrl::LAST);
+}
+
+static void
+review_moves()
+{
+  game_controller.request_review();
+  app_controller.set_controller(AppController::Ctrl::LAST);
+}
+
+static MenuViewer::MenuEntry menu[10] = {
   { MenuViewer::Icon::RETURN,      "Return to the chessboard",             CommonActions::return_to_last},
   { MenuViewer::Icon::W_KNIGHT,    "New game, play white",                 new_game_play_white          },
   { MenuViewer::Icon::B_KNIGHT,    "New game, play black",                 new_game_play_black          },
+  { MenuViewer::Icon::BOOK,        "Analysis of the current position",     analyse_position             },
+  { MenuViewer::Icon::BOOK_LIST,   "Review the moves list",                review_moves                 },
   { MenuViewer::Icon::MAIN_PARAMS, "Main parameters",                      main_parameters              },
   { MenuViewer::Icon::CHESS,       "Chess parameters",                     chess_parameters             },
 //{ MenuViewer::Icon::WIFI,        "WiFi Access to the games folder",      wifi_mode                     },
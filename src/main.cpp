@@ -102,6 +102,9 @@
       config.get(Config::Ident::ENGINE_TIME, &time_limit);
 
       chess_engine.setup(time_limit * 15);
+      chess_engine.load_nnue(MAIN_FOLDER "/engine.nnue");
+      chess_engine.open_analysis_cache(MAIN_FOLDER);
+      chess_engine.load_bitbases(MAIN_FOLDER "/bitbases");
 
       app_controller.start();
     }
@@ -184,6 +187,9 @@
       config.get(Config::Ident::ENGINE_TIME, &time_limit);
 
       chess_engine.setup(time_limit * 15);
+      chess_engine.load_nnue(MAIN_FOLDER "/engine.nnue");
+      chess_engine.open_analysis_cache(MAIN_FOLDER);
+      chess_engine.load_bitbases(MAIN_FOLDER "/bitbases");
 
       // exit(0)  // Used for some Valgrind tests
       app_controller.start();
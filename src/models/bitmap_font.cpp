@@ -0,0 +1,214 @@
+// Copyright (c) 2021 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#include "models/bitmap_font.hpp"
+#include "logging.hpp"
+#include "alloc.hpp"
+
+#include <cstring>
+#include <sys/stat.h>
+
+#if CHESS_LINUX_BUILD
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <unistd.h>
+#endif
+
+void
+BitmapFont::clear()
+{
+  if (buffer != nullptr) {
+    #if CHESS_LINUX_BUILD
+      munmap(buffer, size);
+    #else
+      free(buffer);
+    #endif
+  }
+  if (file != nullptr) {
+    fclose(file);
+    for (auto * table : glyph_tables) free((void *) table);
+  }
+  glyph_tables.clear();
+
+  buffer    = nullptr;
+  file      = nullptr;
+  header    = nullptr;
+  sizes     = nullptr;
+  last_size = nullptr;
+  size      = 0;
+}
+
+bool
+BitmapFont::load(const std::string & filename, uint16_t resolution)
+{
+  clear();
+
+  #if CHESS_LINUX_BUILD
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if ((fstat(fd, &st) != 0) || (st.st_size < (off_t) sizeof(BitmapFontHeader))) {
+      close(fd);
+      return false;
+    }
+
+    size   = st.st_size;
+    buffer = (uint8_t *) mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (buffer == MAP_FAILED) {
+      buffer = nullptr;
+      return false;
+    }
+  #else
+    if ((file = fopen(filename.c_str(), "rb")) == nullptr) return false;
+
+    struct stat st;
+    fstat(fileno(file), &st);
+    size = st.st_size;
+
+    // The header is read first, to get the sizes table length
+
+    BitmapFontHeader head;
+    if ((size < sizeof(BitmapFontHeader)) || (fread(&head, sizeof(head), 1, file) != 1)) {
+      clear();
+      return false;
+    }
+
+    size_t length = sizeof(BitmapFontHeader) + head.size_count * sizeof(BitmapFontSize);
+
+    if ((size < length) || ((buffer = (uint8_t *) allocate(length)) == nullptr)) {
+      clear();
+      return false;
+    }
+
+    fseek(file, 0, SEEK_SET);
+    if (fread(buffer, length, 1, file) != 1) {
+      clear();
+      return false;
+    }
+  #endif
+
+  header = (const BitmapFontHeader *) buffer;
+
+  size_t sizes_end = sizeof(BitmapFontHeader) + header->size_count * sizeof(BitmapFontSize);
+
+  bool ok = (memcmp(header->magic, "CIBF", 4) == 0) &&
+            (header->version == VERSION)            &&
+            (size >= sizes_end);
+
+  if (ok) {
+    const BitmapFontSize * s = (const BitmapFontSize *)(buffer + sizeof(BitmapFontHeader));
+    for (uint16_t i = 0; ok && (i < header->size_count); i++, s++) {
+      ok = (s->glyphs_offset + s->glyph_count * sizeof(BitmapFontGlyph)) <= size;
+    }
+  }
+
+  if (!ok) {
+    LOG_E("Invalid bitmap font file: %s", filename.c_str());
+    clear();
+    return false;
+  }
+
+  if (header->resolution != resolution) {
+    LOG_I("Bitmap font %s not rendered for this screen resolution.", filename.c_str());
+    clear();
+    return false;
+  }
+
+  sizes = (const BitmapFontSize *)(buffer + sizeof(BitmapFontHeader));
+
+  glyph_tables.resize(header->size_count, nullptr);
+  #if CHESS_LINUX_BUILD
+    for (uint16_t i = 0; i < header->size_count; i++) {
+      glyph_tables[i] = (const BitmapFontGlyph *)(buffer + sizes[i].glyphs_offset);
+    }
+  #endif
+
+  LOG_D("Bitmap font %s loaded, %d sizes.", filename.c_str(), header->size_count);
+
+  return true;
+}
+
+const BitmapFontSize *
+BitmapFont::get_size(int16_t glyph_size)
+{
+  if ((last_size != nullptr) && (last_size->glyph_size == glyph_size)) return last_size;
+
+  for (uint16_t i = 0; i < header->size_count; i++) {
+    if (sizes[i].glyph_size == glyph_size) return last_size = &sizes[i];
+  }
+
+  return nullptr;
+}
+
+const BitmapFontGlyph *
+BitmapFont::get_glyph(int16_t glyph_size, uint8_t bits, int32_t charcode)
+{
+  for (uint16_t i = 0; i < header->size_count; i++) {
+    if ((sizes[i].glyph_size == glyph_size) && (sizes[i].bits == bits)) {
+      #if CHESS_INKPLATE_BUILD
+        if (glyph_tables[i] == nullptr) {
+          size_t            length = sizes[i].glyph_count * sizeof(BitmapFontGlyph);
+          BitmapFontGlyph * table  = (BitmapFontGlyph *) allocate(length);
+          if (table == nullptr) return nullptr;
+          fseek(file, sizes[i].glyphs_offset, SEEK_SET);
+          if (fread(table, length, 1, file) != 1) {
+            free(table);
+            return nullptr;
+          }
+          glyph_tables[i] = table;
+        }
+      #endif
+
+      const BitmapFontGlyph * first = glyph_tables[i];
+      const BitmapFontGlyph * last  = first + sizes[i].glyph_count;
+
+      while (first < last) {
+        const BitmapFontGlyph * middle = first + ((last - first) >> 1);
+        if      (middle->charcode < charcode) first = middle + 1;
+        else if (middle->charcode > charcode) last  = middle;
+        else return middle;
+      }
+      return nullptr;
+    }
+  }
+
+  return nullptr;
+}
+
+bool
+BitmapFont::get_bitmap(const BitmapFontGlyph & glyph, uint8_t bits, uint8_t * bitmap)
+{
+  uint32_t length = bitmap_size(glyph.width, glyph.height, bits);
+
+  if ((glyph.bitmap_offset + length) > size) return false;
+
+  // 3-bit bitmaps are read at the end of the destination, then expanded
+  // in place, from the first pixel: the expansion never overtakes the
+  // packed bytes still to be read.
+
+  uint8_t * packed = (bits == 1) ? bitmap : bitmap + (glyph.width * glyph.height) - length;
+
+  #if CHESS_LINUX_BUILD
+    memcpy(packed, buffer + glyph.bitmap_offset, length);
+  #else
+    fseek(file, glyph.bitmap_offset, SEEK_SET);
+    if (fread(packed, length, 1, file) != 1) return false;
+  #endif
+
+  if (bits != 1) {
+    uint16_t row_size = (glyph.width + 1) >> 1;
+    for (uint16_t j = 0; j < glyph.height; j++) {
+      const uint8_t * src = packed + (j * row_size);
+      uint8_t       * dst = bitmap + (j * glyph.width);
+      for (uint16_t i = 0; i < glyph.width; i++) {
+        dst[i] = ((i & 1) ? (src[i >> 1] << 4) : src[i >> 1]) & 0xE0;
+      }
+    }
+  }
+
+  return true;
+}
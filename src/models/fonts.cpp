@@ -9,6 +9,8 @@
 #include "alloc.hpp"
 
 #include <algorithm>
+#include <cstring>
+#include <cstdio>
 
 static const char * font_names[7] = {
   "CASE",
@@ -60,8 +62,11 @@ bool Fonts::setup()
     std::string chess       = std::string(FONTS_FOLDER "/").append(font_names[i]).append("FONT.TTF");
     if (!add(ches, FaceStyle::NORMAL, chess)) return false;
   }
-  
-  return true;
+
+  // The drawings font is loaded now: the other fonts fall back to it when
+  // they cannot be loaded.
+
+  return get(0) != nullptr;
 }
 
 Fonts::~Fonts()
@@ -81,7 +86,7 @@ Fonts::clear(bool all)
     int i = 0;
     for (auto & entry : font_cache) {
       if (all || (i >= 5)) delete entry.font;
-      else entry.font->clear_cache();
+      else if (entry.font != nullptr) entry.font->clear_cache();
       i++;
     }
     font_cache.resize(all ? 0 : 5);
@@ -93,7 +98,7 @@ void
 Fonts::clear_glyph_caches()
 {
   for (auto & entry : font_cache) {
-    entry.font->clear_cache();
+    if (entry.font != nullptr) entry.font->clear_cache();
   }
 }
 
@@ -122,29 +127,60 @@ Fonts::add(const std::string & name,
         (font.style == style)) return true;
   }
 
+  FILE * file = fopen(filename.c_str(), "rb");
+  if (file == nullptr) {
+    LOG_E("Font file not found: %s", filename.c_str());
+    return false;
+  }
+
+  // TrueType, OpenType (CFF) or collection signature
+
+  uint8_t sig[4];
+  bool    ok = fread(sig, sizeof(sig), 1, file) == 1;
+  fclose(file);
+
+  if (!ok || ((memcmp(sig, "\x00\x01\x00\x00", 4) != 0) && (memcmp(sig, "OTTO", 4) != 0) &&
+              (memcmp(sig, "true", 4) != 0) && (memcmp(sig, "ttcf", 4) != 0))) {
+    LOG_E("Not a supported font file: %s", filename.c_str());
+    return false;
+  }
+
   FontEntry f;
-  if ((f.font = new TTF(filename))) {
-    if (f.font->ready()) {
-      f.name                    = name;
-      f.font->fonts_cache_index = font_cache.size();
-      f.style                   = style;
-      font_cache.push_back(f);
 
-      LOG_D("Font %s added to cache at index %d and style %d.",
-        f.name.c_str(), 
-        f.font->fonts_cache_index,
-        (int)f.style);
+  f.name     = name;
+  f.font     = nullptr;
+  f.style    = style;
+  f.filename = filename;
+  f.failed   = false;
+  font_cache.push_back(f);
+
+  LOG_D("Font %s registered in cache at index %d and style %d.",
+    f.name.c_str(), 
+    (int) font_cache.size() - 1,
+    (int)f.style);
+
+  return true;
+}
+
+bool
+Fonts::load(FontEntry & entry, int16_t index)
+{
+  LOG_D("Loading font %s from %s.", entry.name.c_str(), entry.filename.c_str());
+
+  if ((entry.font = new TTF(entry.filename))) {
+    if (entry.font->ready()) {
+      entry.font->fonts_cache_index = index;
       return true;
     }
-    else {
-      delete f.font;
-    }
+    LOG_E("Unable to load font %s.", entry.filename.c_str());
+    delete entry.font;
+    entry.font = nullptr;
   }
   else {
     LOG_E("Unable to allocate memory.");
-    // msg_viewer.out_of_memory("font allocation");
   }
 
+  entry.failed = true;
   return false;
 }
 
@@ -162,6 +198,8 @@ Fonts::add(const std::string & name,
 
   FontEntry f;
 
+  f.failed = false;
+
   if ((f.font = new TTF(buffer, size))) {
     if (f.font->ready()) {
       f.name                    = name;
@@ -0,0 +1,146 @@
+// Copyright (c) 2021 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#define __GAME_ANALYSIS__ 1
+#include "models/game_analysis.hpp"
+
+#include "logging.hpp"
+
+#include <algorithm>
+
+constexpr uint32_t GameAnalysis::budgets[];
+
+void
+GameAnalysis::reset()
+{
+  step_count = -1;
+  pass       =  0;
+  next_ply   =  0;
+}
+
+void
+GameAnalysis::start(int16_t count)
+{
+  step_count = std::min(count, MAX_PLIES);
+  pass       = 0;
+  next_ply   = 0;
+
+  for (int16_t i = 0; i <= step_count; i++) scores[i]      = NO_SCORE;
+  for (int16_t i = 0; i <  step_count; i++) annotations[i] = Annotation::NONE;
+
+  LOG_D("Analysis started for %d steps.", step_count);
+}
+
+// Same as GameController::replay(), up to ply.
+
+void
+GameAnalysis::set_position(Step * steps, int16_t ply)
+{
+  Position * pos = chess_engine.get_pos(0);
+
+  chess_engine.load_board_from_fen(
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq -"
+  );
+
+  pos[0].white_move = true;
+
+  for (int16_t step_idx = 0; step_idx < ply; step_idx++) {
+    chess_engine.move_step(0, steps[step_idx]);
+    chess_engine.move_pos (0, steps[step_idx]);
+
+    chess_engine.generate_steps(1);
+    pos[1].white_move = !pos[0].white_move;
+    pos[0]            =  pos[1];
+  }
+}
+
+// The loss of the step played at ply is the difference between the score
+// before the step and the score after it, both from the point of view of the
+// side playing it.
+
+void
+GameAnalysis::annotate(int16_t ply)
+{
+  if ((ply < 0) || (ply >= step_count)) return;
+  if ((scores[ply] == NO_SCORE) || (scores[ply + 1] == NO_SCORE)) return;
+
+  int before = std::clamp<int>( scores[ply    ], -SCORE_CLIP, SCORE_CLIP);
+  int after  = std::clamp<int>(-scores[ply + 1], -SCORE_CLIP, SCORE_CLIP);
+  int loss   = before - after;
+
+  if      (loss >= BLUNDER_LOSS   ) annotations[ply] = Annotation::BLUNDER;
+  else if (loss >= MISTAKE_LOSS   ) annotations[ply] = Annotation::MISTAKE;
+  else if (loss >= INACCURACY_LOSS) annotations[ply] = Annotation::INACCURACY;
+  else                              annotations[ply] = Annotation::NONE;
+}
+
+bool
+GameAnalysis::step(Step * steps)
+{
+  if (!is_started() || is_complete()) return false;
+
+  set_position(steps, next_ply);
+
+  chess_engine.set_chunk_time(CHUNK_TIME);
+  int score = chess_engine.analyse_position(budgets[pass]);
+  chess_engine.set_chunk_time(0);
+
+  if (chess_engine.is_search_interrupted()) {
+    set_position(steps, step_count);
+    return true;
+  }
+
+  scores[next_ply] = score;
+
+  LOG_D("Analysis pass %d, ply %d: %d", pass, next_ply, scores[next_ply]);
+
+  annotate(next_ply - 1);
+  annotate(next_ply    );
+
+  if (++next_ply > step_count) {
+    next_ply = 0;
+    pass++;
+  }
+
+  set_position(steps, step_count);
+
+  return true;
+}
+
+bool
+GameAnalysis::save(std::ofstream & file)
+{
+  for (;;) {
+    if (file.write(reinterpret_cast<const char *>(&step_count), sizeof(step_count)).fail()) break;
+    if (step_count < 0) break;
+
+    if (file.write(reinterpret_cast<const char *>(&pass       ), sizeof(pass       )).fail()) break;
+    if (file.write(reinterpret_cast<const char *>(&next_ply   ), sizeof(next_ply   )).fail()) break;
+    if (file.write(reinterpret_cast<const char *>( scores     ), sizeof(int16_t)    * (step_count + 1)).fail()) break;
+    if (file.write(reinterpret_cast<const char *>( annotations), sizeof(Annotation) *  step_count     ).fail()) break;
+    break;
+  }
+
+  return !file.fail();
+}
+
+bool
+GameAnalysis::load(std::ifstream & file)
+{
+  for (;;) {
+    if (file.read(reinterpret_cast<char *>(&step_count), sizeof(step_count)).fail()) break;
+    if (step_count < 0) break;
+    if (step_count > MAX_PLIES) { file.setstate(std::ios::failbit); break; }
+
+    if (file.read(reinterpret_cast<char *>(&pass       ), sizeof(pass       )).fail()) break;
+    if (file.read(reinterpret_cast<char *>(&next_ply   ), sizeof(next_ply   )).fail()) break;
+    if (file.read(reinterpret_cast<char *>( scores     ), sizeof(int16_t)    * (step_count + 1)).fail()) break;
+    if (file.read(reinterpret_cast<char *>( annotations), sizeof(Annotation) *  step_count     ).fail()) break;
+    break;
+  }
+
+  if (file.fail()) reset();
+
+  return !file.fail();
+}
@@ -5,16 +5,28 @@
 #define _TTF_ 1
 #include "models/ttf2.hpp"
 #include "viewers/msg_viewer.hpp"
+#include "viewers/page.hpp"
 
 #include "screen.hpp"
 #include "alloc.hpp"
 
 #include <iostream>
 #include <ostream>
+#include <cstring>
 #include <sys/stat.h>
 
+#if CHESS_LINUX_BUILD
+  #include <sys/mman.h>
+#endif
+
 FT_Library TTF::library{ nullptr };
 
+TTF * TTF::instances = nullptr;
+
+uint32_t TTF::cache_budget = TTF::DEFAULT_CACHE_BUDGET;
+uint32_t TTF::cache_bytes  = 0;
+uint32_t TTF::lru_clock    = 0;
+
 TTF::TTF(const std::string & filename)
 {
   face = nullptr;
@@ -27,9 +39,28 @@ TTF::TTF(const std::string & filename)
     }
   }
 
-  set_font_face_from_file(filename);
-  memory_font  = nullptr;
+  current_cache = nullptr;
+  memory_font   = nullptr;
+  #if CHESS_LINUX_BUILD
+    mapped_font = nullptr;
+    mapped_size = 0;
+  #endif
+
+  // A pre-rasterised version of the font may be found beside it. The font
+  // file itself is then opened only when required.
+
+  std::string bitmap_filename = filename.substr(0, filename.find_last_of('.')) + ".cibf";
+
+  if (bitmap_font.load(bitmap_filename, Screen::RESOLUTION)) {
+    face_filename = filename;
+  }
+  else {
+    set_font_face_from_file(filename);
+  }
   current_size = -1;
+
+  next_instance = instances;
+  instances     = this;
 }
 
 TTF::TTF(unsigned char * buffer, int32_t buffer_size)
@@ -43,53 +74,145 @@ TTF::TTF(unsigned char * buffer, int32_t buffer_size)
     }
   }
 
+  current_cache = nullptr;
+  memory_font   = nullptr;
+  #if CHESS_LINUX_BUILD
+    mapped_font = nullptr;
+    mapped_size = 0;
+  #endif
+
   set_font_face_from_memory(buffer, buffer_size);
   current_size = -1;
+
+  next_instance = instances;
+  instances     = this;
 }
 
 TTF::~TTF()
 {
   if (face != nullptr) clear_face();
+  clear_cache();
+  for (TTF ** font = &instances; *font != nullptr; font = &(*font)->next_instance) {
+    if (*font == this) {
+      *font = next_instance;
+      break;
+    }
+  }
 }
 
+// Remove the least recently used glyph sizes, from all fonts, until there is
+// room for size bytes in the budget.
+
 void
-TTF::add_buff_to_byte_pool()
+TTF::make_room(uint32_t size, const GlyphsCache * keep)
+{
+  uint16_t paint_count = page.get_paint_count();
+
+  while ((cache_bytes + size) > cache_budget) {
+    TTF         * owner  = nullptr;
+    GlyphsCache * oldest = nullptr;
+
+    for (TTF * font = instances; font != nullptr; font = font->next_instance) {
+      for (auto * cache : font->caches) {
+        if ((cache != keep) && (cache->paint_count != paint_count) &&
+            ((oldest == nullptr) || (cache->last_use < oldest->last_use))) {
+          oldest = cache;
+          owner  = font;
+        }
+      }
+    }
+
+    if (oldest == nullptr) break; // All sizes are in use for the current page
+
+    LOG_D("Removing glyphs of size %d from font %d cache.", oldest->glyph_size, owner->fonts_cache_index);
+    owner->remove_cache(oldest);
+  }
+}
+
+uint8_t * 
+TTF::byte_pool_alloc(GlyphsCache * cache, uint16_t size)
 {
-  BytePool * pool = (BytePool *) allocate(BYTE_POOL_SIZE);
+  size = (size + (sizeof(void *) - 1)) & ~(sizeof(void *) - 1); // Keep glyph structures aligned
+
+  if ((cache->byte_pool != nullptr) && ((cache->byte_pool_idx + size) <= BYTE_POOL_SIZE)) {
+    uint8_t * buff = &cache->byte_pool[cache->byte_pool_idx];
+    cache->byte_pool_idx += size;
+    return buff;
+  }
+
+  // Bitmaps larger than a pool get their own buffer. The current pool
+  // is kept for the following allocations.
+
+  uint16_t pool_size = (size > BYTE_POOL_SIZE) ? size : BYTE_POOL_SIZE;
+
+  make_room(pool_size, cache);
+
+  uint8_t * pool = (uint8_t *) allocate(pool_size);
   if (pool == nullptr) {
     LOG_E("Unable to allocated memory for bytes pool.");
     msg_viewer.out_of_memory("ttf pool allocation");
   }
-  byte_pools.push_front(pool);
 
-  byte_pool_idx = 0;
+  cache->byte_pools.push_front(pool);
+  cache->bytes += pool_size;
+  cache_bytes  += pool_size;
+
+  if (pool_size == BYTE_POOL_SIZE) {
+    cache->byte_pool     = pool;
+    cache->byte_pool_idx = size;
+  }
+
+  return pool;
 }
 
-uint8_t * 
-TTF::byte_pool_alloc(uint16_t size)
+TTF::GlyphsCache *
+TTF::get_cache(int16_t glyph_size)
 {
-  if (size > BYTE_POOL_SIZE) {
-    LOG_E("Byte Pool Size NOT BIG ENOUGH!!!");
-    std::abort();
-  }
-  if (byte_pools.empty() || (byte_pool_idx + size) > BYTE_POOL_SIZE) {
-    LOG_D("Adding new Byte Pool buffer.");
-    add_buff_to_byte_pool();
+  for (auto * cache : caches) {
+    if (cache->glyph_size == glyph_size) return cache;
   }
 
-  uint8_t * buff = &(*byte_pools.front())[byte_pool_idx];
-  byte_pool_idx += size;
+  make_room(sizeof(GlyphsCache), nullptr);
+
+  GlyphsCache * cache = new GlyphsCache;
+  if (cache == nullptr) msg_viewer.out_of_memory("glyphs cache allocation");
+
+  cache->glyph_size    = glyph_size;
+  cache->bytes         = sizeof(GlyphsCache);
+  cache->byte_pool     = nullptr;
+  cache->byte_pool_idx = 0;
+  std::fill(cache->direct, cache->direct + DIRECT_GLYPH_COUNT, nullptr);
+
+  cache_bytes += cache->bytes;
+  caches.push_front(cache);
+
+  return cache;
+}
+
+void
+TTF::remove_cache(GlyphsCache * cache)
+{
+  for (auto * buff : cache->byte_pools) free(buff);
 
-  return buff;
+  cache_bytes -= cache->bytes;
+  caches.remove(cache);
+  if (current_cache == cache) current_cache = nullptr;
+
+  delete cache;
 }
 
 void
 TTF::clear_face()
 {
   clear_cache();
-  if (face != nullptr) FT_Done_Face(face);
+  if (face != nullptr) FT_Done_Face(face); // Closes the font stream (ESP32)
   face = nullptr;
   free(memory_font);
+  memory_font = nullptr;
+  #if CHESS_LINUX_BUILD
+    if (mapped_font != nullptr) munmap(mapped_font, mapped_size);
+    mapped_font = nullptr;
+  #endif
   
   current_size = -1;
 }
@@ -97,19 +220,7 @@ TTF::clear_face()
 void
 TTF::clear_cache()
 {
-  for (auto const & entry : cache) {
-    for (auto const & glyph : entry.second) {
-      bitmap_glyph_pool.deleteElement(glyph.second);      
-    }
-  }
-
-  for (auto * buff : byte_pools) {
-    free(buff);
-  }
-  byte_pools.clear();
-  
-  cache.clear();
-  cache.reserve(50);
+  while (!caches.empty()) remove_cache(caches.front());
 }
 
 TTF::BitmapGlyph *
@@ -123,20 +234,60 @@ TTF::get_glyph_internal(int32_t charcode, int16_t glyph_size)
 {
   int error;
 
-  Glyphs::iterator git;
+  if (!ready()) return nullptr;
 
-  if (face == nullptr) return nullptr;
+  GlyphsCache * cache = ((current_cache != nullptr) && (current_cache->glyph_size == glyph_size)) ?
+                          current_cache : (current_cache = get_cache(glyph_size));
 
-  GlyphsCache::iterator cache_it = cache.find(glyph_size);
+  cache->last_use    = ++lru_clock;
+  cache->paint_count = page.get_paint_count();
 
-  bool found = (cache_it != cache.end()) &&
-               ((git = cache_it->second.find(charcode)) != cache_it->second.end());
+  BitmapGlyph * glyph;
 
-  if (found) {
-    return git->second;
+  if ((charcode >= 0) && (charcode < DIRECT_GLYPH_COUNT)) {
+    glyph = cache->direct[charcode];
   }
   else {
-    if (current_size != glyph_size) set_font_size(glyph_size);
+    Glyphs::iterator git = cache->others.find(charcode);
+    glyph = (git == cache->others.end()) ? nullptr : git->second;
+  }
+
+  if (glyph != nullptr) return glyph;
+
+  uint8_t bits = (screen.get_pixel_resolution() == Screen::PixelResolution::ONE_BIT) ? 1 : 3;
+
+  const BitmapFontGlyph * bitmap_glyph = bitmap_font.ready() ? 
+                                           bitmap_font.get_glyph(glyph_size, bits, charcode) : nullptr;
+
+  if (bitmap_glyph != nullptr) {
+
+    // Pre-rasterised glyph
+
+    glyph = (BitmapGlyph *) byte_pool_alloc(cache, sizeof(BitmapGlyph));
+
+    glyph->root       = this;
+    glyph->pitch      = BitmapFont::pitch(bitmap_glyph->width, bits);
+    glyph->dim.height = bitmap_glyph->height;
+    glyph->dim.width  = bitmap_glyph->width;
+    glyph->xoff       = bitmap_glyph->xoff;
+    glyph->yoff       = bitmap_glyph->yoff;
+    glyph->advance    = bitmap_glyph->advance;
+
+    int32_t size = glyph->pitch * glyph->dim.height;
+
+    if (size > 0) {
+      glyph->buffer = byte_pool_alloc(cache, size);
+      if (!bitmap_font.get_bitmap(*bitmap_glyph, bits, glyph->buffer)) {
+        LOG_E("Unable to read bitmap font glyph for charcode: %d", charcode);
+        return nullptr;
+      }
+    }
+    else {
+      glyph->buffer = nullptr;
+    }
+  }
+  else {
+    if (!use_face(glyph_size)) return nullptr;
 
     int glyph_index = FT_Get_Char_Index(face, charcode);
     if (glyph_index == 0) {
@@ -154,22 +305,10 @@ TTF::get_glyph_internal(int32_t charcode, int16_t glyph_size)
       }
     }
 
-    BitmapGlyph * glyph = bitmap_glyph_pool.newElement();
-
-    if (glyph == nullptr) {
-      LOG_E("Unable to allocate memory for glyph.");
-      msg_viewer.out_of_memory("glyph allocation");
-    }
-
     FT_GlyphSlot slot = face->glyph;
 
-    glyph->root       = this;
-    glyph->dim.width  = slot->metrics.width  >> 6;
-    glyph->dim.height = slot->metrics.height >> 6;
-
-
     if (face->glyph->format != FT_GLYPH_FORMAT_BITMAP) {
-      if (screen.get_pixel_resolution() == Screen::PixelResolution::ONE_BIT) {
+      if (bits == 1) {
         error = FT_Render_Glyph(face->glyph,            // glyph slot
                                 FT_RENDER_MODE_MONO);   // render mode
       }
@@ -183,6 +322,9 @@ TTF::get_glyph_internal(int32_t charcode, int16_t glyph_size)
       }
     }
 
+    glyph = (BitmapGlyph *) byte_pool_alloc(cache, sizeof(BitmapGlyph));
+
+    glyph->root       = this;
     glyph->pitch      = slot->bitmap.pitch;
     glyph->dim.height = slot->bitmap.rows;
     glyph->dim.width  = slot->bitmap.width;
@@ -190,7 +332,7 @@ TTF::get_glyph_internal(int32_t charcode, int16_t glyph_size)
     int32_t size = glyph->pitch * glyph->dim.height;
 
     if (size > 0) {
-      glyph->buffer = byte_pool_alloc(size);
+      glyph->buffer = byte_pool_alloc(cache, size);
 
       if (glyph->buffer == nullptr) {
         LOG_E("Unable to allocate memory for glyph.");
@@ -219,10 +361,32 @@ TTF::get_glyph_internal(int32_t charcode, int16_t glyph_size)
     //   " x:"  << glyph->xoff <<
     //   " y:"  << glyph->yoff <<
     //   " a:"  << glyph->advance << std::endl;
+  }
 
-    cache[current_size][charcode] = glyph;
-    return glyph;
+  if ((charcode >= 0) && (charcode < DIRECT_GLYPH_COUNT)) {
+    cache->direct[charcode] = glyph;
   }
+  else {
+    cache->others[charcode] = glyph;
+  }
+  
+  return glyph;
+}
+
+bool
+TTF::use_face(int16_t glyph_size)
+{
+  if ((face == nullptr) && !face_filename.empty()) {
+    std::string filename = face_filename;
+    face_filename.clear(); // A single attempt
+    LOG_D("Opening font %s for a size or glyph not in its bitmap font.", filename.c_str());
+    set_font_face_from_file(filename);
+  }
+
+  if (face == nullptr) return false;
+
+  if (current_size != glyph_size) set_font_size(glyph_size);
+  return true;
 }
 
 bool 
@@ -244,46 +408,86 @@ TTF::set_font_size(int16_t size)
   return true;
 }
 
+#if CHESS_INKPLATE_BUILD
+  // FreeType stream callbacks. A count of 0 is a seek request.
+
+  static unsigned long
+  font_stream_read(FT_Stream stream, unsigned long offset, unsigned char * buffer, unsigned long count)
+  {
+    FILE * file = (FILE *) stream->descriptor.pointer;
+
+    if (fseek(file, offset, SEEK_SET) != 0) return (count == 0) ? 1 : 0;
+    return (count == 0) ? 0 : fread(buffer, 1, count, file);
+  }
+
+  static void
+  font_stream_close(FT_Stream stream)
+  {
+    fclose((FILE *) stream->descriptor.pointer);
+    stream->descriptor.pointer = nullptr;
+  }
+#endif
+
 bool 
 TTF::set_font_face_from_file(const std::string font_filename)
 {
   LOG_D("set_font_face_from_file() ...");
 
+  if (face != nullptr) clear_face();
+
   FILE * font_file;
   if ((font_file = fopen(font_filename.c_str(), "r")) == nullptr) {
     LOG_E("set_font_face_from_file: Unable to open font file '%s'", font_filename.c_str());
     perror("System msg");
     return false;
   }
-  else {
-    uint8_t * buffer;
 
-    struct stat stat_buf;
-    fstat(fileno(font_file), &stat_buf);
-    int32_t length = stat_buf.st_size;
-    
-    LOG_D("Font File Length: %d", length);
+  struct stat stat_buf;
+  fstat(fileno(font_file), &stat_buf);
+  int32_t length = stat_buf.st_size;
 
-    buffer = (uint8_t *) allocate(length + 1);
+  LOG_D("Font File Length: %d", length);
 
-    if (buffer == nullptr) {
-      LOG_E("Unable to allocate font buffer: %d", (int32_t) (length + 1));
-      msg_viewer.out_of_memory("font buffer allocation");
-    }
-
-    if (fread(buffer, length, 1, font_file) != 1) {
-      LOG_E("set_font_face_from_file: Unable to read file content");
-      fclose(font_file);
-      free(buffer);
-      return false;
-    }
+  FT_Open_Args args;
+  memset(&args, 0, sizeof(args));
 
+  #if CHESS_LINUX_BUILD
+    mapped_font = mmap(nullptr, length, PROT_READ, MAP_SHARED, fileno(font_file), 0);
     fclose(font_file);
 
-    buffer[length] = 0;
-
-    return set_font_face_from_memory(buffer, length);
+    if (mapped_font == MAP_FAILED) {
+      LOG_E("set_font_face_from_file: Unable to map font file '%s'", font_filename.c_str());
+      mapped_font = nullptr;
+      return false;
+    }
+    mapped_size = length;
+
+    args.flags       = FT_OPEN_MEMORY;
+    args.memory_base = (const FT_Byte *) mapped_font;
+    args.memory_size = length;
+  #else
+    // The stream is closed by FreeType, when the face is done or if it
+    // cannot be opened.
+
+    memset(&font_stream, 0, sizeof(font_stream));
+    font_stream.size               = length;
+    font_stream.descriptor.pointer = font_file;
+    font_stream.read               = font_stream_read;
+    font_stream.close              = font_stream_close;
+
+    args.flags  = FT_OPEN_STREAM;
+    args.stream = &font_stream;
+  #endif
+
+  int error = FT_Open_Face(library, &args, 0, &face);
+  if (error) {
+    LOG_E("The font format is unsupported or is broken: %s", font_filename.c_str());
+    face = nullptr;
+    clear_face();
+    return false;
   }
+
+  return true;
 }
 
 bool 
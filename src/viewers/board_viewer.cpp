@@ -8,6 +8,7 @@
 
 #include "models/ttf2.hpp"
 #include "models/config.hpp"
+#include "models/game_analysis.hpp"
 #include "viewers/msg_viewer.hpp"
 
 #include "chess_engine.hpp"
@@ -19,6 +20,7 @@
 #include "screen.hpp"
 #include "alloc.hpp"
 
+#include <algorithm>
 #include <iomanip>
 #include <cstring>
 #include <iostream>
@@ -31,6 +33,10 @@ constexpr char white_on_black[] = "+PNBRQK";
 constexpr char black_on_white[] = " omvtwl";
 constexpr char black_on_black[] = "+OMVTWL";
 
+// Move annotations suffixes, as for GameAnalysis::Annotation values
+
+constexpr char const * annotation_suffix[] = { "", "?!", "?", "??" };
+
 constexpr char col_nbr[] = {
   '\350', '\351', '\352', '\353', '\354', '\355', '\356', '\357', '\0'
 };
@@ -72,72 +78,217 @@ BoardViewer::show_cursor(bool play_white,
   }
 }
 
-void
-BoardViewer::show_board(bool        play_white, 
-                        Pos         cursor_pos, 
-                        Pos         from_pos, 
-                        Step *      steps, 
-                        int         step_count, 
-                        std::string msg)
+// Character of the chess font showing figure f on a square
+
+static inline char
+square_char(signed char f, bool white_pos)
 {
-  Board * board = chess_engine.get_board();
+  if (f >= 0) return (white_pos) ? white_on_white[ f] : white_on_black[ f];
+  else        return (white_pos) ? black_on_white[-f] : black_on_black[-f];
+}
 
-  std::ostringstream stream;
+// Board location of the square shown at row, col (from the top left corner)
 
-  stream << "!\"\"\"\"\"\"\"\"#" << std::endl;
-  
-  bool white_pos = true;
-  int  board_idx;
+static inline int
+display_to_board_idx(bool play_white, int row, int col)
+{
+  return play_white ? (row * 8) + col : ((7 - row) * 8) + (7 - col);
+}
 
-  if (play_white) {
+// Text of the move at index idx in the game, as shown in the moves list
 
-    board_idx = 0;
+static std::string
+move_text(Step & step, int idx)
+{
+  std::string text;
 
-    for (int row = 7; row >= 0; row--) {
+  if ((idx & 1) == 0) text = std::to_string((idx / 2) + 1) + '.';
 
-      stream << row_nbr[row];
+  text += chess_engine.step_to_str(step);
+  text += annotation_suffix[(int) game_analysis.get_annotation(idx)];
 
-      for (int col = 0; col < 8; col++) {
-        signed char f = (*board)[board_idx];
+  if (step.check == CheckType::CHECKMATE) text += (idx & 1) ? " 0-1" : " 1-0";
 
-        if (f >= 0) stream << ((white_pos) ? white_on_white[ f] : white_on_black[ f]);
-        else        stream << ((white_pos) ? black_on_white[-f] : black_on_black[-f]);
-      
-        board_idx++;
-        white_pos = !white_pos;
-      }
+  return text;
+}
 
-      stream << '%' << std::endl;
-      white_pos = !white_pos;
+void
+BoardViewer::layout_moves(Step * steps, int step_count, Dim dim)
+{
+  TTF * font = fonts.get(MOVES_FONT_INDEX);
+
+  int16_t top   = 6 + dim.height - 20;
+  int16_t width = Screen::WIDTH - 5 - (5 + (9 * dim.width) + 15);
+
+  moves.page_lines = (Screen::HEIGHT + font->get_descender_height(MOVES_FONT_SIZE) - top) / 
+                     font->get_line_height(MOVES_FONT_SIZE);
+  if (moves.page_lines < 1) moves.page_lines = 1;
+
+  // First move that is not the same as when it was laid out. Annotations
+  // are updated by the game analysis after the moves were played.
+
+  int count = std::min<int>(step_count, moves.texts.size());
+  int first = 0;
+
+  if (width == moves.width) {
+    while ((first < count) &&
+           (memcmp(&steps[first], &moves.steps[first], sizeof(Step)) == 0) &&
+           (moves.annotations[first] == (int8_t) game_analysis.get_annotation(first))) {
+      first++;
     }
-    stream << '/' << col_nbr << ')';
   }
   else {
+    moves.width = width;
+  }
 
-    for (int row = 0; row < 8; row++) {
+  if ((first == step_count) && (first == (int) moves.texts.size())) return;
 
-      stream << row_nbr[row];
+  // Only the lines from the one where the first changed move is are laid
+  // out again. A move added at the end of the game continues the last line.
 
-      for (int col = 7; col >= 0; col--) {
-        board_idx = ((7 - row) * 8) + col;
+  bool new_line = false;
 
-        signed char f = (*board)[board_idx];
+  if (first < (int) moves.texts.size()) {
+    int16_t line = std::upper_bound(moves.line_first.begin(), moves.line_first.end(), first) - 
+                   moves.line_first.begin() - 1;
+    if (line < 0) line = 0;
 
-        if (f >= 0) stream << ((white_pos) ? white_on_white[ f] : white_on_black[ f]); 
-        else        stream << ((white_pos) ? black_on_white[-f] : black_on_black[-f]);
+    first = moves.line_first.empty() ? 0 : moves.line_first[line];
 
-        white_pos = !white_pos;
-      }
+    moves.lines.resize(line);
+    moves.line_first.resize(line);
+    new_line = true;
+  }
+
+  moves.steps.resize(first);
+  moves.annotations.resize(first);
+  moves.texts.resize(first);
+
+  int16_t changed_line = moves.lines.size();
+  if (!new_line && (changed_line > 0)) changed_line--;
+  if (changed_line < moves.changed_line) moves.changed_line = changed_line;
+
+  TTF::BitmapGlyph * glyph = font->get_glyph(' ', MOVES_FONT_SIZE);
+  int16_t space = (glyph == nullptr) ? 0 : glyph->advance;
+
+  for (int i = first; i < step_count; i++) {
+    moves.steps.push_back(steps[i]);
+    moves.annotations.push_back((int8_t) game_analysis.get_annotation(i));
+    moves.texts.push_back(move_text(steps[i], i));
+
+    Dim text_dim;
+    font->get_size(moves.texts.back().c_str(), &text_dim, MOVES_FONT_SIZE);
+
+    if (new_line || moves.lines.empty() || ((moves.last_width + space + text_dim.width) >= width)) {
+      moves.lines.push_back(moves.texts.back());
+      moves.line_first.push_back(i);
+      moves.last_width = text_dim.width;
+      new_line         = false;
+    }
+    else {
+      moves.lines.back() += ' ';
+      moves.lines.back() += moves.texts.back();
+      moves.last_width   += space + text_dim.width;
+    }
+  }
+
+  scroll_moves(0); // Keeps the page shown in the shortened list
+}
+
+// Lines of the moves list on the page shown. The last page ends with the
+// last line, the first one starts with the first line.
+
+void
+BoardViewer::moves_range(int16_t & top, int16_t & end)
+{
+  int16_t count = moves.lines.size();
+
+  end = count - (moves.page * moves.page_lines);
+  top = end - moves.page_lines;
+
+  if (top <= 0) {
+    top = 0;
+    end = std::min(count, moves.page_lines);
+  }
+}
+
+bool
+BoardViewer::scroll_moves(int16_t pages)
+{
+  int16_t count     = moves.lines.size();
+  int16_t last_page = ((count > 0) && (moves.page_lines > 0)) ? (count - 1) / moves.page_lines : 0;
+  int16_t new_page  = std::clamp<int16_t>(moves.page + pages, 0, last_page);
+
+  if (new_page == moves.page) return false;
+
+  moves.page = new_page;
+  return true;
+}
+
+void
+BoardViewer::show_moves(Page::Format & fmt, Dim dim, bool clear)
+{
+  Page::Format list_fmt = fmt;
+
+  list_fmt.font_index = MOVES_FONT_INDEX;
+  list_fmt.font_size  = MOVES_FONT_SIZE;
+
+  TTF   * font        = fonts.get(MOVES_FONT_INDEX);
+  int16_t line_height = font->get_line_height(MOVES_FONT_SIZE);
+
+  Pos pos;
+  pos.x = fmt.screen_left + 5 + (9 * dim.width) + 15;
+  pos.y = fmt.screen_top  + 6 +      dim.height  - 20;
+
+  int16_t top, end;
+  moves_range(top, end);
+
+  // When the same page is still shown, the lines above the first one that
+  // changed are kept, and the area is cleared from below the descenders of
+  // the line before it, down to the last line shown before or now.
+
+  int16_t first = top;
+
+  if (clear) {
+    int16_t last = moves.page_lines;
 
-      stream << '%' << std::endl;
-      white_pos = !white_pos;
+    if (top == shown.moves_top) {
+      last = std::max(end, shown.moves_end) - top;
+      if (moves.changed_line > top) {
+        first  = std::min(moves.changed_line, shown.moves_end);
+        pos.y += ((first - top) * line_height) - font->get_descender_height(MOVES_FONT_SIZE);
+      }
     }
 
-    stream << '/';
-    for (int col = 7; col >= 0; col--) stream << col_nbr[col];
-    stream << ')';
+    int16_t bottom = fmt.screen_top + 6 + dim.height - 20 + 
+                     (last * line_height) - font->get_descender_height(MOVES_FONT_SIZE);
+
+    page.clear_region(Dim(Screen::WIDTH - pos.x, bottom - pos.y), pos);
+
+    pos.y = fmt.screen_top + 6 + dim.height - 20 + ((first - top) * line_height);
+  }
+
+  for (int16_t line = first; line < end; line++) {
+    pos.y += line_height;
+    page.put_str_at(moves.lines[line], pos, list_fmt);
   }
 
+  shown.moves_top    = top;
+  shown.moves_end    = end;
+  moves.changed_line = moves.lines.size();
+}
+
+void
+BoardViewer::show_board(bool        play_white, 
+                        Pos         cursor_pos, 
+                        Pos         from_pos, 
+                        Step *      steps, 
+                        int         step_count, 
+                        std::string msg,
+                        const std::vector<std::string> & analysis)
+{
+  Board * board = chess_engine.get_board();
+
   int8_t font_index;
   config.get(Config::Ident::DEFAULT_FONT, &font_index);
   if ((font_index < 0) || (font_index > 7)) font_index = 0;
@@ -168,43 +319,182 @@ BoardViewer::show_board(bool        play_white,
 
   fmt.font_index = font_index;
 
-  page.set_compute_mode(Page::ComputeMode::DISPLAY);
-  page.start(fmt);
+  // When the screen still shows the last board drawn, only the squares,
+  // cursors, message and moves list lines that changed are redrawn.
 
-  Dim dim = page.add_text_raw(stream.str(), fmt);
-
-  if (cursor_pos.x >= 0) show_cursor(play_white, dim, cursor_pos, fmt, true);
-  if ((from_pos.x  >= 0) && (memcmp(&from_pos, &cursor_pos, sizeof(Pos)) != 0)) {
-    show_cursor(play_white, dim, from_pos, fmt, false);
+  if (shown.valid                                     &&
+      (shown.paint_count == page.get_paint_count())   &&
+      (shown.play_white  == play_white)               &&
+      (shown.font_index  == font_index)               &&
+      !shown.analysis && analysis.empty()) {
+    show_changes(fmt, cursor_pos, from_pos, msg, steps, step_count);
   }
+  else {
+    show_all(fmt, play_white, cursor_pos, from_pos, steps, step_count, msg, analysis);
+  }
+
+  std::memcpy(shown.board, *board, sizeof(Board));
+  shown.valid       = true;
+  shown.play_white  = play_white;
+  shown.font_index  = font_index;
+  shown.analysis    = !analysis.empty();
+  shown.cursor_pos  = cursor_pos;
+  shown.from_pos    = from_pos;
+  shown.msg         = msg;
+  shown.paint_count = page.get_paint_count();
+}
 
+void
+BoardViewer::show_msg(Page::Format & fmt, const std::string & msg)
+{
   if (!msg.empty()) {
-    fmt.font_index =  1;
-    fmt.font_size  = 12;
+    Page::Format msg_fmt = fmt;
+    
+    msg_fmt.font_index =  1;
+    msg_fmt.font_size  = 12;
 
     Pos pos;
-    pos.x = fmt.margin_left + fmt.screen_left + dim.width;
+    pos.x = fmt.margin_left + fmt.screen_left + shown.dim.width;
     pos.y = fmt.margin_top  + fmt.screen_top  + 30;
 
-    page.put_str_at(msg, pos, fmt);
+    page.put_str_at(msg, pos, msg_fmt);
+  }
+}
+
+void
+BoardViewer::show_changes(Page::Format & fmt, Pos cursor_pos, Pos from_pos, const std::string & msg,
+                          Step * steps, int step_count)
+{
+  Board * board = chess_engine.get_board();
+  Dim     dim   = shown.dim;
+  bool    dirty[64];
+
+  for (int board_idx = 0; board_idx < 64; board_idx++) {
+    dirty[board_idx] = (*board)[board_idx] != shown.board[board_idx];
   }
 
-  if (step_count > 0) {
-    stream.str(""); stream.clear();
+  // Squares where a cursor is added or removed. The y coordinate of a 
+  // cursor is its row from the bottom (row 1), as for show_cursor().
+
+  Pos cursors[4] = { shown.cursor_pos, shown.from_pos, cursor_pos, from_pos };
+  for (auto & cursor : cursors) {
+    if (cursor.x >= 0) dirty[((7 - cursor.y) * 8) + cursor.x] = true;
+  }
+
+  layout_moves(steps, step_count, dim);
+
+  int16_t moves_top, moves_end;
+  moves_range(moves_top, moves_end);
+
+  bool moves_changed = (moves_top          != shown.moves_top) ||
+                       (moves_end          != shown.moves_end) ||
+                       (moves.changed_line <  moves_end);
+
+  bool msg_changed = msg != shown.msg;
+  bool any         = msg_changed || moves_changed;
+
+  for (int board_idx = 0; board_idx < 64; board_idx++) any = any || dirty[board_idx];
+
+  if (!any) return;
+
+  page.set_compute_mode(Page::ComputeMode::DISPLAY);
+  page.start(fmt);
+
+  for (int row = 0; row < 8; row++) {
+    for (int col = 0; col < 8; col++) {
+      int board_idx = display_to_board_idx(shown.play_white, row, col);
+      if (!dirty[board_idx]) continue;
+
+      Pos pos;
+      pos.x = fmt.margin_left + fmt.screen_left + (dim.width  * (col + 1));
+      pos.y = fmt.margin_top  + fmt.screen_top  + (dim.height * (row + 1));
+
+      page.clear_region(dim, pos);
 
-    int first = 0;
-    if (step_count >= 50) {
-      first = step_count - ((step_count % 50) + 25);
+      pos.y += dim.height;
+      page.put_char_at(square_char((*board)[board_idx], ((row + col) & 1) == 0), pos, fmt);
     }
-    for (int i = first; i < step_count; i++) {
-      if ((i & 1) == 0) stream << ((i / 2) + 1) << '.';
-      stream << chess_engine.step_to_str(steps[i]) << ' ';
+  }
+
+  if (msg_changed) {
+    // The message is written over the top border of the board, which is
+    // redrawn after the message area is cleared.
+
+    TTF * font = fonts.get(1);
+    int16_t height = font->get_line_height(12) - font->get_descender_height(12);
+
+    Pos pos;
+    pos.x = fmt.margin_left + fmt.screen_left + dim.width;
+    pos.y = fmt.margin_top  + fmt.screen_top  + 30 - font->get_line_height(12);
+    
+    page.clear_region(Dim(Screen::WIDTH - pos.x, height), pos);
+
+    pos.x = fmt.margin_left + fmt.screen_left;
+    pos.y = fmt.margin_top  + fmt.screen_top  + dim.height;
+
+    for (const char * ch = "!\"\"\"\"\"\"\"\"#"; *ch; ch++) {
+      page.put_char_at(*ch, pos, fmt);
+      pos.x += dim.width;
     }
 
-    if (steps[step_count-1].check == CheckType::CHECKMATE) {
-      stream <<  ((step_count & 1) ? " 1-0" : " 0-1"); 
+    show_msg(fmt, msg);
+  }
+
+  if (moves_changed) show_moves(fmt, dim, true);
+
+  if (cursor_pos.x >= 0) show_cursor(shown.play_white, dim, cursor_pos, fmt, true);
+  if ((from_pos.x  >= 0) && (memcmp(&from_pos, &cursor_pos, sizeof(Pos)) != 0)) {
+    show_cursor(shown.play_white, dim, from_pos, fmt, false);
+  }
+
+  page.paint(false);
+}
+
+void
+BoardViewer::show_all(Page::Format & fmt,
+                      bool           play_white, 
+                      Pos            cursor_pos, 
+                      Pos            from_pos, 
+                      Step         * steps,
+                      int            step_count,
+                      const std::string & msg,
+                      const std::vector<std::string> & analysis)
+{
+  Board * board = chess_engine.get_board();
+
+  std::ostringstream stream;
+
+  stream << "!\"\"\"\"\"\"\"\"#" << std::endl;
+  
+  for (int row = 0; row < 8; row++) {
+
+    stream << row_nbr[play_white ? 7 - row : row];
+
+    for (int col = 0; col < 8; col++) {
+      stream << square_char((*board)[display_to_board_idx(play_white, row, col)], ((row + col) & 1) == 0);
     }
 
+    stream << '%' << std::endl;
+  }
+
+  stream << '/';
+  if (play_white) stream << col_nbr;
+  else for (int col = 7; col >= 0; col--) stream << col_nbr[col];
+  stream << ')';
+
+  page.set_compute_mode(Page::ComputeMode::DISPLAY);
+  page.start(fmt);
+
+  Dim dim = shown.dim = page.add_text_raw(stream.str(), fmt);
+
+  if (cursor_pos.x >= 0) show_cursor(play_white, dim, cursor_pos, fmt, true);
+  if ((from_pos.x  >= 0) && (memcmp(&from_pos, &cursor_pos, sizeof(Pos)) != 0)) {
+    show_cursor(play_white, dim, from_pos, fmt, false);
+  }
+
+  show_msg(fmt, msg);
+
+  if (!analysis.empty()) {
     fmt.font_index  =  1;
     fmt.font_size   = 10;
     fmt.margin_left =  5 + (9 * dim.width ) + 15;
@@ -212,9 +502,15 @@ BoardViewer::show_board(bool        play_white,
 
     page.set_limits(fmt);
 
-    page.new_paragraph(fmt);
-    page.add_text(stream.str(), fmt);
-    page.end_paragraph(fmt);
+    for (auto & line : analysis) {
+      page.new_paragraph(fmt);
+      page.add_text(line, fmt);
+      page.end_paragraph(fmt);
+    }
+  }
+  else {
+    layout_moves(steps, step_count, dim);
+    show_moves(fmt, dim, false);
   }
 
   #if CHESS_INKPLATE_BUILD
@@ -238,6 +534,5 @@ BoardViewer::show_board(bool        play_white,
     BatteryViewer::show();
   #endif
 
-
   page.paint();
-}
\ No newline at end of file
+}
@@ -30,18 +30,14 @@
 #include <string>
 #include <algorithm>
 
-static void
-no_mem()
-{
-  msg_viewer.out_of_memory("display list allocation");
-}
-
 Page::Page() :
   compute_mode(ComputeMode::DISPLAY), 
-  screen_is_full(false)
+  screen_is_full(false),
+  paint_count(0)
 {
-  clear_display_list();
-  clear_line_list();
+  display_list.reserve(DISPLAY_LIST_CAPACITY);
+  line_list.reserve(LINE_LIST_CAPACITY);
+  word_list.reserve(LINE_LIST_CAPACITY);
 }
 
 void 
@@ -51,21 +47,21 @@ Page::clean()
   clear_line_list();
 }
 
+// Entries are trivially destructible (an IMAGE entry doesn't own its bitmap):
+// clearing a list is done in constant time.
+
 void
 Page::clear_display_list()
 {
-  for (auto * entry: display_list) {
-    if (entry->command == DisplayListCommand::IMAGE) {
-      if (entry->kind.image_entry.image.bitmap) {
-        delete [] entry->kind.image_entry.image.bitmap;
-      }
-    }
-    display_list_entry_pool.deleteElement(entry);
-    //entry = nullptr;
-  }
   display_list.clear();
 }
 
+void
+Page::clear_line_list()
+{
+  line_list.clear();
+}
+
 // 00000000 -- 0000007F: 	0xxxxxxx
 // 00000080 -- 000007FF: 	110xxxxx 10xxxxxx
 // 00000800 -- 0000FFFF: 	1110xxxx 10xxxxxx 10xxxxxx
@@ -147,8 +143,7 @@ Page::put_str_at(const std::string & str, Pos pos, const Format & fmt)
     bool first = true;
     while (*s) {
       if ((glyph = font->get_glyph(to_unicode(&s, fmt.text_transform, first), fmt.font_size))) {
-        DisplayListEntry * entry = display_list_entry_pool.newElement();
-        if (entry == nullptr) no_mem();
+        DisplayListEntry * entry = &display_list.emplace_back();
         entry->command = DisplayListCommand::GLYPH;
         entry->kind.glyph_entry.glyph = glyph;
         entry->pos.x = pos.x + glyph->xoff;
@@ -162,8 +157,6 @@ Page::put_str_at(const std::string & str, Pos pos, const Format & fmt)
             LOG_E("Put_str_at with a too large location: %d %d", entry->pos.x, entry->pos.y);
           }
         #endif
-
-        display_list.push_front(entry);
       
         pos.x += glyph->advance;
       }
@@ -206,8 +199,7 @@ Page::put_str_at(const std::string & str, Pos pos, const Format & fmt)
     while (*s) {
       if ((glyph = font->get_glyph(to_unicode(&s, fmt.text_transform, first), fmt.font_size))) {
         
-        DisplayListEntry * entry = display_list_entry_pool.newElement();
-        if (entry == nullptr) no_mem();
+        DisplayListEntry * entry = &display_list.emplace_back();
 
         entry->command                = DisplayListCommand::GLYPH;
         entry->kind.glyph_entry.glyph = glyph;
@@ -222,8 +214,6 @@ Page::put_str_at(const std::string & str, Pos pos, const Format & fmt)
             LOG_E("Put_str_at with a too large location: %d %d", entry->pos.x, entry->pos.y);
           }
         #endif
-
-        display_list.push_front(entry);
       
         x += glyph->advance;
       }
@@ -240,8 +230,7 @@ Page::put_char_at(uint8_t ch, Pos pos, const Format & fmt)
   TTF * font = fonts.get(fmt.font_index);
 
   if ((glyph = font->get_glyph(ch, fmt.font_size))) {
-    DisplayListEntry * entry = display_list_entry_pool.newElement();
-    if (entry == nullptr) no_mem();
+    DisplayListEntry * entry = &display_list.emplace_back();
     entry->command                = DisplayListCommand::GLYPH;
     entry->kind.glyph_entry.glyph = glyph;
     entry->pos.x                  = pos.x + glyph->xoff;
@@ -255,11 +244,41 @@ Page::put_char_at(uint8_t ch, Pos pos, const Format & fmt)
         LOG_E("Put_char_at with a too large location: %d %d", entry->pos.x, entry->pos.y);
       }
     #endif
-
-    display_list.push_front(entry);
   }  
 }
 
+// Consecutive glyphs are sorted by screen band, such that painting them walks
+// the frame buffer in row order. Other entries (regions, highlights, images)
+// are kept in place as they may cover glyphs painted before them. The glyphs
+// of a page are mostly in order already: an insertion sort is cheap and
+// doesn't require any allocation. The order of glyphs in the same band is kept.
+
+void
+Page::sort_by_band()
+{
+  auto first = display_list.begin();
+
+  while (first != display_list.end()) {
+    if (first->command != DisplayListCommand::GLYPH) { first++; continue; }
+
+    auto last = first + 1;
+    while ((last != display_list.end()) && (last->command == DisplayListCommand::GLYPH)) {
+      int16_t band = last->pos.y / BAND_HEIGHT;
+      if (band < ((last - 1)->pos.y / BAND_HEIGHT)) {
+        DisplayListEntry entry = *last;
+        auto it = last;
+        do {
+          *it = *(it - 1);
+          it--;
+        } while ((it != first) && (band < ((it - 1)->pos.y / BAND_HEIGHT)));
+        *it = entry;
+      }
+      last++;
+    }
+    first = last;
+  }
+}
+
 void
 Page::paint(bool clear_screen, bool no_full, bool do_it)
 {
@@ -267,9 +286,10 @@ Page::paint(bool clear_screen, bool no_full, bool do_it)
   
   if (clear_screen) screen.clear();
 
-  display_list.reverse();
+  sort_by_band();
 
-  for (auto * entry : display_list) {
+  for (auto & e : display_list) {
+    DisplayListEntry * entry = &e;
     if (entry->command == DisplayListCommand::GLYPH) {
       if (entry->kind.glyph_entry.glyph != nullptr) {
         screen.draw_glyph(
@@ -312,9 +332,10 @@ Page::paint(bool clear_screen, bool no_full, bool do_it)
         entry->pos,
         Screen::BLACK_COLOR);
     }
-  };
+  }
 
   screen.update(no_full);
+  paint_count++;
 }
 
 void
@@ -462,20 +483,10 @@ Page::add_line(const Format & fmt, bool justifyable)
   // Get rid of space characters that are at the end of the line.
   // This is mainly required for the JUSTIFY alignment algo.
 
-  while (!line_list.empty()) {
-    if ((*(line_list.begin()))->pos.y > 0) {
-      DisplayListEntry * entry = *(line_list.begin());
-      if (entry->command == DisplayListCommand::IMAGE) {
-        if (entry->kind.image_entry.image.bitmap) delete [] entry->kind.image_entry.image.bitmap;
-      }
-      display_list_entry_pool.deleteElement(entry);
-      line_list.pop_front(); 
-    }
-    else break;
+  while (!line_list.empty() && (line_list.back().pos.y > 0)) {
+    line_list.pop_back(); 
   }
 
-  line_list.reverse();
-  
   if (!line_list.empty() && (compute_mode == ComputeMode::DISPLAY)) {
   
     if ((fmt.align == Align::JUSTIFY) && justifyable) {
@@ -483,17 +494,17 @@ Page::add_line(const Format & fmt, bool justifyable)
       int16_t loop_count = 0;
       while ((line_width < target_width) && (++loop_count < 50)) {
         bool at_least_once = false;
-        for (auto * entry : line_list) {
-          if (entry->pos.x > 0) {
+        for (auto & entry : line_list) {
+          if (entry.pos.x > 0) {
             at_least_once = true;
-            entry->pos.x++;
+            entry.pos.x++;
             if (++line_width >= target_width) break;
           }
         }
         if (!at_least_once) break; // No space available in line to justify the line
       }
       if (loop_count >= 50) {
-        for (auto * entry : line_list) entry->pos.x = 0;
+        for (auto & entry : line_list) entry.pos.x = 0;
       }
     }
     else {
@@ -506,7 +517,8 @@ Page::add_line(const Format & fmt, bool justifyable)
     }
   }
   
-  for (auto * entry : line_list) {
+  for (auto & e : line_list) {
+    DisplayListEntry * entry = &e;
     if (entry->command == DisplayListCommand::GLYPH) {
       int16_t x = entry->pos.x; // x may contains the calculated gap between words
       entry->pos.x = pos.x + entry->kind.glyph_entry.glyph->xoff;
@@ -534,12 +546,12 @@ Page::add_line(const Format & fmt, bool justifyable)
         show_fmt(fmt, "  -> ");
       }
     #endif
+  }
 
-    display_list.push_front(entry);
-  };
+  display_list.insert(display_list.end(), line_list.begin(), line_list.end());
   
   line_width = line_height = glyphs_height = 0;
-  clear_line_list();
+  line_list.clear(); // Image bitmaps are now owned by the display list
 
   para_indent = 0;
   top_margin  = 0;
@@ -552,8 +564,7 @@ Page::add_glyph_to_line(TTF::BitmapGlyph * glyph, int16_t glyph_size, TTF & font
 {
   if (is_space && (line_width == 0)) return;
 
-  DisplayListEntry * entry = display_list_entry_pool.newElement();
-  if (entry == nullptr) no_mem();
+  DisplayListEntry * entry = &line_list.emplace_back();
 
   entry->command = DisplayListCommand::GLYPH;
   entry->kind.glyph_entry.glyph = glyph;
@@ -562,8 +573,6 @@ Page::add_glyph_to_line(TTF::BitmapGlyph * glyph, int16_t glyph_size, TTF & font
   if (glyphs_height < glyph->root->get_line_height(glyph_size)) glyphs_height = glyph->root->get_line_height(glyph_size);
 
   line_width += (glyph->advance);
-
-  line_list.push_front(entry);
 }
 
 #define NEXT_LINE_REQUIRED_SPACE (pos.y + (fmt.line_height_factor * font->get_line_height(fmt.font_size)) - font->get_descender_height(fmt.font_size))
@@ -572,8 +581,6 @@ Page::add_glyph_to_line(TTF::BitmapGlyph * glyph, int16_t glyph_size, TTF & font
 bool
 Page::add_word(const char * word,  const Format & fmt)
 {
-  DisplayList the_list;
-
   TTF::BitmapGlyph * glyph;
   const char * str = word;
   int16_t height;
@@ -592,8 +599,9 @@ Page::add_word(const char * word,  const Format & fmt)
   int16_t width = 0;
   bool    first = true;
 
+  word_list.clear();
+
   while (*str) {
-    char code = *str;
     if ((glyph = font->get_glyph(to_unicode(&str, fmt.text_transform, first), fmt.font_size)) == nullptr) {
       glyph = font->get_glyph(' ', fmt.font_size);
     }
@@ -601,14 +609,11 @@ Page::add_word(const char * word,  const Format & fmt)
       width += glyph->advance;
       first  = false;
 
-      DisplayListEntry * entry = display_list_entry_pool.newElement();
-      if (entry == nullptr) no_mem();
+      DisplayListEntry * entry = &word_list.emplace_back();
 
       entry->command                = DisplayListCommand::GLYPH;
       entry->kind.glyph_entry.glyph = glyph;
       entry->pos.x = entry->pos.y   = 0;
-
-      the_list.push_front(entry);
       // LOG_D("Char: %d(%c), advance: %d", code, code, glyph->advance);
     }
   }
@@ -617,10 +622,6 @@ Page::add_word(const char * word,  const Format & fmt)
 
   if (width >= avail_width) {
     if (strncasecmp(word, "http", 4) == 0) {
-      for (auto * entry : the_list) {
-        display_list_entry_pool.deleteElement(entry);
-      }
-      the_list.clear();
       return add_word("[URL removed]", fmt);
     }
     else {
@@ -632,19 +633,16 @@ Page::add_word(const char * word,  const Format & fmt)
     add_line(fmt, true);
     screen_is_full = NEXT_LINE_REQUIRED_SPACE > max_y;
     if (screen_is_full) {
-      for (auto * entry : the_list) {
-        display_list_entry_pool.deleteElement(entry);
-      }
-      the_list.clear();
+      word_list.clear();
       return false;
     }
   }
 
-  line_list.splice_after(line_list.before_begin(), the_list);
+  line_list.insert(line_list.end(), word_list.begin(), word_list.end());
 
   if (glyphs_height < height) glyphs_height = height;
   line_width += width;
-  the_list.clear();
+  word_list.clear();
 
   return true;
 }
@@ -823,8 +821,7 @@ Page::add_text(std::string str, const Format & fmt)
 void 
 Page::put_highlight(Dim dim, Pos pos)
 {
-  DisplayListEntry * entry = display_list_entry_pool.newElement();
-  if (entry == nullptr) no_mem();
+  DisplayListEntry * entry = &display_list.emplace_back();
 
   entry->command               = DisplayListCommand::HIGHLIGHT;
   entry->kind.region_entry.dim = dim;
@@ -838,15 +835,12 @@ Page::put_highlight(Dim dim, Pos pos)
       LOG_E("put_highlight with a too large location: %d %d", entry->pos.x, entry->pos.y);
     }
   #endif
-
-  display_list.push_front(entry);
 }
 
 void 
 Page::clear_highlight(Dim dim, Pos pos)
 {
-  DisplayListEntry * entry = display_list_entry_pool.newElement();
-  if (entry == nullptr) no_mem();
+  DisplayListEntry * entry = &display_list.emplace_back();
 
   entry->command               = DisplayListCommand::CLEAR_HIGHLIGHT;
   entry->kind.region_entry.dim = dim;
@@ -860,15 +854,12 @@ Page::clear_highlight(Dim dim, Pos pos)
       LOG_E("Put_str_at with a too large location: %d %d", entry->pos.x, entry->pos.y);
     }
   #endif
-
-  display_list.push_front(entry);
 }
 
 void 
 Page::clear_region(Dim dim, Pos pos)
 {
-  DisplayListEntry * entry = display_list_entry_pool.newElement();
-  if (entry == nullptr) no_mem();
+  DisplayListEntry * entry = &display_list.emplace_back();
 
   entry->command               = DisplayListCommand::CLEAR_REGION;
   entry->kind.region_entry.dim = dim;
@@ -882,16 +873,13 @@ Page::clear_region(Dim dim, Pos pos)
       LOG_E("Put_str_at with a too large location: %d %d", entry->pos.x, entry->pos.y);
     }
   #endif
-
-  display_list.push_front(entry);
 }
 
 
 void 
 Page::set_region(Dim dim, Pos pos)
 {
-  DisplayListEntry * entry = display_list_entry_pool.newElement();
-  if (entry == nullptr) no_mem();
+  DisplayListEntry * entry = &display_list.emplace_back();
 
   entry->command               = DisplayListCommand::SET_REGION;
   entry->kind.region_entry.dim = dim;
@@ -905,8 +893,6 @@ Page::set_region(Dim dim, Pos pos)
       LOG_E("Put_str_at with a too large location: %d %d", entry->pos.x, entry->pos.y);
     }
   #endif
-
-  display_list.push_front(entry);
 }
 
 void
@@ -914,7 +900,8 @@ Page::show_display_list(const DisplayList & list, const char * title) const
 {
   #if DEBUGGING
     std::cout << title << std::endl;
-    for (auto * entry : list) {
+    for (auto & e : list) {
+      const DisplayListEntry * entry = &e;
       if (entry->command == DisplayListCommand::GLYPH) {
         std::cout << "GLYPH" <<
           " x:" << entry->pos.x <<
@@ -0,0 +1,414 @@
+// Chess-InkPlate chess engine
+//
+// Endgame bitbases generator (Linux)
+//
+// (c) 2021 - GPL-3.0
+//
+// Builds the win/draw/loss tables probed by the engine (see
+// chess_engine_bitbase.hpp for the format), using the engine move
+// generator:
+//
+//   bitbase_gen [-t threads] folder [NAME ...]
+//
+// e.g. "bitbase_gen /sdcard/chess/bitbases KRKP". The tables reached from
+// the requested ones through captures and promotions are built first, and
+// all are written to the folder. Without names, the KPK, KRK, KQK, KBNK
+// and KRKP tables are built.
+//
+// Each table is solved by successive passes over its positions, split
+// between threads. A position is won if a step reaches a position lost
+// for the opponent, lost if all steps reach positions won by the
+// opponent, and drawn if all steps reach known positions otherwise. The
+// passes stop when nothing changes anymore, the positions left being
+// drawn.
+
+#include "chess_engine.hpp"
+#include "chess_engine_bitbase.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Values during a table build, in addition to the WDL ones
+
+static const uint8_t UNKNOWN = 3;
+static const uint8_t INVALID = Bitbases::INVALID_VALUE;
+
+static const uint32_t CHUNK_SIZE = 4096;  // Positions taken at once by a thread
+
+static std::map<std::string, std::vector<uint8_t>> tables;  // Completed tables
+
+static int         thread_count;
+static std::string folder;
+
+// Table being built
+
+static std::string                       current_name;
+static std::unique_ptr<std::atomic<uint8_t>[]> current;
+static uint32_t                          current_count;
+
+static std::atomic<uint32_t> next_chunk;
+static std::atomic<uint32_t> changes;
+
+static bool
+parse_name(const std::string & name, std::vector<int8_t> & strong, std::vector<int8_t> & weak)
+{
+  static const char letters[] = " PNBRQ";
+
+  strong.clear();
+  weak.clear();
+
+  if ((name.length() < 2) || (name.length() > BITBASE_MAX_PIECES) || (name[0] != 'K')) return false;
+
+  std::vector<int8_t> * side = &strong;
+  for (std::size_t i = 1; i < name.length(); i++) {
+    if (name[i] == 'K') {
+      if (side == &weak) return false;
+      side = &weak;
+      continue;
+    }
+    const char * letter = (name[i] != ' ') ? strchr(letters, name[i]) : nullptr;
+    if ((letter == nullptr) || (*letter == 0)) return false;
+    side->push_back(letter - letters);
+  }
+
+  return side == &weak;
+}
+
+static std::string
+material_name(const std::vector<int8_t> & first, const std::vector<int8_t> & second)
+{
+  char name[8];
+  bool flipped;
+
+  Bitbases::material_name(first.data(), first.size(), second.data(), second.size(), name, flipped);
+  return name;
+}
+
+// Tables reached by a capture or a promotion
+
+static std::vector<std::string>
+dependencies(const std::string & name)
+{
+  std::vector<int8_t>      strong, weak;
+  std::vector<std::string> names;
+
+  parse_name(name, strong, weak);
+
+  for (int side = 0; side < 2; side++) {
+    std::vector<int8_t> & us   = (side == 0) ? strong : weak;
+    std::vector<int8_t> & them = (side == 0) ? weak   : strong;
+
+    for (std::size_t i = 0; i < us.size(); i++) {
+      int8_t fig = us[i];
+
+      us.erase(us.begin() + i);
+      names.push_back(material_name(us, them));
+      us.insert(us.begin() + i, fig);
+
+      if (fig == PAWN) {
+        for (int8_t promoted = KNIGHT; promoted <= QUEEN; promoted++) {
+          us[i] = promoted;
+          names.push_back(material_name(us, them));
+        }
+        us[i] = PAWN;
+      }
+    }
+  }
+
+  std::sort(names.begin(), names.end());
+  names.erase(std::unique(names.begin(), names.end()), names.end());
+  names.erase(std::remove(names.begin(), names.end(), "KK"), names.end());
+
+  return names;
+}
+
+// Board of a position index, in the table frame (white is the strong
+// side). false if the position cannot be met.
+
+static bool
+setup_position(const std::string & name, uint32_t index, Board & board, bool & white_move)
+{
+  int8_t squares[BITBASE_MAX_PIECES];
+  int    piece_count = name.length() - 2;
+  uint32_t idx       = index;
+
+  for (int i = piece_count - 1; i >= 0; i--) {
+    squares[i] = idx % 64;
+    idx       /= 64;
+  }
+
+  int8_t bk = idx % 64; idx /= 64;
+  int8_t wk = idx % 32; idx /= 32;
+
+  wk         = (wk / 4) * 8 + (wk % 4);
+  white_move = (idx == 0);
+
+  if ((wk == bk) ||
+      ((abs((wk >> 3) - (bk >> 3)) <= 1) && (abs((wk & 7) - (bk & 7)) <= 1))) return false;
+
+  std::memset(board, 0, sizeof(Board));
+  board[wk] =  KING;
+  board[bk] = -KING;
+
+  static const char letters[] = " PNBRQ";
+  int8_t sign = 1;
+  int    i    = 0;
+
+  for (std::size_t l = 1; l < name.length(); l++) {
+    if (name[l] == 'K') {
+      sign = -1;
+      continue;
+    }
+
+    int8_t sq  = squares[i++];
+    int8_t fig = strchr(letters, name[l]) - letters;
+
+    if (board[sq] != NO_FIG) return false;
+    if ((fig == PAWN) && ((sq < 8) || (sq >= 56))) return false;
+
+    board[sq] = sign * fig;
+  }
+
+  // Pieces of the same kind must be in ascending location order
+
+  return Bitbases::position_index(board, white_move, name.c_str(), false) == index;
+}
+
+// Value of a position reached by a step, from its side to move perspective
+
+static uint8_t
+child_value(const Board & board, bool white_move)
+{
+  char name[8];
+  bool flipped;
+
+  Bitbases::table_name(board, name, flipped);
+
+  if (strcmp(name, "KK") == 0) return (uint8_t) WDL::DRAW;
+
+  uint32_t index = Bitbases::position_index(board, white_move, name, flipped);
+
+  if (current_name == name) return current[index].load(std::memory_order_relaxed);
+
+  return tables.at(name)[index];
+}
+
+static uint8_t
+evaluate_position(const Board & board, bool white_move)
+{
+  chess_engine.set_board(board, white_move);
+  chess_engine.generate_steps(0);
+
+  Position * pos   = chess_engine.get_pos(0);
+  int        legal = 0;
+  int        known = 0;
+  int        wins  = 0;
+
+  for (int i = 0; i < pos->steps_count; i++) {
+    chess_engine.move_step(0, pos->steps[i]);
+
+    uint8_t value = UNKNOWN;
+    bool    check = white_move ? chess_engine.check_on_white_king() : chess_engine.check_on_black_king();
+
+    if (!check) {
+      legal++;
+      value = child_value(*chess_engine.get_board(), !white_move);
+    }
+
+    chess_engine.back_step(0, pos->steps[i]);
+
+    if (check) continue;
+    if (value == (uint8_t) WDL::LOSS) return (uint8_t) WDL::WIN;
+    if (value == (uint8_t) WDL::WIN ) wins++;
+    if (value != UNKNOWN            ) known++;
+  }
+
+  if (legal == 0)     return (uint8_t) (pos->check_on_table ? WDL::LOSS : WDL::DRAW);
+  if (wins  == legal) return (uint8_t) WDL::LOSS;
+  if (known == legal) return (uint8_t) WDL::DRAW;
+
+  return UNKNOWN;
+}
+
+static void
+run_pass(bool first)
+{
+  chess_engine.attach_thread();
+
+  for (;;) {
+    uint32_t start = next_chunk.fetch_add(CHUNK_SIZE);
+    if (start >= current_count) break;
+
+    uint32_t end   = std::min(start + CHUNK_SIZE, current_count);
+    uint32_t count = 0;
+
+    for (uint32_t index = start; index < end; index++) {
+      if (!first && (current[index].load(std::memory_order_relaxed) != UNKNOWN)) continue;
+
+      Board board;
+      bool  white_move;
+
+      if (first) {
+        if (!setup_position(current_name, index, board, white_move)) {
+          current[index].store(INVALID, std::memory_order_relaxed);
+          continue;
+        }
+
+        // The side not to move cannot be in check
+
+        chess_engine.set_board(board, white_move);
+        if (white_move ? chess_engine.check_on_black_king() : chess_engine.check_on_white_king()) {
+          current[index].store(INVALID, std::memory_order_relaxed);
+          continue;
+        }
+      }
+      else {
+        setup_position(current_name, index, board, white_move);
+      }
+
+      uint8_t value = evaluate_position(board, white_move);
+      if (value != UNKNOWN) count++;
+
+      current[index].store(value, std::memory_order_relaxed);
+    }
+
+    changes += count;
+  }
+
+  chess_engine.detach_thread();
+}
+
+static bool
+write_table(const std::string & name, const std::vector<uint8_t> & values)
+{
+  uint32_t position_count = values.size();
+  uint16_t block_count    = (position_count + BITBASE_BLOCK_SIZE - 1) / BITBASE_BLOCK_SIZE;
+
+  std::vector<uint32_t> offsets(block_count + 1);
+  std::vector<uint8_t>  data(position_count);
+
+  uint32_t size = Bitbases::compress(values.data(), position_count, offsets.data(), data.data());
+
+  BitbaseHeader header;
+  memcpy(header.magic, "CIBB", 4);
+  memset(header.name, 0, sizeof(header.name));
+  strcpy(header.name, name.c_str());
+  header.version        = BITBASE_VERSION;
+  header.block_count    = block_count;
+  header.position_count = position_count;
+
+  std::string filename = folder + "/" + name + ".cibb";
+  FILE * file = fopen(filename.c_str(), "wb");
+  if (file == nullptr) {
+    std::cerr << "Unable to create " << filename << std::endl;
+    return false;
+  }
+
+  bool ok = (fwrite(&header,        sizeof(header),   1,               file) == 1              ) &&
+            (fwrite(offsets.data(), sizeof(uint32_t), block_count + 1, file) == block_count + 1u) &&
+            (fwrite(data.data(),    1,                size,            file) == size           );
+
+  if (fclose(file) != 0) ok = false;
+
+  if (!ok) std::cerr << "Unable to write " << filename << std::endl;
+  else     std::cout << filename << ": " << size << " bytes." << std::endl;
+
+  return ok;
+}
+
+static bool
+generate(const std::string & name)
+{
+  for (auto & dependency : dependencies(name)) {
+    if ((tables.find(dependency) == tables.end()) && !generate(dependency)) return false;
+  }
+
+  current_name  = name;
+  current_count = Bitbases::position_count(name.c_str());
+  current.reset(new std::atomic<uint8_t>[current_count]);
+
+  for (uint32_t index = 0; index < current_count; index++) current[index] = UNKNOWN;
+
+  for (int pass = 0; ; pass++) {
+    next_chunk = 0;
+    changes    = 0;
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < thread_count; i++) threads.emplace_back(run_pass, pass == 0);
+    for (auto & thread : threads) thread.join();
+
+    std::cout << name << ": pass " << pass << ", " << changes << " positions resolved." << std::endl;
+
+    if (changes == 0) break;
+  }
+
+  std::vector<uint8_t> & values = tables[name];
+  uint32_t wdl_count[3] = { 0, 0, 0 };
+
+  values.resize(current_count);
+  for (uint32_t index = 0; index < current_count; index++) {
+    uint8_t value = current[index];
+    if (value == UNKNOWN) value = (uint8_t) WDL::DRAW;
+    values[index] = value;
+
+    // Strong side to move
+
+    if ((index < current_count / 2) && (value != INVALID)) wdl_count[value]++;
+  }
+
+  current_name.clear();
+  current.reset();
+
+  std::cout << name << ": strong side to move: "
+            << wdl_count[(int) WDL::WIN ] << " wins, "
+            << wdl_count[(int) WDL::DRAW] << " draws, "
+            << wdl_count[(int) WDL::LOSS] << " losses." << std::endl;
+
+  return write_table(name, values);
+}
+
+int
+main(int argc, char ** argv)
+{
+  thread_count = std::max(1U, std::thread::hardware_concurrency());
+
+  int arg = 1;
+  if ((argc > 2) && (strcmp(argv[1], "-t") == 0)) {
+    thread_count = std::max(1, atoi(argv[2]));
+    arg = 3;
+  }
+
+  if (arg >= argc) {
+    std::cerr << "Usage: " << argv[0] << " [-t threads] folder [NAME ...]" << std::endl;
+    return 1;
+  }
+
+  folder = argv[arg++];
+
+  std::vector<std::string> names;
+  if (arg < argc) names.assign(argv + arg, argv + argc);
+  else            names = { "KPK", "KRK", "KQK", "KBNK", "KRKP" };
+
+  for (auto & name : names) {
+    std::vector<int8_t> strong, weak;
+
+    if (!parse_name(name, strong, weak) || (strong.size() + weak.size() == 0)) {
+      std::cerr << "Invalid table name: " << name << std::endl;
+      return 1;
+    }
+
+    std::string normalized = material_name(strong, weak);
+    if ((tables.find(normalized) == tables.end()) && !generate(normalized)) return 1;
+  }
+
+  return 0;
+}
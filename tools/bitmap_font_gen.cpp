@@ -0,0 +1,255 @@
+// Copyright (c) 2021 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+// Bitmap fonts generator (Linux)
+//
+// Pre-renders the glyphs of fonts with FreeType, for the sizes used by the
+// application, in the format read by the BitmapFont class (see
+// include/models/bitmap_font.hpp):
+//
+//   bitmap_font_gen [-r resolution] [-s size,size,...] font_file ...
+//
+// e.g. "bitmap_font_gen SDCard/fonts/*.otf SDCard/fonts/*.TTF". Each font
+// gets a <font name>.cibf file beside it. Glyphs are rendered at the
+// screen resolution given (166 pixels per inch by default, 150 for the
+// Inkplate 10) for the characters 32 to 126 and 160 to 255, in both 1-bit
+// and 3-bit pixel resolutions, the same way the TTF class renders them.
+
+#include "models/bitmap_font.hpp"
+
+#include <ft2build.h>
+
+#include FT_FREETYPE_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static FT_Library library;
+
+struct Glyph {
+  BitmapFontGlyph      entry;
+  std::vector<uint8_t> bitmap;
+};
+
+struct Size {
+  BitmapFontSize     entry;
+  std::vector<Glyph> glyphs;
+};
+
+// Pixel value (0 = white, 255 = black) of a FreeType bitmap
+
+static uint8_t
+pixel(const FT_Bitmap & bitmap, int row, int col)
+{
+  const uint8_t * line = bitmap.buffer + row * bitmap.pitch;
+
+  if (bitmap.pixel_mode == FT_PIXEL_MODE_MONO) {
+    return (line[col >> 3] & (0x80 >> (col & 7))) ? 255 : 0;
+  }
+  else {
+    return line[col];
+  }
+}
+
+static bool
+render_size(FT_Face face, int16_t glyph_size, uint8_t bits, uint16_t resolution, Size & size)
+{
+  if (FT_Set_Char_Size(face, 0, glyph_size * 64, resolution, resolution)) {
+    std::cerr << "Unable to set font size " << glyph_size << std::endl;
+    return false;
+  }
+
+  memset(&size.entry, 0, sizeof(size.entry));
+
+  size.entry.glyph_size  = glyph_size;
+  size.entry.bits        = bits;
+  size.entry.line_height = face->size->metrics.height    >> 6;
+  size.entry.descender   = face->size->metrics.descender >> 6;
+  size.entry.em_width    = face->size->metrics.x_ppem;
+  size.entry.em_height   = face->size->metrics.y_ppem;
+
+  for (int32_t charcode = 32; charcode < 256; charcode++) {
+    if ((charcode > 126) && (charcode < 160)) continue;
+
+    int glyph_index = FT_Get_Char_Index(face, charcode);
+    if (glyph_index == 0) continue;
+
+    if (FT_Load_Glyph(face, glyph_index, FT_LOAD_DEFAULT)) continue;
+
+    FT_GlyphSlot slot = face->glyph;
+
+    if (slot->format != FT_GLYPH_FORMAT_BITMAP) {
+      if (FT_Render_Glyph(slot, (bits == 1) ? FT_RENDER_MODE_MONO : FT_RENDER_MODE_NORMAL)) continue;
+    }
+
+    Glyph glyph;
+
+    glyph.entry.charcode      = charcode;
+    glyph.entry.width         = slot->bitmap.width;
+    glyph.entry.height        = slot->bitmap.rows;
+    glyph.entry.xoff          =  slot->bitmap_left;
+    glyph.entry.yoff          = -slot->bitmap_top;
+    glyph.entry.advance       =  slot->advance.x >> 6;
+    glyph.entry.bitmap_offset = 0;
+
+    glyph.bitmap.resize(BitmapFont::bitmap_size(glyph.entry.width, glyph.entry.height, bits), 0);
+
+    uint16_t row_size = (glyph.entry.height == 0) ? 0 : (glyph.bitmap.size() / glyph.entry.height);
+
+    for (int j = 0; j < glyph.entry.height; j++) {
+      uint8_t * row = &glyph.bitmap[j * row_size];
+      for (int i = 0; i < glyph.entry.width; i++) {
+        uint8_t v = pixel(slot->bitmap, j, i);
+        if (bits == 1) {
+          if (v & 0x80) row[i >> 3] |= 0x80 >> (i & 7);
+        }
+        else {
+          row[i >> 1] |= (i & 1) ? ((v & 0xE0) >> 4) : (v & 0xE0);
+        }
+      }
+    }
+
+    size.glyphs.push_back(glyph);
+  }
+
+  size.entry.glyph_count = size.glyphs.size();
+
+  return true;
+}
+
+static bool
+generate(const std::string & font_filename, const std::vector<int16_t> & glyph_sizes, uint16_t resolution)
+{
+  FT_Face face;
+
+  if (FT_New_Face(library, font_filename.c_str(), 0, &face)) {
+    std::cerr << "Unable to load font " << font_filename << std::endl;
+    return false;
+  }
+
+  std::vector<Size> sizes;
+
+  for (auto glyph_size : glyph_sizes) {
+    for (uint8_t bits : { 1, 3 }) {
+      Size size;
+      if (!render_size(face, glyph_size, bits, resolution, size)) {
+        FT_Done_Face(face);
+        return false;
+      }
+      sizes.push_back(size);
+    }
+  }
+
+  FT_Done_Face(face);
+
+  // Offsets
+
+  uint32_t offset = sizeof(BitmapFontHeader) + sizes.size() * sizeof(BitmapFontSize);
+
+  for (auto & size : sizes) {
+    size.entry.glyphs_offset = offset;
+    offset += size.glyphs.size() * sizeof(BitmapFontGlyph);
+  }
+
+  for (auto & size : sizes) {
+    for (auto & glyph : size.glyphs) {
+      glyph.entry.bitmap_offset = offset;
+      offset += glyph.bitmap.size();
+    }
+  }
+
+  // Output
+
+  BitmapFontHeader header;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "CIBF", 4);
+  header.version    = BitmapFont::VERSION;
+  header.resolution = resolution;
+  header.size_count = sizes.size();
+
+  std::string filename = font_filename.substr(0, font_filename.find_last_of('.')) + ".cibf";
+
+  FILE * file = fopen(filename.c_str(), "wb");
+  if (file == nullptr) {
+    std::cerr << "Unable to create " << filename << std::endl;
+    return false;
+  }
+
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+  for (auto & size : sizes) {
+    ok = ok && (fwrite(&size.entry, sizeof(size.entry), 1, file) == 1);
+  }
+  for (auto & size : sizes) {
+    for (auto & glyph : size.glyphs) {
+      ok = ok && (fwrite(&glyph.entry, sizeof(glyph.entry), 1, file) == 1);
+    }
+  }
+  for (auto & size : sizes) {
+    for (auto & glyph : size.glyphs) {
+      ok = ok && (glyph.bitmap.empty() || (fwrite(glyph.bitmap.data(), glyph.bitmap.size(), 1, file) == 1));
+    }
+  }
+
+  ok = (fclose(file) == 0) && ok;
+
+  if (!ok) {
+    std::cerr << "Unable to write " << filename << std::endl;
+    return false;
+  }
+
+  std::cout << filename << ": " << offset << " bytes." << std::endl;
+
+  return true;
+}
+
+static void
+usage()
+{
+  std::cerr << "Usage: bitmap_font_gen [-r resolution] [-s size,size,...] font_file ..." << std::endl;
+  exit(1);
+}
+
+int
+main(int argc, char ** argv)
+{
+  uint16_t             resolution  = 166;
+  std::vector<int16_t> glyph_sizes = { 9, 10, 12, 16, 24 };
+
+  int arg = 1;
+
+  for (; (arg < argc) && (argv[arg][0] == '-'); arg++) {
+    if ((strcmp(argv[arg], "-r") == 0) && (arg + 1 < argc)) {
+      resolution = atoi(argv[++arg]);
+    }
+    else if ((strcmp(argv[arg], "-s") == 0) && (arg + 1 < argc)) {
+      glyph_sizes.clear();
+      for (char * s = strtok(argv[++arg], ","); s != nullptr; s = strtok(nullptr, ",")) {
+        glyph_sizes.push_back(atoi(s));
+      }
+    }
+    else {
+      usage();
+    }
+  }
+
+  if ((arg >= argc) || (resolution == 0) || glyph_sizes.empty()) usage();
+
+  if (FT_Init_FreeType(&library)) {
+    std::cerr << "Unable to initialize FreeType." << std::endl;
+    return 1;
+  }
+
+  bool ok = true;
+  for (; arg < argc; arg++) ok = generate(argv[arg], glyph_sizes, resolution) && ok;
+
+  FT_Done_FreeType(library);
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,13 @@
+#!/bin/sh
+#
+# This script is used to build the bitmap fonts generator (Linux)
+#
+# Usage, from the project folder: tools/bld_bitmap_font_gen.sh
+#
+
+g++ -std=gnu++17 -O2 -Wall \
+    -DCHESS_LINUX_BUILD=1 -DCHESS_INKPLATE_BUILD=0 \
+    -Iinclude_global -Iinclude -Ilib/tools \
+    $(pkg-config --cflags freetype2) \
+    tools/bitmap_font_gen.cpp \
+    -o tools/bitmap_font_gen $(pkg-config --libs freetype2)
@@ -0,0 +1,12 @@
+#!/bin/sh
+#
+# This script is used to build the self-play match runner (Linux)
+#
+# Usage, from the project folder: tools/bld_selfplay.sh
+#
+
+g++ -std=gnu++17 -O2 -Wall \
+    -DCHESS_LINUX_BUILD=1 -DCHESS_INKPLATE_BUILD=0 \
+    -Iinclude_global -Ilib/tools -Ilib/chess-engine \
+    lib/chess-engine/*.cpp tools/selfplay.cpp \
+    -o tools/selfplay -lpthread
@@ -0,0 +1,21 @@
+#!/bin/sh
+#
+# This script is used to build the user interface rendering benchmark,
+# using the headless screen (Linux)
+#
+# Usage, from the project folder: tools/bld_ui_bench.sh
+#
+
+g++ -std=gnu++17 -O2 -Wall \
+    -DCHESS_LINUX_BUILD=1 -DCHESS_INKPLATE_BUILD=0 \
+    -DMAIN_FOLDER=\"$(pwd)/SDCard\" \
+    -Iinclude_global -Iinclude -Ilib/tools -Ilib/chess-engine \
+    -Ilib_headless/EPub_InkPlate/src -Ilib_linux/EPub_InkPlate/src -Ilib_linux/tools/src \
+    $(pkg-config --cflags freetype2) \
+    lib/chess-engine/*.cpp lib_headless/EPub_InkPlate/src/screen.cpp lib_linux/tools/src/*.cpp \
+    src/models/fonts.cpp src/models/ttf2.cpp src/models/bitmap_font.cpp src/models/config.cpp \
+    src/models/game_analysis.cpp \
+    src/viewers/page.cpp src/viewers/board_viewer.cpp src/viewers/menu_viewer.cpp \
+    src/viewers/form_viewer.cpp src/viewers/msg_viewer.cpp \
+    tools/ui_bench.cpp \
+    -o tools/ui_bench $(pkg-config --libs freetype2) -lpthread
@@ -0,0 +1,614 @@
+// Chess-InkPlate chess engine
+//
+// Self-play match runner (Linux)
+//
+// (c) 2021 - GPL-3.0
+//
+// Plays games between two engine settings (A and B), to tell whether a
+// change improves the play:
+//
+//   selfplay [options] [openings file]
+//
+//   -g games        Maximum number of games (default 1000)
+//   -c count        Games played at the same time (default: number of cores)
+//   -t ms           Time per move (default 100)
+//   -n nodes        Nodes per move, instead of a time
+//   -a settings     Engine A settings, e.g. "null=0,futility=0"
+//   -b settings     Engine B settings
+//   -e elo0,elo1    SPRT hypotheses, in Elo (default 0,5)
+//   -p alpha,beta   SPRT error probabilities (default 0.05,0.05)
+//   -m plies        Game length after which a draw is declared (default 400)
+//   --nnue file     Network used by the settings with nnue=1
+//   --bitbases dir  Bitbases used by the settings with bitbases=1
+//
+// Settings are comma separated: null, futility, lazy, nnue and bitbases
+// (0 or 1, all 1 by default), and build=<program>, to have the moves
+// played by another build of this tool, run with --serve. In that mode,
+// a FEN is read from stdin for each move, and the step found with the -a
+// settings is written back as "c1 c2 type", or "none <end of game type>".
+//
+// The openings file holds one FEN (or EPD) per line. Each opening is
+// played twice, both engines taking the white side once. Each game is
+// played by its own process, using a single search thread. After each
+// game, the Elo difference of A over B is estimated and a sequential
+// probability ratio test (SPRT) tells if A is better than B by elo1
+// (H1) rather than by elo0 (H0), stopping the match when one of them is
+// accepted.
+
+#include "chess_engine.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct Settings {
+  bool        null_move = true;
+  bool        futility  = true;
+  bool        lazy_eval = true;
+  bool        nnue      = true;
+  bool        bitbases  = true;
+  std::string build;             // Another build of this tool, empty for this one
+  std::string options;           // As given on the command line, less the build
+};
+
+static Settings    settings[2];  // A and B
+static int         max_games     = 1000;
+static int         concurrency   = std::max(1U, std::thread::hardware_concurrency());
+static uint32_t    time_ms       = 100;
+static uint32_t    nodes         = 0;
+static double      elo0          = 0.0, elo1  = 5.0;
+static double      alpha         = 0.05, beta = 0.05;
+static int         max_plies     = 400;
+static std::string nnue_filename;
+static std::string bitbases_folder;
+
+static std::vector<std::string> openings = {
+  "rnbqkbnr/pppp1ppp/8/4p3/4P3/8/PPPP1PPP/RNBQKBNR w KQkq -",   // 1. e4 e5
+  "rnbqkbnr/pp1ppppp/8/2p5/4P3/8/PPPP1PPP/RNBQKBNR w KQkq -",   // 1. e4 c5
+  "rnbqkbnr/pppp1ppp/4p3/8/4P3/8/PPPP1PPP/RNBQKBNR w KQkq -",   // 1. e4 e6
+  "rnbqkbnr/pp1ppppp/2p5/8/4P3/8/PPPP1PPP/RNBQKBNR w KQkq -",   // 1. e4 c6
+  "rnbqkbnr/ppp1pppp/8/3p4/3P4/8/PPP1PPPP/RNBQKBNR w KQkq -",   // 1. d4 d5
+  "rnbqkb1r/pppppppp/5n2/8/3P4/8/PPP1PPPP/RNBQKBNR w KQkq -",   // 1. d4 Nf6
+  "rnbqkbnr/pppp1ppp/8/4p3/2P5/8/PP1PPPPP/RNBQKBNR w KQkq -",   // 1. c4 e5
+  "rnbqkbnr/ppp1pppp/8/3p4/8/5N2/PPPPPPPP/RNBQKB1R w KQkq -",   // 1. Nf3 d5
+};
+
+static bool
+parse_settings(const std::string & str, Settings & s)
+{
+  std::istringstream stream(str);
+  std::string        item;
+
+  while (std::getline(stream, item, ',')) {
+    std::size_t eq = item.find('=');
+    if (eq == std::string::npos) return false;
+
+    std::string key   = item.substr(0, eq);
+    std::string value = item.substr(eq + 1);
+
+    if (key == "build") {
+      s.build = value;
+      continue;
+    }
+
+    bool active = value != "0";
+
+    if      (key == "null"    ) s.null_move = active;
+    else if (key == "futility") s.futility  = active;
+    else if (key == "lazy"    ) s.lazy_eval = active;
+    else if (key == "nnue"    ) s.nnue      = active;
+    else if (key == "bitbases") s.bitbases  = active;
+    else return false;
+
+    if (!s.options.empty()) s.options += ',';
+    s.options += item;
+  }
+
+  return true;
+}
+
+// ----- Game -------------------------------------------------------------
+
+// Engine of one side, in the game process
+
+class Player
+{
+  public:
+    Player() : pid(-1), in(nullptr), out(nullptr) { }
+   ~Player() { stop(); }
+
+    bool start(const Settings & s);
+    void stop();
+
+    // Best step of position 0. false at the end of the game, with its type.
+
+    bool play(Step & best, EndOfGameType & end);
+
+  private:
+    Settings settings;
+    pid_t    pid;
+    FILE   * in;
+    FILE   * out;
+};
+
+bool
+Player::start(const Settings & s)
+{
+  settings = s;
+  if (settings.build.empty()) return true;
+
+  int to_child[2], from_child[2];
+  if ((pipe(to_child) != 0) || (pipe(from_child) != 0)) return false;
+
+  pid = fork();
+  if (pid < 0) return false;
+
+  if (pid == 0) {
+    dup2(to_child[0],   STDIN_FILENO);
+    dup2(from_child[1], STDOUT_FILENO);
+    close(to_child[1]);
+    close(from_child[0]);
+
+    std::string limit = std::to_string(nodes != 0 ? nodes : time_ms);
+    std::vector<const char *> args = {
+      settings.build.c_str(), "--serve", (nodes != 0) ? "-n" : "-t", limit.c_str()
+    };
+    if (!settings.options.empty()) { args.push_back("-a");         args.push_back(settings.options.c_str()); }
+    if (!nnue_filename.empty())    { args.push_back("--nnue");     args.push_back(nnue_filename.c_str());    }
+    if (!bitbases_folder.empty())  { args.push_back("--bitbases"); args.push_back(bitbases_folder.c_str());  }
+    args.push_back(nullptr);
+
+    execv(settings.build.c_str(), const_cast<char * const *>(args.data()));
+    std::cerr << "Unable to run " << settings.build << std::endl;
+    _exit(1);
+  }
+
+  close(to_child[0]);
+  close(from_child[1]);
+
+  in  = fdopen(from_child[0], "r");
+  out = fdopen(to_child[1],   "w");
+
+  return (in != nullptr) && (out != nullptr);
+}
+
+void
+Player::stop()
+{
+  if (out != nullptr) fclose(out);
+  if (in  != nullptr) fclose(in);
+  if (pid  > 0      ) waitpid(pid, nullptr, 0);
+
+  in  = out = nullptr;
+  pid = -1;
+}
+
+static bool
+search(const Settings & s, Step & best, EndOfGameType & end)
+{
+  chess_engine.set_null_move(s.null_move);
+  chess_engine.set_futility (s.futility );
+  chess_engine.set_lazy_eval(s.lazy_eval);
+  chess_engine.set_nnue     (s.nnue     );
+  chess_engine.set_bitbases (s.bitbases );
+
+  Position * pos       = chess_engine.get_pos(0);
+  Step     * best_move = chess_engine.get_best_move(0);
+
+  for (int i = 0; i < MAXEPD; i++) best_move[i].c1 = -1;
+  pos[0].best.c1 = -1;
+
+  chess_engine.new_game();
+  chess_engine.solve_step();
+
+  if (pos[0].best.c1 == -1) {
+    end = chess_engine.get_end_of_game_type();
+    return false;
+  }
+
+  best = pos[0].best;
+  return true;
+}
+
+bool
+Player::play(Step & best, EndOfGameType & end)
+{
+  if (settings.build.empty()) return search(settings, best, end);
+
+  char line[100];
+  int  c1, c2, type;
+
+  fprintf(out, "%s\n", chess_engine.export_pos_to_fen(0).c_str());
+  fflush(out);
+
+  if (fgets(line, sizeof(line), in) == nullptr) {
+    end = EndOfGameType::NONE;
+    return false;
+  }
+
+  if (sscanf(line, "none %d", &type) == 1) {
+    end = (EndOfGameType) type;
+    return false;
+  }
+
+  if (sscanf(line, "%d %d %d", &c1, &c2, &type) != 3) {
+    end = EndOfGameType::NONE;
+    return false;
+  }
+
+  best.c1   = c1;
+  best.c2   = c2;
+  best.type = (MoveType) type;
+
+  return true;
+}
+
+// Same as GameController::engine_play(): the step is played on position 0,
+// which then becomes the next position. false if the step is not legal.
+
+static bool
+play_step(const Step & best, Step & played)
+{
+  Position * pos = chess_engine.get_pos(0);
+
+  chess_engine.generate_steps(0);
+
+  for (int i = 0; i < pos[0].steps_count; i++) {
+    Step & step = pos[0].steps[i];
+
+    if ((step.c1 != best.c1) || (step.c2 != best.c2) || (step.type != best.type)) continue;
+
+    chess_engine.move_step(0, step);
+    if (pos[0].white_move ? chess_engine.check_on_white_king() : chess_engine.check_on_black_king()) {
+      chess_engine.back_step(0, step);
+      return false;
+    }
+    chess_engine.move_pos(0, step);
+
+    played = step;
+
+    pos[1].white_move = !pos[0].white_move;
+    pos[0]            =  pos[1];
+
+    return true;
+  }
+
+  return false;
+}
+
+// Result from the A side perspective: 1 (win), 0 (draw) or -1 (loss)
+
+static int
+play_game(const std::string & opening, bool a_white, int & plies, std::string & reason)
+{
+  plies = 0;
+
+  chess_engine.setup(0, 1);
+  chess_engine.set_time_limit((nodes != 0) ? 3600000 : time_ms);
+  chess_engine.set_node_limit(nodes);
+
+  if (!nnue_filename.empty()  ) chess_engine.load_nnue(nnue_filename.c_str());
+  if (!bitbases_folder.empty()) chess_engine.load_bitbases(bitbases_folder.c_str());
+
+  Player players[2];  // A, B
+  for (int i = 0; i < 2; i++) {
+    if (!players[i].start(settings[i])) {
+      reason = "unable to start engine";
+      return 0;
+    }
+  }
+
+  chess_engine.load_board_from_fen(opening);
+
+  Position                 * pos       = chess_engine.get_pos(0);
+  int                        quiet     = 0;  // Plies since the last capture or pawn move
+  std::map<std::string, int> seen;
+
+  for (plies = 0; plies < max_plies; plies++) {
+    int           side  = (pos[0].white_move == a_white) ? 0 : 1;
+    int           sign  = (side == 0) ? 1 : -1;
+    Step          best, played;
+    EndOfGameType end;
+
+    if (++seen[chess_engine.export_pos_to_fen(0)] >= 3) {
+      reason = "repetition";
+      return 0;
+    }
+
+    if (!players[side].play(best, end)) {
+      switch (end) {
+        case EndOfGameType::CHECKMATE: reason = "checkmate";  return -sign;
+        case EndOfGameType::PAT:       reason = "stalemate";  return 0;
+        case EndOfGameType::DRAW:      reason = "material";   return 0;
+        default:                       reason = "no move";    return -sign;
+      }
+    }
+
+    if (!play_step(best, played)) {
+      reason = "illegal move";
+      return -sign;
+    }
+
+    quiet = ((played.f2 != NO_FIG) || (abs(played.f1) == PAWN)) ? 0 : quiet + 1;
+    if (quiet >= 100) {
+      reason = "fifty moves";
+      return 0;
+    }
+  }
+
+  reason = "length";
+  return 0;
+}
+
+// ----- Serve mode (this build playing for another one) -----------------
+
+static int
+serve()
+{
+  // The engine messages are dropped, stdout being used for the replies
+
+  int reply_fd = dup(STDOUT_FILENO);
+  int null_fd  = open("/dev/null", O_WRONLY);
+  dup2(null_fd, STDOUT_FILENO);
+  FILE * reply = fdopen(reply_fd, "w");
+
+  chess_engine.setup(0, 1);
+  chess_engine.set_time_limit((nodes != 0) ? 3600000 : time_ms);
+  chess_engine.set_node_limit(nodes);
+
+  if (!nnue_filename.empty()  ) chess_engine.load_nnue(nnue_filename.c_str());
+  if (!bitbases_folder.empty()) chess_engine.load_bitbases(bitbases_folder.c_str());
+
+  std::string fen;
+  while (std::getline(std::cin, fen)) {
+    Step          best;
+    EndOfGameType end;
+
+    chess_engine.load_board_from_fen(fen);
+
+    if (search(settings[0], best, end)) fprintf(reply, "%d %d %d\n", best.c1, best.c2, (int) best.type);
+    else                                fprintf(reply, "none %d\n", (int) end);
+    fflush(reply);
+  }
+
+  return 0;
+}
+
+// ----- Match ------------------------------------------------------------
+
+struct Stats {
+  int wins = 0, draws = 0, losses = 0;
+
+  int    count() const { return wins + draws + losses; }
+  double score() const { return (wins + draws * 0.5) / count(); }
+
+  // Variance of a game result
+
+  double variance() const {
+    double s = score();
+    return (wins * (1 - s) * (1 - s) + draws * (0.5 - s) * (0.5 - s) + losses * s * s) / count();
+  }
+
+  static double to_score(double elo) { return 1.0 / (1.0 + std::pow(10.0, -elo / 400.0)); }
+  static double to_elo(double score) {
+    score = std::min(std::max(score, 1e-6), 1.0 - 1e-6);
+    return -400.0 * std::log10(1.0 / score - 1.0);
+  }
+
+  // Log-likelihood ratio of H1 over H0, normal approximation of the
+  // generalized SPRT
+
+  double llr() const {
+    if ((count() == 0) || (variance() <= 0.0)) return 0.0;
+
+    double s0 = to_score(elo0);
+    double s1 = to_score(elo1);
+
+    return count() * (s1 - s0) * (2.0 * score() - s0 - s1) / (2.0 * variance());
+  }
+
+  // Elo difference, with its 95% confidence margin
+
+  double elo(double & margin) const {
+    double deviation = std::sqrt(variance() / count());
+    margin = (to_elo(score() + 1.96 * deviation) - to_elo(score() - 1.96 * deviation)) / 2.0;
+    return to_elo(score());
+  }
+};
+
+struct Game {
+  pid_t pid;
+  int   fd;
+  int   number;
+};
+
+static void
+start_game(int number, std::vector<Game> & running)
+{
+  int fds[2];
+  if (pipe(fds) != 0) {
+    std::cerr << "Unable to create a pipe." << std::endl;
+    exit(1);
+  }
+
+  std::cout.flush();
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    std::cerr << "Unable to start a game." << std::endl;
+    exit(1);
+  }
+
+  if (pid == 0) {
+    close(fds[0]);
+
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+
+    int         plies;
+    std::string reason;
+    int         result = play_game(openings[(number / 2) % openings.size()], (number % 2) == 0, plies, reason);
+
+    std::string line = std::to_string(result) + " " + std::to_string(plies) + " " + reason + "\n";
+    if (write(fds[1], line.c_str(), line.length()) < 0) _exit(1);
+    _exit(0);
+  }
+
+  close(fds[1]);
+  running.push_back({ pid, fds[0], number });
+}
+
+static int
+match()
+{
+  double lower = std::log(beta / (1.0 - alpha));
+  double upper = std::log((1.0 - beta) / alpha);
+
+  std::vector<Game> running;
+  Stats             stats;
+  int               next     = 0;
+  bool              decided  = false;
+
+  std::cout << "SPRT: elo0 " << elo0 << ", elo1 " << elo1 << ", bounds ["
+            << std::setprecision(3) << lower << ", " << upper << "]" << std::endl;
+
+  while (!running.empty() || (!decided && (next < max_games))) {
+    while (!decided && (next < max_games) && ((int) running.size() < concurrency)) start_game(next++, running);
+
+    int   status;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0) break;
+
+    auto game = std::find_if(running.begin(), running.end(), [pid](const Game & g) { return g.pid == pid; });
+    if (game == running.end()) continue;
+
+    char    line[100] = { 0 };
+    ssize_t size      = read(game->fd, line, sizeof(line) - 1);
+    int     number    = game->number;
+
+    close(game->fd);
+    running.erase(game);
+
+    if (decided) continue;
+
+    int  result, plies;
+    char reason[80];
+    if ((size <= 0) || (sscanf(line, "%d %d %79[^\n]", &result, &plies, reason) != 3)) {
+      std::cerr << "Game " << number + 1 << " failed." << std::endl;
+      continue;
+    }
+
+    if      (result > 0) stats.wins++;
+    else if (result < 0) stats.losses++;
+    else                 stats.draws++;
+
+    double margin;
+    double elo = stats.elo(margin);
+    double llr = stats.llr();
+
+    std::cout << "Game " << std::setw(4) << number + 1 << ": A " << (((number % 2) == 0) ? "white" : "black") << ", "
+              << ((result > 0) ? "A wins" : (result < 0) ? "B wins" : "draw  ") << " (" << reason << ", " << plies << " plies)"
+              << "  +" << stats.wins << " =" << stats.draws << " -" << stats.losses
+              << "  Elo " << std::fixed << std::setprecision(1) << elo << " +/- " << margin
+              << "  LLR " << std::setprecision(2) << llr << std::defaultfloat << std::endl;
+
+    if      (llr >= upper) { decided = true; std::cout << "H1 accepted: A is stronger than B by at least " << elo1 << " Elo." << std::endl; }
+    else if (llr <= lower) { decided = true; std::cout << "H0 accepted: A is not stronger than B by "     << elo1 << " Elo." << std::endl; }
+
+    if (decided) {
+      for (auto & g : running) kill(g.pid, SIGTERM);
+    }
+  }
+
+  if (!decided) std::cout << "No SPRT decision after " << stats.count() << " games." << std::endl;
+
+  return 0;
+}
+
+static bool
+read_openings(const char * filename)
+{
+  std::ifstream file(filename);
+  if (!file.is_open()) return false;
+
+  openings.clear();
+
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty() || (line[0] == '#')) continue;
+    openings.push_back(line);
+  }
+
+  return !openings.empty();
+}
+
+static void
+usage(const char * program)
+{
+  std::cerr << "Usage: " << program << " [-g games] [-c count] [-t ms | -n nodes] [-a settings] [-b settings]" << std::endl
+            << "       [-e elo0,elo1] [-p alpha,beta] [-m plies] [--nnue file] [--bitbases dir] [openings file]" << std::endl;
+  exit(1);
+}
+
+int
+main(int argc, char ** argv)
+{
+  bool serving = false;
+  int  arg;
+
+  for (arg = 1; arg < argc; arg++) {
+    std::string option = argv[arg];
+
+    if (option == "--serve") {
+      serving = true;
+      continue;
+    }
+    if ((option[0] != '-') || (arg + 1 >= argc)) break;
+
+    const char * value = argv[++arg];
+
+    if      (option == "-g") max_games   = atoi(value);
+    else if (option == "-c") concurrency = std::max(1, atoi(value));
+    else if (option == "-t") time_ms     = atoi(value);
+    else if (option == "-n") nodes       = atoi(value);
+    else if (option == "-m") max_plies   = atoi(value);
+    else if (option == "-a") { if (!parse_settings(value, settings[0])) usage(argv[0]); }
+    else if (option == "-b") { if (!parse_settings(value, settings[1])) usage(argv[0]); }
+    else if (option == "-e") { if (sscanf(value, "%lf,%lf", &elo0,  &elo1) != 2) usage(argv[0]); }
+    else if (option == "-p") { if (sscanf(value, "%lf,%lf", &alpha, &beta) != 2) usage(argv[0]); }
+    else if (option == "--nnue"    ) nnue_filename   = value;
+    else if (option == "--bitbases") bitbases_folder = value;
+    else usage(argv[0]);
+  }
+
+  if (serving) return serve();
+
+  if (arg < argc) {
+    if (!read_openings(argv[arg])) {
+      std::cerr << "Unable to read openings: " << argv[arg] << std::endl;
+      return 1;
+    }
+    arg++;
+  }
+  if (arg < argc) usage(argv[0]);
+
+  std::cout << openings.size() << " openings, " << concurrency << " games at a time, "
+            << ((nodes != 0) ? std::to_string(nodes) + " nodes" : std::to_string(time_ms) + " ms") << " per move." << std::endl;
+
+  return match();
+}
@@ -0,0 +1,184 @@
+// Copyright (c) 2021 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+// User interface rendering benchmark (Linux, headless)
+//
+// Renders the board, menu, form and message screens repeatedly into the
+// headless screen frame buffer (lib_headless), and reports, for each one,
+// the frames per second and the pixels drawn and updated per frame:
+//
+//   ui_bench [-n frames] [-r 1|3] [-s folder]
+//
+//   -n frames   Frames rendered per screen (default 200)
+//   -r bits     Pixel resolution, 1 or 3 bits (default 1)
+//   -s folder   Save the last frame of each screen as a PGM image there
+//
+// Fonts are taken from MAIN_FOLDER/fonts (see tools/bld_ui_bench.sh).
+
+#include "models/fonts.hpp"
+#include "models/config.hpp"
+#include "viewers/board_viewer.hpp"
+#include "viewers/menu_viewer.hpp"
+#include "viewers/form_viewer.hpp"
+#include "viewers/msg_viewer.hpp"
+#include "viewers/page.hpp"
+#include "chess_engine.hpp"
+#include "screen.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+
+static constexpr int STEP_COUNT = 40;
+
+static Step steps[STEP_COUNT];
+
+static int         frames = 200;
+static std::string snapshots_folder;
+
+// A game to show in the moves list. The moves only have to be legal
+// looking: one of the generated steps is taken at each ply.
+
+static void
+setup_game()
+{
+  Position * pos = chess_engine.get_pos(0);
+
+  chess_engine.load_board_from_fen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq -");
+  pos[0].white_move = true;
+  chess_engine.generate_steps(0);
+
+  for (int i = 0; (i < STEP_COUNT) && (pos[0].steps_count > 0); i++) {
+    steps[i] = pos[0].steps[(i * 7) % pos[0].steps_count];
+
+    chess_engine.move_step(0, steps[i]);
+    chess_engine.move_pos (0, steps[i]);
+
+    chess_engine.generate_steps(1);
+    pos[1].white_move = !pos[0].white_move;
+    pos[0]            =  pos[1];
+  }
+}
+
+static void
+bench(const char * name, std::function<void (int)> render)
+{
+  render(0); // Fonts loading and glyphs rendering are not measured
+
+  screen.reset_stats();
+
+  auto start = std::chrono::steady_clock::now();
+  for (int frame = 1; frame <= frames; frame++) render(frame);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  const Screen::Stats & stats = screen.get_stats();
+
+  printf("%-16s %9.1f frames/s %10.0f pixels drawn/frame %10.0f pixels updated/frame %5.2f updates/frame\n",
+    name,
+    frames / elapsed.count(),
+    (double) stats.pixels_touched / frames,
+    (double) stats.pixels_updated / frames,
+    (double) stats.update_count   / frames);
+
+  if (!snapshots_folder.empty()) {
+    std::string filename = snapshots_folder + "/" + name + ".pgm";
+    if (!screen.save_pgm(filename.c_str())) {
+      std::cerr << "Unable to save " << filename << std::endl;
+    }
+  }
+}
+
+static MenuViewer::MenuEntry menu[] = {
+  { MenuViewer::Icon::RETURN,      "Return to the game",         nullptr },
+  { MenuViewer::Icon::MAIN_PARAMS, "Main parameters",            nullptr },
+  { MenuViewer::Icon::REFRESH,     "Refresh the screen",         nullptr },
+  { MenuViewer::Icon::INFO,        "About the application",      nullptr },
+  { MenuViewer::Icon::END_MENU,    nullptr,                      nullptr }
+};
+
+static int8_t timeout, resolution, battery, heap;
+
+static FormViewer::FormEntry form[] = {
+  { "Minutes Before Sleeping :", &timeout,    3, FormViewer::timeout_choices,    FormViewer::FormEntryType::HORIZONTAL_CHOICES },
+  { "Pixel Resolution :",        &resolution, 2, FormViewer::resolution_choices, FormViewer::FormEntryType::HORIZONTAL_CHOICES },
+  { "Show Battery Level :",      &battery,    4, FormViewer::battery_visual,     FormViewer::FormEntryType::VERTICAL_CHOICES   },
+  { "Show Heap Size :",          &heap,       2, FormViewer::yes_no_choices,     FormViewer::FormEntryType::HORIZONTAL_CHOICES }
+};
+
+static void
+usage()
+{
+  std::cerr << "Usage: ui_bench [-n frames] [-r 1|3] [-s folder]" << std::endl;
+  exit(1);
+}
+
+int
+main(int argc, char ** argv)
+{
+  Screen::PixelResolution pixel_resolution = Screen::PixelResolution::ONE_BIT;
+
+  for (int arg = 1; arg < argc; arg++) {
+    if      ((strcmp(argv[arg], "-n") == 0) && (arg + 1 < argc)) frames = atoi(argv[++arg]);
+    else if ((strcmp(argv[arg], "-r") == 0) && (arg + 1 < argc)) {
+      pixel_resolution = (atoi(argv[++arg]) == 3) ? Screen::PixelResolution::THREE_BITS :
+                                                    Screen::PixelResolution::ONE_BIT;
+    }
+    else if ((strcmp(argv[arg], "-s") == 0) && (arg + 1 < argc)) snapshots_folder = argv[++arg];
+    else usage();
+  }
+
+  if (frames <= 0) usage();
+
+  if (!fonts.setup()) {
+    std::cerr << "Unable to load fonts from " FONTS_FOLDER "." << std::endl;
+    return 1;
+  }
+
+  screen.setup(pixel_resolution, Screen::Orientation::BOTTOM);
+
+  chess_engine.setup(15, 1);
+  setup_game();
+
+  printf("%d frames per screen, %d-bit pixels.\n", frames,
+    (pixel_resolution == Screen::PixelResolution::ONE_BIT) ? 1 : 3);
+
+  // Whole board screen, as after a menu
+
+  bench("board", [](int frame) {
+    board_viewer.invalidate();
+    board_viewer.show_board(true, Pos(3, 1), Pos(-1, -1), steps, STEP_COUNT, "Your move.");
+  });
+
+  // Cursor moves on the board: only the changes are painted
+
+  bench("board-cursor", [](int frame) {
+    board_viewer.show_board(true, Pos(frame & 7, 1), Pos(-1, -1), steps, STEP_COUNT, "Your move.");
+  });
+
+  // Moves played one after the other: only the end of the moves list is
+  // laid out and painted again
+
+  bench("board-moves", [](int frame) {
+    board_viewer.show_board(true, Pos(3, 1), Pos(-1, -1), steps, 1 + (frame % STEP_COUNT), "Your move.");
+  });
+
+  bench("menu", [](int frame) {
+    menu_viewer.show(menu, frame & 3, true);
+  });
+
+  bench("form", [](int frame) {
+    form_viewer.show(form, 4, "Select an entry with the cursor keys.");
+  });
+
+  bench("message", [](int frame) {
+    msg_viewer.show(MsgViewer::Severity::INFO, false, true, "Benchmark",
+      "Message number %d, shown on a cleared screen.", frame);
+  });
+
+  return 0;
+}